@@ -0,0 +1,116 @@
+#ifndef ACTIVATIONFUNCTION_H_INCLUDED
+#define ACTIVATIONFUNCTION_H_INCLUDED
+
+#include <math.h>
+#include "EActivationFunction.h"
+
+#define EULER_NUMBER 2.71828182845904523536
+
+/**
+    The activation functions and their derivatives, shared by everything which
+    evaluates a neuron (Neuron itself, weight snapshots, batched trainers)
+*/
+inline float activate(EActivationFunction function, float input)
+{
+    switch (function)
+    {
+        case LINEAR:
+			return input;
+
+		case HEAVISIDE: // 0 to 1
+			if (input > 0) return 1;
+			else if (input == 0) return 0.5f;
+			else return 0;
+
+		case LOGISTIC: // From 0 to 1
+			return 1.0f / (1.0f + (float) pow(EULER_NUMBER, -input));
+
+        case SOFTMAX:
+            return 0;
+
+		case TANH: // From -1 to 1
+			return tanh(input);
+
+		case TANH01: // From 0 to 1
+			return tanh(input) / 2.0f + 0.5f;
+
+        case RECTIFIED_LINEAR_UNIT:
+            if (input < 0) return 0;
+            return input;
+
+		case ARCTAN: // From -pi/2 to pi/2
+			return atan(input);
+
+        case ARCTAN01: // From 0 to 1
+			return atan(input) / 3.14159265358979f + 0.5f;
+
+		case SYMMETRICAL_HARD_LIMIT: // -1 to 1
+			if (input > 0) return 1;
+			else if (input == 0) return 0;
+			else return -1;
+
+		case SINUSOID: // -1 to 1
+			return sin(input);
+
+        case SINUSOID01: // 0 to 1
+			return sin(input) / 2.0f + 0.5f;
+
+		case GAUSSIAN: // 0 to 1
+			return pow(EULER_NUMBER, -input * input);
+
+		default:
+			return input; // Assume linear otherwise
+    }
+}
+
+inline float activateDerived(EActivationFunction function, float input)
+{
+    switch (function)
+    {
+		case LINEAR:
+			return 1;
+
+		case HEAVISIDE:
+		    // if (input == 0) return std::numeric_limits<float>::infinity();
+			return 0; // Will not work with back propagation
+
+		case LOGISTIC:
+			return activate(function, input) * (1.0f - activate(function, input));
+
+        case SOFTMAX:
+            return 0;
+
+		case TANH:
+			return 1.0f - pow(activate(function, input), 2.0f);
+
+		case TANH01:
+			return (1.0f - pow(activate(function, input), 2.0f)) / 2.0f;
+
+        case RECTIFIED_LINEAR_UNIT:
+            if (input < 0) return 0;
+            return 1;
+
+		case ARCTAN:
+			return 1.0f / (input * input + 1.0f);
+
+        case ARCTAN01:
+			return 1.0f / (input * input + 1.0f) / 3.14159265358979f; // Unsure here
+
+		case SYMMETRICAL_HARD_LIMIT:
+			return 0;
+
+		case SINUSOID:
+			return cos(input);
+
+		case SINUSOID01:
+			return cos(input) / 2.0f;
+
+		case GAUSSIAN:
+			return -2 * input * pow(EULER_NUMBER, -input * input);
+
+		default:
+			return 1; // Assume linear otherwise
+    }
+}
+
+#endif // ACTIVATIONFUNCTION_H_INCLUDED
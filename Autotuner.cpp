@@ -0,0 +1,473 @@
+#include "Autotuner.h"
+#include "NeuralNetwork.h"
+#include "NetworkSnapshot.h"
+#include "SparseVector.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <stdio.h>
+#include <string.h>
+
+static std::atomic<Autotuner*> attachedAutotuner(nullptr);
+static thread_local int forcedDotBlockSize = -1; // Set while a candidate is being measured
+static thread_local bool tuningThread = false; // Set while tune runs, it measures whatever autoTune says
+
+static int tunedDotBlockSize(const char* type, int x1, int x2, int y1)
+{
+    if (forcedDotBlockSize >= 0)
+        return forcedDotBlockSize;
+
+    Autotuner* autotuner = attachedAutotuner.load();
+    return autotuner != nullptr ? autotuner->getDotBlockSize(type, x1, x2, y1) : 0;
+}
+
+static int roundUpPowerOfTwo(int value)
+{
+    int rounded = 1;
+    while (rounded < value)
+        rounded <<= 1;
+    return rounded;
+}
+
+static unsigned int getLog2(int powerOfTwo)
+{
+    unsigned int log = 0;
+    while ((1 << log) < powerOfTwo)
+        log++;
+    return log;
+}
+
+// The element type and the three rounded sizes packed into 16 bits, the key of the lock free table
+static unsigned int getDotShape(bool isDouble, int x1, int x2, int y1)
+{
+    return (isDouble ? 1u << 15 : 0u) | getLog2(roundUpPowerOfTwo(x1)) << 10 | getLog2(roundUpPowerOfTwo(x2)) << 5 | getLog2(roundUpPowerOfTwo(y1));
+}
+
+/**
+    Seconds per call, the best of three rounds which each run for a third of minimumSeconds
+*/
+template <class Function>
+static double measure(Function function, double minimumSeconds)
+{
+    function(); // Warm up the caches and the allocator
+    double best = std::numeric_limits<double>::max();
+    for (int round = 0; round < 3; round++)
+    {
+        int calls = 0;
+        double elapsed = 0;
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            function();
+            calls++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < minimumSeconds / 3);
+        best = std::min(best, elapsed / calls);
+    }
+    return best;
+}
+
+template <class T>
+static int benchmarkDot(int x1, int x2, int y1, double minimumSeconds, double& bestSeconds)
+{
+    Matrix<T> matrix1(x1, y1), matrix2(x2, x1), result;
+    for (int i = 0; i < x1; i++)
+        for (int j = 0; j < y1; j++)
+            matrix1[i][j] = T((i * 7 + j * 3) % 17) / 17;
+    for (int i = 0; i < x2; i++)
+        for (int j = 0; j < x1; j++)
+            matrix2[i][j] = T((i * 5 + j * 11) % 13) / 13;
+
+    // 0 is the plain loop over whole columns
+    int bestBlockSize = 0;
+    bestSeconds = std::numeric_limits<double>::max();
+    for (int blockSize = 0; blockSize < y1; blockSize = blockSize == 0 ? 64 : blockSize * 2)
+    {
+        forcedDotBlockSize = blockSize;
+        double seconds = measure([&]() { result.dot(matrix1, matrix2); }, minimumSeconds);
+        if (seconds < bestSeconds)
+        {
+            bestSeconds = seconds;
+            bestBlockSize = blockSize;
+        }
+    }
+    forcedDotBlockSize = -1;
+    return bestBlockSize;
+}
+
+// Layer sizes such as 2-16-1
+static std::string getTopology(const NetworkSnapshot& snapshot)
+{
+    std::ostringstream topology;
+    for (int i = 0; i < (int) snapshot.layerSizes.size(); i++)
+        topology << (i > 0 ? "-" : "") << snapshot.layerSizes[i];
+    return topology.str();
+}
+
+
+// --------------------------------------- Autotuner ---------------------------------------
+Autotuner::Autotuner(const std::string& cacheFileName)
+{
+    fileName = cacheFileName;
+    cpuKey = getCpuKey();
+    autoTune = true;
+    minimumSeconds = 0.03;
+    changed = false;
+    clearDotBlockSizes();
+    if (!fileName.empty())
+        load();
+}
+
+Autotuner::~Autotuner()
+{
+    detachFromMatrix();
+    if (changed && !fileName.empty())
+        save();
+}
+
+std::string Autotuner::getCpuKey()
+{
+    std::string model = "unknown";
+    std::ifstream cpuInfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuInfo, line))
+    {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+        {
+            model = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+
+    std::string features;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) features += " sse4.2";
+    if (__builtin_cpu_supports("avx")) features += " avx";
+    if (__builtin_cpu_supports("avx2")) features += " avx2";
+    if (__builtin_cpu_supports("fma")) features += " fma";
+    if (__builtin_cpu_supports("avx512f")) features += " avx512f";
+    if (__builtin_cpu_supports("avx512vpopcntdq")) features += " avx512vpopcntdq";
+#endif
+
+    // The kernels compiled in matter as much as what the CPU could run
+    std::string build = "generic";
+#if defined(__AVX512F__)
+    build = "avx512f";
+#elif defined(__AVX2__)
+    build = "avx2";
+#elif defined(__AVX__)
+    build = "avx";
+#endif
+
+    return model + " |" + features + " | build " + build + " | threads " + std::to_string(std::thread::hardware_concurrency());
+}
+
+std::string Autotuner::makeKey(ETunedOperation operation, const char* type, const std::string& shape)
+{
+    const char* names[] = {"MATRIX_DOT", "EVALUATION", "INPUT_REPRESENTATION"};
+    return std::string(names[operation]) + " " + type + " " + shape;
+}
+
+/**
+    Open addressing with linear probing, slots are only ever filled or
+    overwritten with the same shape so a reader sees either nothing or a
+    complete entry
+*/
+int Autotuner::lookUpDotBlockSize(unsigned int shape)
+{
+    unsigned int slot = (shape * 2654435761u) >> 24;
+    for (int probe = 0; probe < DOT_BLOCK_SIZE_SLOTS; probe++)
+    {
+        unsigned long long entry = dotBlockSizes[(slot + probe) % DOT_BLOCK_SIZE_SLOTS].load(std::memory_order_acquire);
+        if (entry == 0)
+            return -1;
+        if ((entry >> 32) == shape + 1)
+            return (int) (entry & 0xFFFFFFFF);
+    }
+    return -1;
+}
+
+void Autotuner::publishDotBlockSize(unsigned int shape, int blockSize)
+{
+    unsigned long long newEntry = (unsigned long long) (shape + 1) << 32 | (unsigned int) blockSize;
+    unsigned int slot = (shape * 2654435761u) >> 24;
+    for (int probe = 0; probe < DOT_BLOCK_SIZE_SLOTS; probe++)
+    {
+        std::atomic<unsigned long long>& entry = dotBlockSizes[(slot + probe) % DOT_BLOCK_SIZE_SLOTS];
+        unsigned long long expected = 0;
+        if (entry.compare_exchange_strong(expected, newEntry, std::memory_order_acq_rel) || (expected >> 32) == shape + 1)
+        {
+            entry.store(newEntry, std::memory_order_release);
+            return;
+        }
+    }
+    // A full table only means the slow path keeps answering for this shape
+}
+
+void Autotuner::clearDotBlockSizes()
+{
+    for (int i = 0; i < DOT_BLOCK_SIZE_SLOTS; i++)
+        dotBlockSizes[i].store(0, std::memory_order_release);
+}
+
+bool Autotuner::find(const std::string& key, std::string& configuration)
+{
+    std::map<std::string, std::string>::iterator entry = entries.find(key);
+    if (entry == entries.end())
+        return false;
+    configuration = entry->second;
+    return true;
+}
+
+void Autotuner::store(const std::string& key, const std::string& configuration, double seconds)
+{
+    entries[key] = configuration;
+    timings[key] = seconds;
+    changed = true;
+}
+
+/**
+    The cache file has one entry per line: CPU key, operation key, configuration and
+    the time of the winner, separated by tabs
+*/
+bool Autotuner::load()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ifstream file(fileName);
+    if (!file)
+        return false; // Nothing tuned yet
+
+    entries.clear();
+    timings.clear();
+    otherLines.clear();
+    clearDotBlockSizes();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() != 4)
+            continue;
+
+        if (fields[0] == cpuKey)
+        {
+            entries[fields[1]] = fields[2];
+            timings[fields[1]] = atof(fields[3].c_str());
+        }
+        else
+            otherLines.push_back(line);
+    }
+    changed = false;
+    return true;
+}
+
+bool Autotuner::save()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fileName.empty())
+        return false;
+
+    // Written next to the cache and renamed over it, a crash never leaves half a file
+    std::string temporaryFileName = fileName + ".tmp";
+    {
+        std::ofstream file(temporaryFileName, std::ios::trunc);
+        for (int i = 0; i < (int) otherLines.size(); i++)
+            file << otherLines[i] << "\n";
+        for (std::map<std::string, std::string>::iterator entry = entries.begin(); entry != entries.end(); entry++)
+            file << cpuKey << "\t" << entry->first << "\t" << entry->second << "\t" << timings[entry->first] << "\n";
+        if (!file.flush())
+        {
+            std::cout << "Autotuner: Could not write " << temporaryFileName << std::endl;
+            return false;
+        }
+    }
+    if (rename(temporaryFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::cout << "Autotuner: Could not rename " << temporaryFileName << std::endl;
+        return false;
+    }
+    changed = false;
+    return true;
+}
+
+int Autotuner::getDotBlockSize(const char* type, int x1, int x2, int y1)
+{
+    /// 1) Shapes resolved before come from the lock free table, tune looks again
+    bool isDouble = strcmp(type, "double") == 0;
+    unsigned int shape = getDotShape(isDouble, x1, x2, y1);
+    int blockSize = tuningThread ? -1 : lookUpDotBlockSize(shape);
+    if (blockSize >= 0)
+        return blockSize;
+
+    /// 2) The cache entry, or the default while the shape is not measured by this thread
+    std::string key = makeKey(MATRIX_DOT, type, "x1=" + std::to_string(roundUpPowerOfTwo(x1)) + " x2=" + std::to_string(roundUpPowerOfTwo(x2))
+                              + " y1=" + std::to_string(roundUpPowerOfTwo(y1)));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string configuration;
+        if (find(key, configuration))
+        {
+            blockSize = atoi(configuration.c_str());
+            publishDotBlockSize(shape, blockSize);
+            return blockSize;
+        }
+        if (!autoTune && !tuningThread)
+        {
+            publishDotBlockSize(shape, 0);
+            return 0;
+        }
+        if (pendingKeys.count(key) > 0)
+            return 0; // Another thread is measuring it
+        pendingKeys.insert(key);
+    }
+
+    /// 3) Measured without the lock, other threads keep multiplying meanwhile
+    double seconds;
+    blockSize = isDouble ? benchmarkDot<double>(x1, x2, y1, minimumSeconds, seconds)
+                         : benchmarkDot<float>(x1, x2, y1, minimumSeconds, seconds);
+    std::lock_guard<std::mutex> lock(mutex);
+    store(key, std::to_string(blockSize), seconds);
+    publishDotBlockSize(shape, blockSize);
+    pendingKeys.erase(key);
+    return blockSize;
+}
+
+void Autotuner::getEvaluationSettings(NeuralNetwork& network, const Matrix<float>& sampleBatch, int& batchSize, int& numberOfThreads)
+{
+    // The defaults of evaluate
+    batchSize = 256;
+    numberOfThreads = 1;
+
+    NetworkSnapshot snapshot;
+    snapshot.capture(network);
+    if (snapshot.isEmpty() || sampleBatch.getSizeX() != snapshot.getInputSize() || sampleBatch.getSizeY() == 0)
+        return;
+
+    int numberOfSamples = sampleBatch.getSizeY();
+    std::string key = makeKey(EVALUATION, "float", getTopology(snapshot) + " n=" + std::to_string(roundUpPowerOfTwo(numberOfSamples)));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string configuration;
+        if (find(key, configuration))
+        {
+            std::istringstream(configuration) >> batchSize >> numberOfThreads;
+            return;
+        }
+        if (!autoTune && !tuningThread)
+            return;
+    }
+
+    Matrix<float> targets(snapshot.getOutputSize(), numberOfSamples);
+    targets.clear();
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double bestSeconds = std::numeric_limits<double>::max();
+    for (int batch = 32; batch <= 1024; batch *= 2)
+    {
+        for (int threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            double seconds = measure([&]() { snapshot.evaluate(sampleBatch, targets, batch, threads); }, minimumSeconds);
+            if (seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                batchSize = batch;
+                numberOfThreads = threads;
+            }
+        }
+        if (batch >= numberOfSamples)
+            break; // Larger batches are the same
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    store(key, std::to_string(batchSize) + " " + std::to_string(numberOfThreads), bestSeconds);
+}
+
+bool Autotuner::prefersSparseInput(NeuralNetwork& network, const Matrix<float>& sampleBatch)
+{
+    if (network.layers.size() < 2 || network.layers[1].layerType != FULLY_CONNECTED
+        || sampleBatch.getSizeX() != network.layers[0].size() || sampleBatch.getSizeY() == 0)
+        return false;
+
+    // Samples as dense columns and as sparse vectors, converted before measuring
+    int dimensions = sampleBatch.getSizeX();
+    int numberOfSamples = sampleBatch.getSizeY();
+    std::vector<Matrix<float>> denseSamples(numberOfSamples);
+    std::vector<SparseVector> sparseSamples(numberOfSamples);
+    long long nonZeros = 0;
+    for (int s = 0; s < numberOfSamples; s++)
+    {
+        denseSamples[s].setSize(dimensions, 1);
+        for (int k = 0; k < dimensions; k++)
+            denseSamples[s][k][0] = sampleBatch[k][s];
+        sparseSamples[s].fromDense(denseSamples[s]);
+        nonZeros += sparseSamples[s].getNonZeroCount();
+    }
+
+    // Density rounded to a power of two fraction, 1/1 down to 1/dimensions
+    int inverseDensity = roundUpPowerOfTwo((int) std::max(1LL, (long long) dimensions * numberOfSamples / std::max(1LL, nonZeros)));
+    std::string key = makeKey(INPUT_REPRESENTATION, "float", "in=" + std::to_string(roundUpPowerOfTwo(dimensions)) + " out="
+                              + std::to_string(roundUpPowerOfTwo(network.layers[1].size())) + " density=1/" + std::to_string(inverseDensity));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string configuration;
+        if (find(key, configuration))
+            return configuration == "sparse";
+        if (!autoTune && !tuningThread)
+            return false;
+    }
+
+    double denseSeconds = measure([&]() { for (int s = 0; s < numberOfSamples; s++) network.forwardPropagation(denseSamples[s]); }, minimumSeconds);
+    double sparseSeconds = measure([&]() { for (int s = 0; s < numberOfSamples; s++) network.forwardPropagation(sparseSamples[s]); }, minimumSeconds);
+    bool sparse = sparseSeconds < denseSeconds;
+    std::lock_guard<std::mutex> lock(mutex);
+    store(key, sparse ? "sparse" : "dense", std::min(denseSeconds, sparseSeconds) / numberOfSamples);
+    return sparse;
+}
+
+void Autotuner::tune(NeuralNetwork& network, const Matrix<float>& sampleBatch)
+{
+    tuningThread = true;
+
+    /// 1) The products of the convolution layers (forward and error propagation)
+    for (int i = 1; i < network.layers.size(); i++)
+    {
+        NeuralNetworkLayer& layer = network.layers[i];
+        if (layer.layerType != CONVOLUTION)
+            continue;
+        int patchSize = layer.inputChannels * layer.kernelSize * layer.kernelSize;
+        int positions = layer.outputWidth * layer.outputHeight;
+        if ((long long) patchSize * layer.outputChannels * positions >= MATRIX_DOT_TUNING_WORK)
+        {
+            getDotBlockSize("float", patchSize, layer.outputChannels, positions);
+            getDotBlockSize("float", layer.outputChannels, patchSize, positions);
+        }
+    }
+
+    /// 2) Batched evaluation and the input representation of fully connected networks
+    int batchSize, numberOfThreads;
+    getEvaluationSettings(network, sampleBatch, batchSize, numberOfThreads);
+    prefersSparseInput(network, sampleBatch);
+
+    tuningThread = false;
+    if (!fileName.empty())
+        save();
+}
+
+void Autotuner::attachToMatrix()
+{
+    attachedAutotuner.store(this);
+    matrixDotBlockSize.store(tunedDotBlockSize, std::memory_order_release);
+}
+
+void Autotuner::detachFromMatrix()
+{
+    Autotuner* expected = this;
+    if (attachedAutotuner.compare_exchange_strong(expected, nullptr))
+        matrixDotBlockSize.store(nullptr, std::memory_order_release);
+}
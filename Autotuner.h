@@ -0,0 +1,84 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include "Matrix.h"
+#include "ETunedOperation.h"
+
+class NeuralNetwork;
+
+/**
+    Picks kernel configurations by measuring them on the machine at hand.
+
+    Every (operation, element type, shape) is benchmarked over its candidate
+    configurations the first time it is asked for, and the fastest one is kept.
+    The results are stored in a cache file under a key of the CPU model and its
+    instruction set (as detected and as compiled), so every CPU generation gets
+    its own winners and a restarted process does not tune again. Entries of other
+    CPUs in the file are preserved.
+
+    Shapes are rounded up to powers of two so similar sizes share an entry.
+    Call tune before deployment to measure everything a network needs up front:
+
+        Autotuner autotuner("tuning.cache");
+        autotuner.tune(network, sampleBatch);
+        autotuner.attachToMatrix(); // Matrix::dot follows the tuned block sizes
+
+    Block sizes resolved once are read back without locking, and unknown shapes
+    are measured outside the lock, so threads multiplying other shapes never wait
+    on a benchmark. An attached autotuner must outlive every dot started while
+    it is attached.
+*/
+class Autotuner
+{
+    public:
+        Autotuner(const std::string& cacheFileName = "");
+        ~Autotuner();
+
+        bool load(); // Reads the entries of this CPU from the cache file
+        bool save(); // Writes the cache file, atomically replacing the old one
+
+        // Measures the configurations the network uses on the samples (inputSize, batch) and saves them
+        void tune(NeuralNetwork& network, const Matrix<float>& sampleBatch);
+
+        // Tuned configurations, measured now if unknown and autoTune is set
+        int getDotBlockSize(const char* type, int x1, int x2, int y1);
+        void getEvaluationSettings(NeuralNetwork& network, const Matrix<float>& sampleBatch, int& batchSize, int& numberOfThreads);
+        bool prefersSparseInput(NeuralNetwork& network, const Matrix<float>& sampleBatch);
+
+        void attachToMatrix(); // Installs getDotBlockSize as matrixDotBlockSize
+        void detachFromMatrix();
+
+        static std::string getCpuKey(); // CPU model and instruction set
+
+        bool autoTune; // Measure unknown shapes on first use, otherwise fall back to the defaults (kept for the shape)
+        double minimumSeconds; // Every candidate runs at least this long per measurement
+
+    private:
+        int lookUpDotBlockSize(unsigned int shape); // -1 if the shape was not resolved yet
+        void publishDotBlockSize(unsigned int shape, int blockSize);
+        void clearDotBlockSizes();
+
+        std::string makeKey(ETunedOperation operation, const char* type, const std::string& shape);
+        bool find(const std::string& key, std::string& configuration);
+        void store(const std::string& key, const std::string& configuration, double seconds);
+
+        std::string fileName;
+        std::string cpuKey;
+        std::map<std::string, std::string> entries; // Key to configuration, this CPU only
+        std::map<std::string, double> timings; // Key to the time of the winner
+        std::vector<std::string> otherLines; // Entries of other CPUs
+        bool changed; // Entries not saved yet
+        std::mutex mutex; // Guards the entries, never held while measuring
+        std::set<std::string> pendingKeys; // Shapes being measured by some thread
+
+        static const int DOT_BLOCK_SIZE_SLOTS = 256;
+        std::atomic<unsigned long long> dotBlockSizes[DOT_BLOCK_SIZE_SLOTS]; // (shape + 1) << 32 | block size, 0 is empty
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,369 @@
+#include "BinaryNetwork.h"
+#include "NeuralNetwork.h"
+#include "ActivationFunction.h"
+#include "Random.h"
+#include <iostream>
+#include <math.h>
+
+#ifdef __AVX512VPOPCNTDQ__
+#include <immintrin.h>
+#endif
+
+static bool isHardLimit(EActivationFunction function)
+{
+    return function == HEAVISIDE || function == SYMMETRICAL_HARD_LIMIT;
+}
+
+/**
+    The derivative in training, the hard limits pass the gradient straight through near 0
+    (HEAVISIDE is half a hard tanh, hence half the gradient)
+*/
+static float getTrainingDerivative(EActivationFunction function, float netInput)
+{
+    if (!isHardLimit(function))
+        return activateDerived(function, netInput);
+    if (fabs(netInput) > 1)
+        return 0;
+    return function == HEAVISIDE ? 0.5f : 1.0f;
+}
+
+BinaryNetwork::BinaryNetwork()
+{
+    weightClip = 1;
+    shuffleSeed = Random::getThreadGenerator().next();
+}
+
+BinaryNetwork::~BinaryNetwork()
+{
+
+}
+
+bool BinaryNetwork::capture(NeuralNetwork& network)
+{
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(network))
+    {
+        std::cout << "Binary network: Only fully connected networks can be binarized!" << std::endl;
+        return false;
+    }
+    return build(snapshot);
+}
+
+bool BinaryNetwork::build(const NetworkSnapshot& snapshot)
+{
+    if (snapshot.getNumberOfLayers() < 2)
+    {
+        std::cout << "Binary network: At least one hidden layer is needed!" << std::endl;
+        return false;
+    }
+    for (int i = 0; i + 1 < snapshot.getNumberOfLayers(); i++)
+    {
+        if (!isHardLimit(snapshot.activationFunctions[i]))
+        {
+            std::cout << "Binary network: Hidden layers must use HEAVISIDE or SYMMETRICAL_HARD_LIMIT!" << std::endl;
+            return false;
+        }
+    }
+
+    model = snapshot;
+    pack();
+    return true;
+}
+
+void BinaryNetwork::pack()
+{
+    layers.clear();
+    if (model.getNumberOfLayers() < 2)
+        return;
+
+    /// 1) The first layer stays in float
+    const float* weight = model.weights.data();
+    int firstLayerCount = model.layerSizes[1] * (model.layerSizes[0] + 1);
+    firstLayerWeights.assign(weight, weight + firstLayerCount);
+    weight += firstLayerCount;
+
+    /// 2) Signs and scales of the other layers
+    layers.resize(model.getNumberOfLayers() - 1);
+    for (int i = 0; i < (int) layers.size(); i++)
+    {
+        BinaryLayer& layer = layers[i];
+        layer.inputSize = model.layerSizes[i + 1];
+        layer.size = model.layerSizes[i + 2];
+        layer.words = (layer.inputSize + 63) / 64;
+        layer.activationFunction = model.activationFunctions[i + 1];
+        layer.bits.assign((size_t) layer.size * layer.words, 0);
+        layer.scale.resize(layer.size);
+        layer.bias.resize(layer.size);
+
+        for (int n = 0; n < layer.size; n++)
+        {
+            double absoluteSum = 0;
+            int signSum = 0;
+            uint64_t* neuronBits = &layer.bits[(size_t) n * layer.words];
+            for (int k = 0; k < layer.inputSize; k++)
+            {
+                absoluteSum += fabs(weight[k + 1]);
+                if (weight[k + 1] >= 0)
+                {
+                    neuronBits[k / 64] |= 1ULL << (k % 64);
+                    signSum++;
+                }
+                else
+                    signSum--;
+            }
+
+            // Inputs of 0 and 1 are (s + 1) / 2 for the signs s the kernel works with
+            float alpha = (float) (absoluteSum / layer.inputSize);
+            if (model.activationFunctions[i] == HEAVISIDE)
+            {
+                layer.scale[n] = alpha / 2;
+                layer.bias[n] = weight[0] + alpha * signSum / 2;
+            }
+            else
+            {
+                layer.scale[n] = alpha;
+                layer.bias[n] = weight[0];
+            }
+            weight += layer.inputSize + 1;
+        }
+    }
+}
+
+int BinaryNetwork::countDisagreements(const uint64_t* input, const uint64_t* weights, int words)
+{
+#ifdef __AVX512VPOPCNTDQ__
+    __m512i sum = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 8 <= words; i += 8)
+        sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_xor_si512(_mm512_loadu_si512(input + i), _mm512_loadu_si512(weights + i))));
+    if (i < words)
+    {
+        __mmask8 mask = (__mmask8) ((1u << (words - i)) - 1);
+        sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, input + i),
+                                                                         _mm512_maskz_loadu_epi64(mask, weights + i))));
+    }
+    // Reduced through memory, the reduce and extract intrinsics trip -Wuninitialized in the GCC headers
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, sum);
+    uint64_t count = 0;
+    for (int lane = 0; lane < 8; lane++)
+        count += lanes[lane];
+    return (int) count;
+#else
+    int count = 0;
+    for (int i = 0; i < words; i++)
+        count += __builtin_popcountll(input[i] ^ weights[i]);
+    return count;
+#endif
+}
+
+void BinaryNetwork::forward(const float* dataSample, int stride, std::vector<uint64_t>& bits, std::vector<uint64_t>& nextBits, float* output) const
+{
+    /// 1) First layer in float, the outputs go straight into bits
+    int inputSize = model.layerSizes[0];
+    bits.assign(layers[0].words, 0);
+    const float* weight = firstLayerWeights.data();
+    for (int n = 0; n < model.layerSizes[1]; n++)
+    {
+        float netInput = weight[0];
+        for (int k = 0; k < inputSize; k++)
+            netInput += weight[k + 1] * dataSample[(size_t) k * stride];
+        if (netInput > 0)
+            bits[n / 64] |= 1ULL << (n % 64);
+        weight += inputSize + 1;
+    }
+
+    /// 2) XOR and popcount through the binarized layers
+    for (int i = 0; i < (int) layers.size(); i++)
+    {
+        const BinaryLayer& layer = layers[i];
+        bool outputLayer = i + 1 == (int) layers.size();
+        if (!outputLayer)
+            nextBits.assign(layers[i + 1].words, 0);
+
+        for (int n = 0; n < layer.size; n++)
+        {
+            int agreement = layer.inputSize - 2 * countDisagreements(bits.data(), &layer.bits[(size_t) n * layer.words], layer.words);
+            float netInput = layer.bias[n] + layer.scale[n] * agreement;
+            if (outputLayer)
+                output[n] = activate(layer.activationFunction, netInput);
+            else if (netInput > 0)
+                nextBits[n / 64] |= 1ULL << (n % 64);
+        }
+        if (!outputLayer)
+            bits.swap(nextBits);
+    }
+}
+
+void BinaryNetwork::predict(const Matrix<float>& dataSample, Matrix<float>& output) const
+{
+    if (layers.empty() || dataSample.getSizeX() != model.getInputSize())
+    {
+        std::cout << "Binary network: Incorrect number of feature dimension entered for data sample. Got "
+            << dataSample.getSizeX() << ". Expected " << model.getInputSize() << std::endl;
+        return;
+    }
+
+    std::vector<uint64_t> bits, nextBits;
+    std::vector<float> result(model.getOutputSize());
+    forward(dataSample.getArrayRef(), 1, bits, nextBits, result.data());
+    output.setSize(model.getOutputSize(), 1);
+    for (int i = 0; i < model.getOutputSize(); i++)
+        output[i][0] = result[i];
+}
+
+void BinaryNetwork::predictBatch(const Matrix<float>& dataSamples, Matrix<float>& outputs) const
+{
+    if (layers.empty() || dataSamples.getSizeX() != model.getInputSize())
+    {
+        std::cout << "Binary network: Incorrect number of feature dimension entered for data samples. Got "
+            << dataSamples.getSizeX() << ". Expected " << model.getInputSize() << std::endl;
+        return;
+    }
+
+    // Every feature is a contiguous row over the samples
+    int batchSize = dataSamples.getSizeY();
+    int outputSize = model.getOutputSize();
+    std::vector<uint64_t> bits, nextBits;
+    std::vector<float> result(outputSize);
+    if (outputs.getSizeX() != outputSize || outputs.getSizeY() != batchSize)
+        outputs.setSize(outputSize, batchSize);
+    float* output = outputs.getArrayRef();
+    for (int s = 0; s < batchSize; s++)
+    {
+        forward(dataSamples.getArrayRef() + s, batchSize, bits, nextBits, result.data());
+        for (int i = 0; i < outputSize; i++)
+            output[(size_t) i * batchSize + s] = result[i];
+    }
+}
+
+float BinaryNetwork::train(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs, float learningRate)
+{
+    if (layers.empty() || dataSamples.size() != classificationVectors.size())
+    {
+        std::cout << "Binary network: Build the network and give a target for every sample before training!" << std::endl;
+        return 0;
+    }
+
+    int numberOfLayers = model.getNumberOfLayers();
+    std::vector<size_t> offsets(numberOfLayers, 0);
+    for (int i = 1; i < numberOfLayers; i++)
+        offsets[i] = offsets[i - 1] + (size_t) model.layerSizes[i] * (model.layerSizes[i - 1] + 1);
+
+    // Per layer: the binarized weights, net inputs, outputs (outputs[0] is the sample) and deltas
+    std::vector<std::vector<float>> binarized(numberOfLayers), netInputs(numberOfLayers), outputs(numberOfLayers + 1), deltas(numberOfLayers);
+    for (int i = 0; i < numberOfLayers; i++)
+    {
+        binarized[i].resize((size_t) model.layerSizes[i + 1] * (model.layerSizes[i] + 1));
+        netInputs[i].resize(model.layerSizes[i + 1]);
+        outputs[i + 1].resize(model.layerSizes[i + 1]);
+        deltas[i].resize(model.layerSizes[i + 1]);
+    }
+    outputs[0].resize(model.getInputSize());
+
+    float loss = 0;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        // The order only depends on the seed and the epoch, as in backpropagationStochastic
+        std::vector<int> order(dataSamples.size());
+        for (int i = 0; i < dataSamples.size(); i++)
+            order[i] = i;
+        Random random(shuffleSeed, epoch);
+        for (int i = order.size() - 1; i > 0; i--)
+            std::swap(order[i], order[random.nextInt(i + 1)]);
+
+        loss = 0;
+        for (int sample = 0; sample < (int) order.size(); sample++)
+        {
+            Matrix<float>& dataSample = dataSamples[order[sample]];
+            Array<float>& target = classificationVectors[order[sample]];
+            if (dataSample.getSizeX() != model.getInputSize() || target.size() != model.getOutputSize())
+            {
+                std::cout << "Binary network: Incorrect size of sample " << order[sample] << std::endl;
+                return 0;
+            }
+            for (int k = 0; k < model.getInputSize(); k++)
+                outputs[0][k] = dataSample[k][0];
+
+            /// 1) Forward through the binarized weights, as predict computes it
+            for (int i = 0; i < numberOfLayers; i++)
+            {
+                int inputSize = model.layerSizes[i];
+                const float* latent = model.weights.data() + offsets[i];
+                float* weight = binarized[i].data();
+                for (int n = 0; n < model.layerSizes[i + 1]; n++)
+                {
+                    float alpha = 0; // The first layer keeps its float weights
+                    for (int k = 0; i > 0 && k < inputSize; k++)
+                        alpha += fabs(latent[k + 1]);
+                    alpha /= inputSize;
+                    weight[0] = latent[0];
+                    for (int k = 0; k < inputSize; k++)
+                        weight[k + 1] = i == 0 ? latent[k + 1] : (latent[k + 1] >= 0 ? alpha : -alpha);
+
+                    float netInput = weight[0];
+                    for (int k = 0; k < inputSize; k++)
+                        netInput += weight[k + 1] * outputs[i][k];
+                    netInputs[i][n] = netInput;
+                    if (i + 1 < numberOfLayers)
+                        outputs[i + 1][n] = netInput > 0 ? 1.0f : (model.activationFunctions[i] == HEAVISIDE ? 0.0f : -1.0f);
+                    else
+                        outputs[i + 1][n] = activate(model.activationFunctions[i], netInput);
+                    latent += inputSize + 1;
+                    weight += inputSize + 1;
+                }
+            }
+
+            /// 2) Deltas, straight through the hard limits and the signs
+            int last = numberOfLayers - 1;
+            for (int n = 0; n < model.getOutputSize(); n++)
+            {
+                float error = target[n] - outputs[numberOfLayers][n];
+                loss += error * error;
+                deltas[last][n] = error * getTrainingDerivative(model.activationFunctions[last], netInputs[last][n]);
+            }
+            for (int i = last - 1; i >= 0; i--)
+            {
+                int size = model.layerSizes[i + 1];
+                for (int j = 0; j < size; j++)
+                {
+                    float sum = 0;
+                    for (int n = 0; n < model.layerSizes[i + 2]; n++)
+                        sum += binarized[i + 1][(size_t) n * (size + 1) + j + 1] * deltas[i + 1][n];
+                    deltas[i][j] = sum * getTrainingDerivative(model.activationFunctions[i], netInputs[i][j]);
+                }
+            }
+
+            /// 3) Update the latent weights
+            for (int i = 0; i < numberOfLayers; i++)
+            {
+                int inputSize = model.layerSizes[i];
+                float* latent = model.weights.data() + offsets[i];
+                for (int n = 0; n < model.layerSizes[i + 1]; n++)
+                {
+                    float step = learningRate * deltas[i][n];
+                    latent[0] += step;
+                    for (int k = 0; k < inputSize; k++)
+                    {
+                        latent[k + 1] += step * outputs[i][k];
+                        if (i > 0)
+                            latent[k + 1] = std::max(-weightClip, std::min(weightClip, latent[k + 1]));
+                    }
+                    latent += inputSize + 1;
+                }
+            }
+        }
+        loss /= std::max(1, dataSamples.size());
+    }
+
+    pack();
+    return loss;
+}
+
+long long BinaryNetwork::getWeightBytes() const
+{
+    long long bytes = firstLayerWeights.size() * sizeof(float);
+    for (int i = 0; i < (int) layers.size(); i++)
+        bytes += layers[i].bits.size() * sizeof(uint64_t) + (layers[i].scale.size() + layers[i].bias.size()) * sizeof(float);
+    return bytes;
+}
@@ -0,0 +1,79 @@
+#ifndef BINARYNETWORK_H
+#define BINARYNETWORK_H
+
+#include <vector>
+#include <stdint.h>
+#include "Matrix.h"
+#include "Array.h"
+#include "NetworkSnapshot.h"
+
+class NeuralNetwork;
+
+/**
+    A layer running on bits: the sign of every weight packed into 64 bit words,
+    net = bias + scale * (inputSize - 2 * popcount(input XOR weights))
+*/
+struct BinaryLayer
+{
+    int inputSize, size;
+    int words; // Per neuron, inputSize / 64 rounded up
+    EActivationFunction activationFunction;
+    std::vector<uint64_t> bits; // Neuron by neuron, bit set for weights >= 0
+    std::vector<float> scale, bias; // Per neuron
+};
+
+/**
+    Inference (and training) with binarized weights for networks whose hidden
+    layers use HEAVISIDE or SYMMETRICAL_HARD_LIMIT.
+
+    The hidden layers only put out two values, so their outputs are kept as bits
+    and every layer after the first is reduced to the sign of its weights times
+    one scale per neuron, the mean absolute weight (as in XNOR-Net). The dot
+    product of two sign vectors is the number of agreeing bits minus the number
+    of disagreeing ones, i.e. XOR and popcount over 64 bit words, with AVX-512
+    VPOPCNTDQ eight words at a time when compiled for it. Outputs of 0 and 1
+    (HEAVISIDE) are mapped onto -1 and +1 by folding the sum of the weight signs
+    into the bias. The first layer keeps float weights for the real inputs and
+    the output layer puts out floats through its own activation function. The
+    weights of the binarized layers take 32 times less memory.
+
+    A hidden unit is on for a net input above 0 (HEAVISIDE at exactly 0 is off
+    rather than 0.5, SYMMETRICAL_HARD_LIMIT is -1 rather than 0).
+
+    model keeps the float (latent) weights. train runs stochastic gradient
+    descent on them through the binarized forward pass, the hard limits and
+    the signs are bypassed by the straight-through estimator (gradient 1 for
+    |net| <= 1, 0 beyond), the latent weights of the binarized layers are
+    clipped to +-weightClip, and the bits are packed again at the end.
+*/
+class BinaryNetwork
+{
+    public:
+        BinaryNetwork();
+        ~BinaryNetwork();
+
+        bool capture(NeuralNetwork& network);
+        bool build(const NetworkSnapshot& snapshot); // Takes over the weights and packs them
+        void pack(); // Binarizes the weights of model
+
+        void predict(const Matrix<float>& dataSample, Matrix<float>& output) const;
+        void predictBatch(const Matrix<float>& dataSamples, Matrix<float>& outputs) const; // (inputSize, batch) to (outputSize, batch)
+
+        // Straight-through training of model, returns the mean squared error of the last epoch
+        float train(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs, float learningRate);
+
+        long long getWeightBytes() const; // Memory of the packed weights, first layer included
+
+        NetworkSnapshot model; // Latent float weights
+        float weightClip;
+        unsigned int shuffleSeed; // Seeds the order of the samples in train
+
+    private:
+        void forward(const float* dataSample, int stride, std::vector<uint64_t>& bits, std::vector<uint64_t>& nextBits, float* output) const;
+        static int countDisagreements(const uint64_t* input, const uint64_t* weights, int words);
+
+        std::vector<BinaryLayer> layers; // Every layer after the first
+        std::vector<float> firstLayerWeights; // Neuron by neuron, bias first
+};
+
+#endif // BINARYNETWORK_H
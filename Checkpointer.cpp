@@ -0,0 +1,397 @@
+#include "Checkpointer.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+
+static const char CHECKPOINT_MAGIC[8] = {'N', 'N', 'C', 'H', 'K', 'P', 'T', '1'};
+
+/**
+    FNV-1a hash of the payload, detects torn or corrupted checkpoints
+*/
+static uint64_t getChecksum(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Serialisation helpers
+template <class T>
+static void append(std::vector<char>& buffer, const T* values, size_t count)
+{
+    const char* bytes = (const char*) values;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * count);
+}
+
+template <class T>
+static void append(std::vector<char>& buffer, T value)
+{
+    append(buffer, &value, 1);
+}
+
+template <class T>
+static bool extract(const std::vector<char>& buffer, size_t& position, T* values, size_t count)
+{
+    if (position + sizeof(T) * count > buffer.size())
+        return false;
+    memcpy(values, buffer.data() + position, sizeof(T) * count);
+    position += sizeof(T) * count;
+    return true;
+}
+
+template <class T>
+static bool extractVector(const std::vector<char>& buffer, size_t& position, std::vector<T>& values)
+{
+    int32_t count;
+    if (!extract(buffer, position, &count, 1) || count < 0 || (size_t) count * sizeof(T) > buffer.size())
+        return false;
+    values.resize(count);
+    return extract(buffer, position, values.data(), count);
+}
+
+template <class T>
+static void appendVector(std::vector<char>& buffer, const std::vector<T>& values)
+{
+    append(buffer, (int32_t) values.size());
+    append(buffer, values.data(), values.size());
+}
+
+static bool writeAll(int file, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(file, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+
+// --------------------------------------- Checkpointer ---------------------------------------
+Checkpointer::Checkpointer(const std::string& _pathPrefix, int _numberOfCheckpoints)
+{
+    pathPrefix = _pathPrefix;
+    numberOfCheckpoints = _numberOfCheckpoints;
+    interval = 1;
+    statePending = false;
+    writing = false;
+    running = true;
+    unsupportedReported = false;
+
+    // Continue the numbering of the checkpoints already on disk
+    nextSequence = 0;
+    std::vector<std::string> checkpoints = listCheckpoints();
+    if (!checkpoints.empty())
+    {
+        const std::string& newest = checkpoints.back();
+        nextSequence = atoll(newest.substr(pathPrefix.size() + 1).c_str()) + 1;
+    }
+
+    writer = std::thread(&Checkpointer::writeLoop, this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    waitForWrites();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    writer.join();
+}
+
+void Checkpointer::epochFinished(NeuralNetwork& network, int epoch)
+{
+    if (interval > 0 && (epoch + 1) % interval == 0)
+        save(network, epoch + 1);
+}
+
+/**
+    Copies the training state into the pending buffer and wakes up the writer.
+    A pending checkpoint which has not been picked up yet is replaced by the newer one.
+*/
+bool Checkpointer::save(NeuralNetwork& network, int nextEpoch)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!pendingState.snapshot.capture(network))
+        {
+            if (!unsupportedReported)
+                std::cout << "Checkpointer: Networks with convolution or pooling layers cannot be checkpointed!" << std::endl;
+            unsupportedReported = true;
+            return false;
+        }
+
+        const Optimizer& optimizer = network.optimizer;
+        const float* firstMoment = optimizer.firstMoment.getArrayRef();
+        const float* secondMoment = optimizer.secondMoment.getArrayRef();
+        pendingState.firstMoment.assign(firstMoment, firstMoment + optimizer.firstMoment.getSize());
+        pendingState.secondMoment.assign(secondMoment, secondMoment + optimizer.secondMoment.getSize());
+        pendingState.optimizerEnum = optimizer.optimizerEnum;
+        pendingState.momentum = optimizer.momentum;
+        pendingState.decayRate = optimizer.decayRate;
+        pendingState.beta1 = optimizer.beta1;
+        pendingState.beta2 = optimizer.beta2;
+        pendingState.epsilon = optimizer.epsilon;
+        pendingState.timeStep = optimizer.timeStep;
+
+        pendingState.learningRate = network.learningRate;
+        pendingState.shuffleSeed = network.shuffleSeed;
+        pendingState.epoch = nextEpoch;
+        statePending = true;
+    }
+    condition.notify_all();
+    return true;
+}
+
+void Checkpointer::waitForWrites()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]{ return !statePending && !writing; });
+}
+
+void Checkpointer::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this]{ return statePending || !running; });
+        if (!statePending && !running)
+            return;
+
+        // Take the pending state (a swap, no copy) and write it without holding the lock
+        std::swap(pendingState, writingState);
+        statePending = false;
+        writing = true;
+        lock.unlock();
+        write(writingState);
+        lock.lock();
+        writing = false;
+        condition.notify_all();
+    }
+}
+
+bool Checkpointer::write(CheckpointState& state)
+{
+    /// 1) Serialise the state
+    std::vector<char> payload;
+    append(payload, (int32_t) state.epoch);
+    append(payload, state.learningRate);
+    append(payload, (uint32_t) state.shuffleSeed);
+
+    std::vector<int32_t> activationFunctions(state.snapshot.activationFunctions.begin(), state.snapshot.activationFunctions.end());
+    std::vector<int32_t> layerSizes(state.snapshot.layerSizes.begin(), state.snapshot.layerSizes.end());
+    appendVector(payload, layerSizes);
+    appendVector(payload, activationFunctions);
+    appendVector(payload, state.snapshot.weights);
+
+    append(payload, (int32_t) state.optimizerEnum);
+    append(payload, state.momentum);
+    append(payload, state.decayRate);
+    append(payload, state.beta1);
+    append(payload, state.beta2);
+    append(payload, state.epsilon);
+    append(payload, (int32_t) state.timeStep);
+    appendVector(payload, state.firstMoment);
+    appendVector(payload, state.secondMoment);
+
+    /// 2) Write it to a temporary file and make sure it reached the disk
+    std::string fileName = getFileName(nextSequence);
+    std::string temporaryFileName = fileName + ".tmp";
+    int file = open(temporaryFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+    {
+        std::cout << "Checkpointer: Could not create " << temporaryFileName << std::endl;
+        return false;
+    }
+
+    uint64_t checksum = getChecksum(payload.data(), payload.size());
+    bool success = writeAll(file, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC))
+        && writeAll(file, payload.data(), payload.size())
+        && writeAll(file, (const char*) &checksum, sizeof(checksum))
+        && fsync(file) == 0;
+    close(file);
+    if (!success)
+    {
+        std::cout << "Checkpointer: Could not write " << temporaryFileName << std::endl;
+        unlink(temporaryFileName.c_str());
+        return false;
+    }
+
+    /// 3) Atomically publish it and make the rename durable
+    if (rename(temporaryFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::cout << "Checkpointer: Could not rename " << temporaryFileName << std::endl;
+        unlink(temporaryFileName.c_str());
+        return false;
+    }
+
+    size_t slash = fileName.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : fileName.substr(0, slash + 1);
+    int directoryFile = open(directory.c_str(), O_RDONLY);
+    if (directoryFile >= 0)
+    {
+        fsync(directoryFile);
+        close(directoryFile);
+    }
+    nextSequence++;
+
+    /// 4) Rotate, keep only the newest checkpoints
+    std::vector<std::string> checkpoints = listCheckpoints();
+    for (int i = 0; i + numberOfCheckpoints < (int) checkpoints.size(); i++)
+        unlink(checkpoints[i].c_str());
+    return true;
+}
+
+bool Checkpointer::load(const std::string& fileName, CheckpointState& state)
+{
+    /// 1) Read the whole file and verify it
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    std::vector<char> buffer;
+    char block[65536];
+    size_t count;
+    while ((count = fread(block, 1, sizeof(block), file)) > 0)
+        buffer.insert(buffer.end(), block, block + count);
+    fclose(file);
+
+    if (buffer.size() < sizeof(CHECKPOINT_MAGIC) + sizeof(uint64_t) || memcmp(buffer.data(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+        return false;
+
+    uint64_t checksum;
+    memcpy(&checksum, buffer.data() + buffer.size() - sizeof(checksum), sizeof(checksum));
+    std::vector<char> payload(buffer.begin() + sizeof(CHECKPOINT_MAGIC), buffer.end() - sizeof(checksum));
+    if (getChecksum(payload.data(), payload.size()) != checksum)
+        return false;
+
+    /// 2) Deserialise it
+    size_t position = 0;
+    int32_t epoch, optimizerEnum, timeStep;
+    uint32_t shuffleSeed;
+    std::vector<int32_t> layerSizes, activationFunctions;
+    bool success = extract(payload, position, &epoch, 1)
+        && extract(payload, position, &state.learningRate, 1)
+        && extract(payload, position, &shuffleSeed, 1)
+        && extractVector(payload, position, layerSizes)
+        && extractVector(payload, position, activationFunctions)
+        && extractVector(payload, position, state.snapshot.weights)
+        && extract(payload, position, &optimizerEnum, 1)
+        && extract(payload, position, &state.momentum, 1)
+        && extract(payload, position, &state.decayRate, 1)
+        && extract(payload, position, &state.beta1, 1)
+        && extract(payload, position, &state.beta2, 1)
+        && extract(payload, position, &state.epsilon, 1)
+        && extract(payload, position, &timeStep, 1)
+        && extractVector(payload, position, state.firstMoment)
+        && extractVector(payload, position, state.secondMoment);
+    if (!success)
+        return false;
+
+    state.epoch = epoch;
+    state.shuffleSeed = shuffleSeed;
+    state.optimizerEnum = optimizerEnum;
+    state.timeStep = timeStep;
+    state.snapshot.layerSizes.assign(layerSizes.begin(), layerSizes.end());
+    state.snapshot.activationFunctions.clear();
+    for (int i = 0; i < (int) activationFunctions.size(); i++)
+        state.snapshot.activationFunctions.push_back((EActivationFunction) activationFunctions[i]);
+    return state.snapshot.getParameterCount() == (int) state.snapshot.weights.size();
+}
+
+/**
+    Restores the network and its optimizer from the newest checkpoint which is
+    intact and of the same topology, older ones are tried if the newest is not
+*/
+bool Checkpointer::resume(NeuralNetwork& network, int& nextEpoch)
+{
+    std::vector<std::string> checkpoints = listCheckpoints();
+    for (int i = checkpoints.size() - 1; i >= 0; i--)
+    {
+        CheckpointState state;
+        if (!load(checkpoints[i], state) || !state.snapshot.matches(network))
+        {
+            std::cout << "Checkpointer: Skipping unusable checkpoint " << checkpoints[i] << std::endl;
+            continue;
+        }
+
+        state.snapshot.restore(network);
+
+        Optimizer& optimizer = network.optimizer;
+        optimizer.optimizerEnum = (EOptimizer) state.optimizerEnum;
+        optimizer.momentum = state.momentum;
+        optimizer.decayRate = state.decayRate;
+        optimizer.beta1 = state.beta1;
+        optimizer.beta2 = state.beta2;
+        optimizer.epsilon = state.epsilon;
+        optimizer.initState(state.firstMoment.size());
+        std::copy(state.firstMoment.begin(), state.firstMoment.end(), optimizer.firstMoment.getArrayRef());
+        std::copy(state.secondMoment.begin(), state.secondMoment.end(), optimizer.secondMoment.getArrayRef());
+        optimizer.setTimeStep(state.timeStep);
+
+        network.learningRate = state.learningRate;
+        network.shuffleSeed = state.shuffleSeed;
+        nextEpoch = state.epoch;
+        return true;
+    }
+    return false;
+}
+
+std::vector<std::string> Checkpointer::listCheckpoints()
+{
+    // Split the prefix into the directory and the start of the file names
+    size_t slash = pathPrefix.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : pathPrefix.substr(0, slash + 1);
+    std::string baseName = (slash == std::string::npos ? pathPrefix : pathPrefix.substr(slash + 1)) + "-";
+
+    std::vector<std::pair<long long, std::string>> checkpoints;
+    DIR* directoryHandle = opendir(directory.c_str());
+    if (directoryHandle == nullptr)
+        return std::vector<std::string>();
+
+    struct dirent* entry;
+    while ((entry = readdir(directoryHandle)) != nullptr)
+    {
+        std::string name = entry->d_name;
+        if (name.size() <= baseName.size() + 5 || name.compare(0, baseName.size(), baseName) != 0
+            || name.compare(name.size() - 5, 5, ".ckpt") != 0)
+            continue;
+
+        std::string sequence = name.substr(baseName.size(), name.size() - baseName.size() - 5);
+        if (sequence.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        checkpoints.push_back(std::make_pair(atoll(sequence.c_str()), getFileName(atoll(sequence.c_str()))));
+    }
+    closedir(directoryHandle);
+
+    std::sort(checkpoints.begin(), checkpoints.end());
+    std::vector<std::string> fileNames;
+    for (int i = 0; i < (int) checkpoints.size(); i++)
+        fileNames.push_back(checkpoints[i].second);
+    return fileNames;
+}
+
+std::string Checkpointer::getFileName(long long sequence)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%08lld", sequence);
+    return pathPrefix + "-" + number + ".ckpt";
+}
@@ -0,0 +1,79 @@
+#ifndef CHECKPOINTER_H
+#define CHECKPOINTER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "NetworkSnapshot.h"
+
+class NeuralNetwork;
+
+/**
+    Everything needed to continue training from where a checkpoint was taken
+*/
+struct CheckpointState
+{
+    NetworkSnapshot snapshot;
+    std::vector<float> firstMoment, secondMoment; // Optimizer state
+    int optimizerEnum;
+    float momentum, decayRate, beta1, beta2, epsilon;
+    int timeStep;
+    float learningRate;
+    unsigned int shuffleSeed;
+    int epoch; // The next epoch to run
+};
+
+/**
+    Saves checkpoints of a long training run in the background.
+
+    The training thread only copies the weights and the optimizer state into a
+    pending buffer; a background thread serialises it to a temporary file, fsyncs
+    it and renames it over the checkpoint so a crash never leaves a half written
+    checkpoint behind. Checkpoints are numbered and only the newest ones are kept.
+
+    Attach it with NeuralNetwork::checkpointer before calling backpropagationStochastic,
+    and continue a run with:
+        int epoch;
+        if (checkpointer.resume(network, epoch))
+            network.backpropagationStochastic(samples, classifications, epochs, epoch);
+*/
+class Checkpointer
+{
+    public:
+        Checkpointer(const std::string& pathPrefix, int numberOfCheckpoints = 3);
+        ~Checkpointer();
+
+        void epochFinished(NeuralNetwork& network, int epoch); // Called by the training loop after every complete epoch
+        bool save(NeuralNetwork& network, int nextEpoch); // Queues a checkpoint, false for networks snapshots cannot hold
+        void waitForWrites(); // Blocks until every queued checkpoint is on disk
+
+        bool resume(NeuralNetwork& network, int& nextEpoch); // Loads the newest valid checkpoint
+        bool load(const std::string& fileName, CheckpointState& state);
+
+        std::vector<std::string> listCheckpoints(); // Oldest first
+
+        int interval; // Epochs between checkpoints
+        int numberOfCheckpoints; // Number of checkpoints kept on disk
+
+    private:
+        void writeLoop();
+        bool write(CheckpointState& state);
+        std::string getFileName(long long sequence);
+
+        std::string pathPrefix;
+        long long nextSequence;
+
+        std::thread writer;
+        std::mutex mutex;
+        std::condition_variable condition;
+        CheckpointState pendingState; // Filled by the training thread
+        CheckpointState writingState; // Serialised by the background thread
+        bool statePending;
+        bool writing;
+        bool running;
+        bool unsupportedReported; // A network with convolution or pooling layers was reported once
+};
+
+#endif // CHECKPOINTER_H
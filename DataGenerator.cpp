@@ -0,0 +1,202 @@
+#include "DataGenerator.h"
+#include "Random.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+static const int CHUNK_SIZE = 256; // Samples drawn from the random stream at a time
+static const int MINIMUM_SAMPLES_PER_THREAD = 4096; // Smaller batches are not worth a thread
+
+// Maps a random number to one of the count integers starting at minValue
+static inline int toInteger(unsigned int bits, int minValue, int count)
+{
+    return (int) (((uint64_t) bits * (uint64_t) count) >> 32) + minValue;
+}
+
+// -50 <= x <= 50 in steps of 0.01
+static inline float toCoordinate(unsigned int bits)
+{
+    return toInteger(bits, 0, 10001) / 100.0f - 50.0f;
+}
+
+
+// --------------------------------------- Data Generator ---------------------------------------
+DataGenerator::DataGenerator(EDataProblem problem, unsigned long long _seed)
+{
+    problemEnum = problem;
+    seed = _seed;
+    numberOfThreads = 1;
+}
+
+DataGenerator::~DataGenerator()
+{
+
+}
+
+int DataGenerator::getFeatureSize()
+{
+    switch (problemEnum)
+    {
+        case LINEAR_PROBLEM: return 2;
+        case QUADRATIC_PROBLEM: return 3;
+        case SINE_PROBLEM: return 1;
+        default: return 0;
+    }
+}
+
+int DataGenerator::getOutputSize()
+{
+    return problemEnum == SINE_PROBLEM ? 2 : 1;
+}
+
+/**
+    Fills the given samples, feature f of sample i is at features[f * stride + i]
+    and output o at targets[o * stride + i]
+*/
+void DataGenerator::generateRange(long long firstSample, int numberOfSamples, int stride, float* features, float* targets)
+{
+    unsigned int bits[CHUNK_SIZE * 4]; // One block of four numbers per sample
+    for (int start = 0; start < numberOfSamples; start += CHUNK_SIZE)
+    {
+        int size = numberOfSamples - start < CHUNK_SIZE ? numberOfSamples - start : CHUNK_SIZE;
+        Random::generate(seed, problemEnum, firstSample + start, size, bits);
+
+        for (int i = 0; i < size; i++)
+        {
+            const unsigned int* sampleBits = bits + i * 4;
+            int index = start + i;
+            switch (problemEnum)
+            {
+                case LINEAR_PROBLEM:
+                {
+                    float x = toInteger(sampleBits[0], -500, 1001);
+                    float y = toInteger(sampleBits[1], -500, 1001);
+                    features[index] = x;
+                    features[stride + index] = y;
+                    targets[index] = x - y >= 0 ? 1 : 0;
+                    break;
+                }
+
+                case QUADRATIC_PROBLEM:
+                {
+                    float x = toCoordinate(sampleBits[0]);
+                    float y = toCoordinate(sampleBits[1]);
+                    float z = toCoordinate(sampleBits[2]);
+                    features[index] = x;
+                    features[stride + index] = y;
+                    features[2 * stride + index] = z;
+                    targets[index] = x * x + x * y - y * y + y * z >= 0 ? 1 : 0;
+                    break;
+                }
+
+                case SINE_PROBLEM:
+                {
+                    float x = toCoordinate(sampleBits[0]);
+                    float positive = sin(x) >= 0 ? 1 : 0;
+                    features[index] = x;
+                    targets[index] = 1 - positive;
+                    targets[stride + index] = positive;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void DataGenerator::generate(long long firstSample, int numberOfSamples, Matrix<float>& features, Matrix<float>& targets)
+{
+    // Reallocate only if the shape changed
+    if (features.getSizeX() != getFeatureSize() || features.getSizeY() != numberOfSamples)
+        features.setSize(getFeatureSize(), numberOfSamples);
+    if (targets.getSizeX() != getOutputSize() || targets.getSizeY() != numberOfSamples)
+        targets.setSize(getOutputSize(), numberOfSamples);
+
+    // Pointers are taken on the calling thread, the threads write disjoint columns
+    float* featureArray = features.getArrayRef();
+    float* targetArray = targets.getArrayRef();
+
+    int threads = numberOfThreads < 1 ? 1 : numberOfThreads;
+    if (threads > numberOfSamples / MINIMUM_SAMPLES_PER_THREAD)
+        threads = numberOfSamples / MINIMUM_SAMPLES_PER_THREAD > 0 ? numberOfSamples / MINIMUM_SAMPLES_PER_THREAD : 1;
+    int groupSize = (numberOfSamples + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    for (int first = groupSize; first < numberOfSamples; first += groupSize)
+    {
+        int size = first + groupSize < numberOfSamples ? groupSize : numberOfSamples - first;
+        workers.push_back(std::thread(&DataGenerator::generateRange, this, firstSample + first, size, numberOfSamples,
+                                      featureArray + first, targetArray + first));
+    }
+
+    // The first group is generated on the calling thread
+    generateRange(firstSample, groupSize < numberOfSamples ? groupSize : numberOfSamples, numberOfSamples, featureArray, targetArray);
+    for (int i = 0; i < (int) workers.size(); i++)
+        workers[i].join();
+}
+
+void DataGenerator::generate(long long firstSample, int numberOfSamples, Matrix<float>& features, Array<float>& classificationVector)
+{
+    if (getOutputSize() != 1)
+    {
+        std::cout << "Data generator: The problem has more than one output, use a target matrix instead!" << std::endl;
+        return;
+    }
+
+    Matrix<float> targets;
+    generate(firstSample, numberOfSamples, features, targets);
+    if (classificationVector.size() != numberOfSamples)
+        classificationVector.setSize(numberOfSamples);
+    for (int i = 0; i < numberOfSamples; i++)
+        classificationVector[i] = targets[0][i];
+}
+
+void DataGenerator::generateSample(long long sample, Matrix<float>& dataSample, Array<float>& classificationVector)
+{
+    if (dataSample.getSizeX() != getFeatureSize() || dataSample.getSizeY() != 1)
+        dataSample.setSize(getFeatureSize(), 1);
+    if (classificationVector.size() != getOutputSize())
+        classificationVector.setSize(getOutputSize());
+
+    float targets[2];
+    generateRange(sample, 1, 1, dataSample.getArrayRef(), targets);
+    for (int i = 0; i < getOutputSize(); i++)
+        classificationVector[i] = targets[i];
+}
+
+
+// --------------------------------------- Data Stream ---------------------------------------
+DataStream::DataStream(DataGenerator& _generator, int _batchSize, long long _numberOfSamples, long long _firstSample)
+{
+    generator = &_generator;
+    batchSize = _batchSize;
+    numberOfSamples = _numberOfSamples;
+    firstSample = _firstSample;
+    reset();
+}
+
+bool DataStream::next()
+{
+    long long size = batchSize;
+    if (numberOfSamples >= 0 && nextPosition + size > firstSample + numberOfSamples)
+        size = firstSample + numberOfSamples - nextPosition;
+    if (size <= 0)
+        return false;
+
+    generator->generate(nextPosition, size, features, targets);
+    position = nextPosition;
+    nextPosition += size;
+    return true;
+}
+
+void DataStream::reset()
+{
+    position = firstSample;
+    nextPosition = firstSample;
+}
+
+long long DataStream::getPosition()
+{
+    return position;
+}
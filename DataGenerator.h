@@ -0,0 +1,67 @@
+#ifndef DATAGENERATOR_H
+#define DATAGENERATOR_H
+
+#include "Matrix.h"
+#include "Array.h"
+#include "EDataProblem.h"
+
+/**
+    Synthetic classification data for tests and benchmarks.
+
+    Sample i is a pure function of (seed, i): it is drawn from block i of a
+    counter based random stream. Any range of samples can be generated on any
+    number of threads, in any order, with the same result, and the training and
+    test sets are simply disjoint ranges of sample indices.
+
+    The output buffers are only reallocated when their shape changes, so filling
+    the same batch buffers over and over does not allocate.
+*/
+class DataGenerator
+{
+    public:
+        DataGenerator(EDataProblem problem, unsigned long long seed = 0);
+        ~DataGenerator();
+
+        // features is (featureSize, numberOfSamples), targets is (outputSize, numberOfSamples)
+        void generate(long long firstSample, int numberOfSamples, Matrix<float>& features, Matrix<float>& targets);
+        void generate(long long firstSample, int numberOfSamples, Matrix<float>& features, Array<float>& classificationVector); // Single output problems
+        void generateSample(long long sample, Matrix<float>& dataSample, Array<float>& classificationVector); // One (featureSize, 1) sample
+
+        int getFeatureSize();
+        int getOutputSize();
+
+        EDataProblem problemEnum;
+        unsigned long long seed;
+        int numberOfThreads; // Number of threads a batch is spread across
+
+    private:
+        void generateRange(long long firstSample, int numberOfSamples, int stride, float* features, float* targets);
+};
+
+/**
+    Iterates over consecutive batches of a generator, reusing the same buffers:
+        DataStream stream(generator, 256);
+        while (stream.next())
+            train(stream.features, stream.targets);
+*/
+class DataStream
+{
+    public:
+        DataStream(DataGenerator& generator, int batchSize, long long numberOfSamples = -1, long long firstSample = 0); // -1 streams forever
+
+        bool next(); // Generates the next batch, false once all samples were streamed
+        void reset();
+
+        long long getPosition(); // Index of the first sample of the current batch
+
+        Matrix<float> features; // (featureSize, batchSize), the last batch may be smaller
+        Matrix<float> targets; // (outputSize, batchSize)
+
+    private:
+        DataGenerator* generator;
+        int batchSize;
+        long long numberOfSamples, firstSample;
+        long long position, nextPosition;
+};
+
+#endif // DATAGENERATOR_H
@@ -0,0 +1,403 @@
+#include "DataParallelTrainer.h"
+#include "NeuralNetwork.h"
+#include "NetworkSnapshot.h"
+#include "Random.h"
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <string>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static const size_t CACHE_LINE = 64;
+
+/**
+    Start of the shared memory segment, followed by one weight buffer per worker
+*/
+struct DataParallelShared
+{
+    alignas(CACHE_LINE) std::atomic<int> arrived; // Workers waiting at the barrier
+    alignas(CACHE_LINE) std::atomic<int> generation; // Incremented every time the barrier opens
+    std::atomic<int> aborted; // Set by the parent when a worker died
+    int numberOfWorkers;
+};
+
+static size_t roundUp(size_t size)
+{
+    return (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = (const char*) data;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size)
+{
+    char* bytes = (char*) data;
+    while (size > 0)
+    {
+        ssize_t received = read(fd, bytes, size);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+DataParallelTrainer::DataParallelTrainer(NeuralNetwork& _network, int _numberOfWorkers)
+{
+    network = &_network;
+    numberOfWorkers = _numberOfWorkers;
+    syncInterval = 64;
+    pinWorkers = false;
+}
+
+DataParallelTrainer::~DataParallelTrainer()
+{
+
+}
+
+std::vector<float> DataParallelTrainer::getEpochLosses()
+{
+    return epochLosses;
+}
+
+float* DataParallelTrainer::getBuffer(DataParallelShared* shared, int rank, int parameterCount)
+{
+    char* base = (char*) shared + roundUp(sizeof(DataParallelShared));
+    return (float*) (base + rank * roundUp(sizeof(float) * parameterCount));
+}
+
+/**
+    Sense reversing barrier over the shared segment, returns false if training was aborted
+*/
+bool DataParallelTrainer::barrier(DataParallelShared* shared)
+{
+    int generation = shared->generation.load(std::memory_order_acquire);
+    if (shared->arrived.fetch_add(1, std::memory_order_acq_rel) == shared->numberOfWorkers - 1)
+    {
+        shared->arrived.store(0, std::memory_order_relaxed);
+        shared->generation.fetch_add(1, std::memory_order_release);
+    }
+    else
+    {
+        while (shared->generation.load(std::memory_order_acquire) == generation)
+        {
+            if (shared->aborted.load(std::memory_order_relaxed))
+                return false;
+            std::this_thread::yield();
+        }
+    }
+    return !shared->aborted.load(std::memory_order_relaxed);
+}
+
+/**
+    Averages the weight buffers of all workers in place, each worker ends up with the mean
+*/
+void DataParallelTrainer::allReduce(int rank, DataParallelShared* shared, int parameterCount)
+{
+    int workers = shared->numberOfWorkers;
+    int chunkSize = (parameterCount + workers - 1) / workers;
+    float* own = getBuffer(shared, rank, parameterCount);
+    const float* left = getBuffer(shared, (rank + workers - 1) % workers, parameterCount);
+
+    // Every worker has written its weights before anyone reads them
+    if (!barrier(shared))
+        _exit(1);
+
+    /// 1) Reduce-scatter, afterwards chunk (rank + 1) holds the mean of all workers
+    float scale = 1.0f / workers;
+    for (int s = 0; s < workers - 1; s++)
+    {
+        int chunk = (rank - s - 1 + 2 * workers) % workers;
+        int first = chunk * chunkSize;
+        int last = std::min(parameterCount, first + chunkSize);
+        if (s < workers - 2)
+        {
+            for (int i = first; i < last; i++)
+                own[i] += left[i];
+        }
+        else
+        {
+            // Last step, the sum is complete
+            for (int i = first; i < last; i++)
+                own[i] = (own[i] + left[i]) * scale;
+        }
+        if (!barrier(shared))
+            _exit(1);
+    }
+
+    /// 2) All-gather, the finished chunks are passed on to the right
+    for (int s = 0; s < workers - 1; s++)
+    {
+        int chunk = (rank - s + workers) % workers;
+        int first = chunk * chunkSize;
+        int last = std::min(parameterCount, first + chunkSize);
+        if (first < last)
+            memcpy(own + first, left + first, sizeof(float) * (last - first));
+        if (!barrier(shared))
+            _exit(1);
+    }
+}
+
+void DataParallelTrainer::runWorker(int rank, Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors,
+                                    int epochs, DataParallelShared* shared, int parameterCount, int controlSocket)
+{
+    if (pinWorkers)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(rank % std::max(1u, std::thread::hardware_concurrency()), &cpuSet);
+        sched_setaffinity(0, sizeof(cpuSet), &cpuSet);
+    }
+
+    /// 1) Rendezvous, check in and wait until every worker is there
+    char start;
+    if (!writeAll(controlSocket, &rank, sizeof(rank)) || !readAll(controlSocket, &start, 1))
+        _exit(1);
+
+    /// 2) Train the share of every epoch and average the weights regularly
+    int workers = shared->numberOfWorkers;
+    int numberOfSamples = dataSamples.size();
+    int stepsPerEpoch = (numberOfSamples + workers - 1) / workers;
+    int interval = std::max(1, syncInterval);
+    NeuralNetworkLayer& outputLayer = network->layers[network->layers.size() - 1];
+    float* own = getBuffer(shared, rank, parameterCount);
+    NetworkSnapshot snapshot;
+    std::vector<double> results; // Squared error and number of samples of every epoch
+
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        // The same order as backpropagationStochastic, dealt out round robin
+        std::vector<int> order(numberOfSamples);
+        for (int i = 0; i < numberOfSamples; i++)
+            order[i] = i;
+        Random random(network->shuffleSeed, epoch);
+        for (int i = order.size() - 1; i > 0; i--)
+            std::swap(order[i], order[random.nextInt(i + 1)]);
+
+        double squaredError = 0;
+        int count = 0;
+        for (int step = 0; step < stepsPerEpoch; step++)
+        {
+            int i = step * workers + rank;
+            if (i < numberOfSamples)
+            {
+                Array<float>& classificationVector = classificationVectors[order[i]];
+                network->backpropagation(dataSamples[order[i]], classificationVector);
+                for (int j = 0; j < outputLayer.results.getSizeX(); j++)
+                {
+                    float error = classificationVector[j] - outputLayer.results[j][0];
+                    squaredError += error * error;
+                }
+                count++;
+            }
+
+            // Every worker runs the same number of steps, so they all meet here
+            if ((step + 1) % interval == 0 || step == stepsPerEpoch - 1)
+            {
+                snapshot.capture(*network);
+                memcpy(own, snapshot.weights.data(), sizeof(float) * parameterCount);
+                allReduce(rank, shared, parameterCount);
+                memcpy(snapshot.weights.data(), own, sizeof(float) * parameterCount);
+                snapshot.restore(*network);
+            }
+        }
+
+        results.push_back(squaredError);
+        results.push_back(count);
+    }
+
+    /// 3) Report back
+    if (!writeAll(controlSocket, results.data(), sizeof(double) * results.size()))
+        _exit(1);
+    _exit(0);
+}
+
+bool DataParallelTrainer::train(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs)
+{
+    /// 1) Check the parameters
+    if (dataSamples.size() != classificationVectors.size())
+    {
+        std::cout << "Data parallel trainer: Input data sample vector size is not equal to the classification vector size!" << std::endl;
+        return false;
+    }
+
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(*network))
+    {
+        std::cout << "Data parallel trainer: Only fully connected networks can be trained!" << std::endl;
+        return false;
+    }
+
+    int workers = std::max(1, numberOfWorkers);
+    int parameterCount = snapshot.getParameterCount();
+
+    /// 2) Shared memory, unlinked right away so it disappears with the last process using it
+    std::string name = "/nn-data-parallel-" + std::to_string(getpid());
+    size_t segmentSize = roundUp(sizeof(DataParallelShared)) + workers * roundUp(sizeof(float) * parameterCount);
+    int memoryFile = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (memoryFile < 0)
+    {
+        std::cout << "Data parallel trainer: shm_open failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    void* segment = MAP_FAILED;
+    if (ftruncate(memoryFile, segmentSize) == 0)
+        segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFile, 0);
+    close(memoryFile);
+    shm_unlink(name.c_str());
+    if (segment == MAP_FAILED)
+    {
+        std::cout << "Data parallel trainer: Could not map " << segmentSize << " bytes of shared memory: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // The weight buffers are left untouched, their pages are first touched by the worker owning them
+    DataParallelShared* shared = new (segment) DataParallelShared();
+    shared->arrived = 0;
+    shared->generation = 0;
+    shared->aborted = 0;
+    shared->numberOfWorkers = workers;
+
+    /// 3) Start the workers, each with a control socket
+    std::vector<int> sockets(workers, -1);
+    std::vector<pid_t> processes(workers, -1);
+    std::cout.flush(); // Otherwise every worker would print the buffered output again
+    bool success = true;
+    for (int rank = 0; rank < workers && success; rank++)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0)
+        {
+            std::cout << "Data parallel trainer: socketpair failed: " << strerror(errno) << std::endl;
+            success = false;
+            break;
+        }
+
+        pid_t process = fork();
+        if (process == 0)
+        {
+            close(pair[0]);
+            for (int i = 0; i < rank; i++)
+                close(sockets[i]);
+            runWorker(rank, dataSamples, classificationVectors, epochs, shared, parameterCount, pair[1]);
+        }
+
+        close(pair[1]);
+        sockets[rank] = pair[0];
+        processes[rank] = process;
+        if (process < 0)
+        {
+            std::cout << "Data parallel trainer: fork failed: " << strerror(errno) << std::endl;
+            success = false;
+        }
+    }
+
+    /// 4) Rendezvous, release the workers together once all of them checked in
+    for (int rank = 0; rank < workers && success; rank++)
+    {
+        int checkedIn;
+        success = readAll(sockets[rank], &checkedIn, sizeof(checkedIn)) && checkedIn == rank;
+    }
+    char start = 1;
+    for (int rank = 0; rank < workers && success; rank++)
+        success = writeAll(sockets[rank], &start, 1);
+
+    /// 5) Wait for the results, a closed socket means a worker died and the others are stopped
+    std::vector<std::vector<double>> results(workers, std::vector<double>(2 * epochs));
+    std::vector<bool> reported(workers, false);
+    int remaining = success ? workers : 0;
+    while (remaining > 0)
+    {
+        std::vector<pollfd> descriptors;
+        std::vector<int> ranks;
+        for (int rank = 0; rank < workers; rank++)
+        {
+            if (!reported[rank])
+            {
+                descriptors.push_back({sockets[rank], POLLIN, 0});
+                ranks.push_back(rank);
+            }
+        }
+        if (poll(descriptors.data(), descriptors.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            success = false;
+            break;
+        }
+
+        for (int i = 0; i < (int) descriptors.size() && success; i++)
+        {
+            if (descriptors[i].revents == 0)
+                continue;
+            int rank = ranks[i];
+            if (!readAll(sockets[rank], results[rank].data(), sizeof(double) * results[rank].size()))
+                success = false;
+            reported[rank] = true;
+            remaining--;
+        }
+        if (!success)
+            break;
+    }
+
+    if (!success)
+        shared->aborted = 1;
+    for (int rank = 0; rank < workers; rank++)
+    {
+        if (sockets[rank] >= 0)
+            close(sockets[rank]);
+        int status = 0;
+        if (processes[rank] > 0 && (waitpid(processes[rank], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0))
+            success = false;
+    }
+
+    /// 6) Every buffer holds the averaged weights, copy them back into the network
+    if (success)
+    {
+        memcpy(snapshot.weights.data(), getBuffer(shared, 0, parameterCount), sizeof(float) * parameterCount);
+        snapshot.restore(*network);
+
+        epochLosses.clear();
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            double squaredError = 0, count = 0;
+            for (int rank = 0; rank < workers; rank++)
+            {
+                squaredError += results[rank][2 * epoch];
+                count += results[rank][2 * epoch + 1];
+            }
+            epochLosses.push_back(count > 0 ? squaredError / (count * snapshot.getOutputSize()) : 0);
+        }
+    }
+    else
+        std::cout << "Data parallel trainer: A worker failed, the network was not changed!" << std::endl;
+
+    shared->~DataParallelShared();
+    munmap(segment, segmentSize);
+    return success;
+}
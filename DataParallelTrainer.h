@@ -0,0 +1,59 @@
+#ifndef DATAPARALLELTRAINER_H
+#define DATAPARALLELTRAINER_H
+
+#include <vector>
+#include "Array.h"
+#include "Matrix.h"
+
+class NeuralNetwork;
+struct DataParallelShared;
+
+/**
+    Trains a network with several worker processes on one Linux machine.
+
+    Every worker is a fork of the calling process, so it starts with its own copy
+    of the network and of the data set and touches only memory of its own (e.g. of
+    its own socket when the workers are pinned). Each epoch the samples are
+    shuffled as in backpropagationStochastic and dealt out round robin, every
+    worker calls backpropagation on its share and after every syncInterval of its
+    samples (and at the end of every epoch) the workers average their weights.
+
+    The average is a ring all-reduce over a POSIX shared memory segment holding one
+    weight buffer per worker: in workers - 1 steps every worker adds one chunk of
+    its left neighbour into its own (reduce-scatter), in workers - 1 more steps the
+    finished chunks travel around the ring (all-gather), so every worker reads and
+    writes each weight about twice regardless of the number of workers. A Unix
+    domain socket is the control channel: the workers check in, are started
+    together and send their epoch losses back, and a worker which dies aborts the
+    others instead of leaving them waiting.
+
+    Only fully connected networks are supported (see NetworkSnapshot). The
+    optimizer state stays in the workers, the network keeps its own.
+*/
+class DataParallelTrainer
+{
+    public:
+        DataParallelTrainer(NeuralNetwork& network, int numberOfWorkers = 2);
+        ~DataParallelTrainer();
+
+        // Returns false if a worker failed, the network is then left unchanged
+        bool train(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs);
+
+        std::vector<float> getEpochLosses(); // Training mean squared error of every epoch of the last call to train
+
+        int numberOfWorkers;
+        int syncInterval; // Samples per worker between weight averages
+        bool pinWorkers; // Pins worker i to core i
+
+    private:
+        void runWorker(int rank, Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs,
+                       DataParallelShared* shared, int parameterCount, int controlSocket);
+        void allReduce(int rank, DataParallelShared* shared, int parameterCount);
+        bool barrier(DataParallelShared* shared);
+        float* getBuffer(DataParallelShared* shared, int rank, int parameterCount);
+
+        NeuralNetwork* network;
+        std::vector<float> epochLosses;
+};
+
+#endif // DATAPARALLELTRAINER_H
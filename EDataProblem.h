@@ -0,0 +1,11 @@
+#ifndef EDATAPROBLEM_H_INCLUDED
+#define EDATAPROBLEM_H_INCLUDED
+
+enum EDataProblem
+{
+    LINEAR_PROBLEM, // x - y >= 0, integer x and y within -500 and 500
+    QUADRATIC_PROBLEM, // xx + xy - yy + yz >= 0, x, y and z within -50 and 50
+    SINE_PROBLEM // sin(x) >= 0, x within -50 and 50, one hot over two classes
+};
+
+#endif // EDATAPROBLEM_H_INCLUDED
@@ -0,0 +1,12 @@
+#ifndef ELAYERTYPE_H_INCLUDED
+#define ELAYERTYPE_H_INCLUDED
+
+enum ELayerType
+{
+    FULLY_CONNECTED, // Every neuron sees every output of the previous layer
+    CONVOLUTION, // One neuron (filter) per output channel, shared across positions
+    MAX_POOLING,
+    AVERAGE_POOLING
+};
+
+#endif // ELAYERTYPE_H_INCLUDED
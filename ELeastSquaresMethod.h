@@ -0,0 +1,10 @@
+#ifndef ELEASTSQUARESMETHOD_H_INCLUDED
+#define ELEASTSQUARESMETHOD_H_INCLUDED
+
+enum ELeastSquaresMethod
+{
+    CHOLESKY, // Normal equations, fastest
+    QR // Householder QR of the data itself, for ill-conditioned features
+};
+
+#endif // ELEASTSQUARESMETHOD_H_INCLUDED
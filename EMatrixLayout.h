@@ -0,0 +1,10 @@
+#ifndef EMATRIXLAYOUT_H_INCLUDED
+#define EMATRIXLAYOUT_H_INCLUDED
+
+enum EMatrixLayout
+{
+    COLUMN_MAJOR, // The elements of one x (column) are contiguous
+    ROW_MAJOR // The elements of one y (row) are contiguous
+};
+
+#endif // EMATRIXLAYOUT_H_INCLUDED
@@ -0,0 +1,13 @@
+#ifndef EOPTIMIZER_H_INCLUDED
+#define EOPTIMIZER_H_INCLUDED
+
+enum EOptimizer
+{
+    SGD, // Plain stochastic gradient descent
+    MOMENTUM, // Classical (heavy ball) momentum
+    NESTEROV, // Nesterov accelerated gradient
+    RMSPROP, // Gradient scaled by a running average of its magnitude
+    ADAM // Adaptive moment estimation
+};
+
+#endif // EOPTIMIZER_H_INCLUDED
@@ -0,0 +1,11 @@
+#ifndef ETUNEDOPERATION_H_INCLUDED
+#define ETUNEDOPERATION_H_INCLUDED
+
+enum ETunedOperation
+{
+    MATRIX_DOT, // Row block size of Matrix::dot
+    EVALUATION, // Batch size and number of threads of NetworkSnapshot::evaluate
+    INPUT_REPRESENTATION // Dense or sparse (SparseVector) first layer
+};
+
+#endif // ETUNEDOPERATION_H_INCLUDED
@@ -0,0 +1,13 @@
+#ifndef EWEIGHTINITIALIZER_H_INCLUDED
+#define EWEIGHTINITIALIZER_H_INCLUDED
+
+enum EWeightInitializer
+{
+    UNIFORM, // Uniform within minValue and maxValue
+    XAVIER_UNIFORM, // Glorot, uniform within +-sqrt(6 / (fanIn + fanOut))
+    XAVIER_NORMAL, // Glorot, normal with deviation sqrt(2 / (fanIn + fanOut))
+    HE_UNIFORM, // Uniform within +-sqrt(6 / fanIn), for rectified linear units
+    HE_NORMAL // Normal with deviation sqrt(2 / fanIn)
+};
+
+#endif // EWEIGHTINITIALIZER_H_INCLUDED
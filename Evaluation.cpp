@@ -0,0 +1,81 @@
+#include "Evaluation.h"
+#include <iostream>
+
+EvaluationResult::EvaluationResult()
+{
+    reset(0, 0);
+}
+
+void EvaluationResult::reset(int _numberOfClasses, int _outputSize)
+{
+    numberOfClasses = _numberOfClasses;
+    outputSize = _outputSize;
+    numberOfSamples = 0;
+    confusionMatrix.assign(numberOfClasses * numberOfClasses, 0);
+    squaredError = 0;
+    accuracy = 0;
+    loss = 0;
+    precision.assign(numberOfClasses, 0);
+    recall.assign(numberOfClasses, 0);
+    seconds = 0;
+    samplesPerSecond = 0;
+}
+
+void EvaluationResult::merge(const EvaluationResult& other)
+{
+    if (other.numberOfClasses != numberOfClasses)
+    {
+        std::cout << "Evaluation: Cannot merge results with a different number of classes!" << std::endl;
+        return;
+    }
+
+    numberOfSamples += other.numberOfSamples;
+    squaredError += other.squaredError;
+    for (int i = 0; i < (int) confusionMatrix.size(); i++)
+        confusionMatrix[i] += other.confusionMatrix[i];
+}
+
+void EvaluationResult::finish()
+{
+    if (numberOfSamples == 0)
+        return;
+
+    long long correct = 0;
+    for (int i = 0; i < numberOfClasses; i++)
+    {
+        long long predicted = 0, actual = 0;
+        for (int j = 0; j < numberOfClasses; j++)
+        {
+            predicted += getConfusion(j, i);
+            actual += getConfusion(i, j);
+        }
+
+        long long truePositives = getConfusion(i, i);
+        correct += truePositives;
+        precision[i] = predicted > 0 ? truePositives / (float) predicted * 100.0f : 0;
+        recall[i] = actual > 0 ? truePositives / (float) actual * 100.0f : 0;
+    }
+
+    accuracy = correct / (float) numberOfSamples * 100.0f;
+    loss = squaredError / (numberOfSamples * outputSize);
+    samplesPerSecond = seconds > 0 ? numberOfSamples / seconds : 0;
+}
+
+long long EvaluationResult::getConfusion(int actualClass, int predictedClass) const
+{
+    return confusionMatrix[actualClass * numberOfClasses + predictedClass];
+}
+
+void EvaluationResult::print() const
+{
+    std::cout << "Samples = " << numberOfSamples << ", accuracy = " << accuracy << "%, loss = " << loss
+        << ", " << samplesPerSecond << " samples/s" << std::endl;
+
+    std::cout << "Confusion matrix (rows: actual, columns: predicted):" << std::endl;
+    for (int i = 0; i < numberOfClasses; i++)
+    {
+        for (int j = 0; j < numberOfClasses; j++)
+            std::cout << getConfusion(i, j) << "\t";
+        std::cout << "precision = " << precision[i] << "%, recall = " << recall[i] << "%" << std::endl;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <vector>
+
+/**
+    Classification metrics of a network over a labelled data set.
+
+    A single output is a binary classification which is right when the output
+    rounds to the target, otherwise the class is the output (and the target)
+    with the largest response. Accuracy,
+    precision and recall are percentages, the loss is the mean squared error.
+*/
+struct EvaluationResult
+{
+    EvaluationResult();
+
+    void reset(int numberOfClasses, int outputSize);
+    void merge(const EvaluationResult& other); // Adds the counts of a partial result
+    void finish(); // Calculates the metrics from the counts
+
+    long long getConfusion(int actualClass, int predictedClass) const;
+    void print() const;
+
+    int numberOfClasses;
+    int outputSize; // Number of outputs of the network
+    long long numberOfSamples;
+    std::vector<long long> confusionMatrix; // [actualClass * numberOfClasses + predictedClass]
+    double squaredError; // Sum over every sample and output
+
+    float accuracy;
+    float loss;
+    std::vector<float> precision; // Per class, 0 if the class was never predicted
+    std::vector<float> recall; // Per class, 0 if the class never occurred
+
+    double seconds; // Wall clock time of the evaluation
+    double samplesPerSecond;
+};
+
+#endif // EVALUATION_H
@@ -0,0 +1,186 @@
+#include "InferenceOptimizer.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <math.h>
+
+/**
+    A layer during the optimization, neuron by neuron with the bias first as in the snapshot
+*/
+struct FoldedLayer
+{
+    int inputSize, size;
+    EActivationFunction activationFunction;
+    std::vector<double> weights;
+};
+
+InferenceOptimizer::InferenceOptimizer()
+{
+    foldAlways = false;
+    tolerance = 1e-4f;
+    foldedLayers = 0;
+    maxDifference = 0;
+}
+
+InferenceOptimizer::~InferenceOptimizer()
+{
+
+}
+
+bool InferenceOptimizer::optimize(NeuralNetwork& network, NetworkSnapshot& optimized)
+{
+    NetworkSnapshot model;
+    if (!model.capture(network))
+    {
+        std::cout << "Inference optimizer: Only fully connected networks can be optimized!" << std::endl;
+        return false;
+    }
+    return optimize(model, optimized);
+}
+
+bool InferenceOptimizer::optimize(const NetworkSnapshot& model, NetworkSnapshot& optimized)
+{
+    foldedLayers = 0;
+    if (model.isEmpty())
+    {
+        std::cout << "Inference optimizer: The model is empty!" << std::endl;
+        return false;
+    }
+    int inputSize = model.getInputSize();
+    if ((!inputScale.empty() && (int) inputScale.size() != inputSize) || (!inputShift.empty() && (int) inputShift.size() != inputSize))
+    {
+        std::cout << "Inference optimizer: The input scale and shift must have " << inputSize << " entries!" << std::endl;
+        return false;
+    }
+
+    /// 1) Unpack the layers
+    std::vector<FoldedLayer> layers(model.getNumberOfLayers());
+    const float* weight = model.weights.data();
+    for (int i = 0; i < (int) layers.size(); i++)
+    {
+        layers[i].inputSize = model.layerSizes[i];
+        layers[i].size = model.layerSizes[i + 1];
+        layers[i].activationFunction = model.activationFunctions[i];
+        layers[i].weights.assign(weight, weight + layers[i].size * (layers[i].inputSize + 1));
+        weight += layers[i].weights.size();
+    }
+
+    /// 2) Fold the pre-processing into the first layer: w (s x + t) + b = (w s) x + (w t + b)
+    FoldedLayer& first = layers[0];
+    for (int n = 0; n < first.size; n++)
+    {
+        double* neuronWeights = &first.weights[n * (inputSize + 1)];
+        for (int k = 0; k < inputSize; k++)
+        {
+            if (!inputShift.empty())
+                neuronWeights[0] += neuronWeights[k + 1] * inputShift[k];
+            if (!inputScale.empty())
+                neuronWeights[k + 1] *= inputScale[k];
+        }
+    }
+
+    /// 3) Fold every LINEAR layer into the layer after it
+    for (int i = 0; i + 1 < (int) layers.size();)
+    {
+        FoldedLayer& linear = layers[i];
+        FoldedLayer& next = layers[i + 1];
+        long long foldedWeights = (long long) next.size * (linear.inputSize + 1);
+        long long currentWeights = (long long) linear.size * (linear.inputSize + 1) + (long long) next.size * (next.inputSize + 1);
+        if (linear.activationFunction != LINEAR || (!foldAlways && foldedWeights > currentWeights))
+        {
+            i++;
+            continue;
+        }
+
+        // Row n of the product is the weighted sum of the linear layer's rows (bias included)
+        int stride = linear.inputSize + 1;
+        FoldedLayer folded;
+        folded.inputSize = linear.inputSize;
+        folded.size = next.size;
+        folded.activationFunction = next.activationFunction;
+        folded.weights.assign(foldedWeights, 0.0);
+        for (int n = 0; n < next.size; n++)
+        {
+            const double* nextWeights = &next.weights[n * (next.inputSize + 1)];
+            double* foldedRow = &folded.weights[n * stride];
+            foldedRow[0] = nextWeights[0];
+            for (int m = 0; m < linear.size; m++)
+            {
+                const double* linearRow = &linear.weights[m * stride];
+                for (int k = 0; k < stride; k++)
+                    foldedRow[k] += nextWeights[m + 1] * linearRow[k];
+            }
+        }
+        layers[i] = folded;
+        layers.erase(layers.begin() + i + 1);
+        foldedLayers++;
+    }
+
+    /// 4) Pack the optimized model
+    optimized.layerSizes.assign(1, inputSize);
+    optimized.activationFunctions.clear();
+    optimized.weights.clear();
+    for (int i = 0; i < (int) layers.size(); i++)
+    {
+        optimized.layerSizes.push_back(layers[i].size);
+        optimized.activationFunctions.push_back(layers[i].activationFunction);
+        optimized.weights.insert(optimized.weights.end(), layers[i].weights.begin(), layers[i].weights.end());
+    }
+    return true;
+}
+
+bool InferenceOptimizer::verify(const NetworkSnapshot& original, const NetworkSnapshot& optimized, const Matrix<float>& dataSamples)
+{
+    maxDifference = 0;
+    if (original.getInputSize() != optimized.getInputSize() || original.getOutputSize() != optimized.getOutputSize()
+        || dataSamples.getSizeX() != original.getInputSize())
+    {
+        std::cout << "Inference optimizer: The models and the samples do not have the same sizes!" << std::endl;
+        return false;
+    }
+
+    Matrix<float> transformed, expected, outputs;
+    if (!applyInputTransform(dataSamples, transformed))
+        return false;
+    original.predictBatch(transformed, expected);
+    optimized.predictBatch(dataSamples, outputs);
+
+    bool equivalent = true;
+    const float* expectedOutput = expected.getArrayRef();
+    const float* output = outputs.getArrayRef();
+    for (int i = 0; i < expected.getSize(); i++)
+    {
+        float difference = fabs(output[i] - expectedOutput[i]);
+        maxDifference = std::max(maxDifference, difference);
+        if (!(difference <= tolerance * (1 + fabs(expectedOutput[i])))) // Fails on NaN
+            equivalent = false;
+    }
+    if (!equivalent)
+        std::cout << "Inference optimizer: The optimized model differs by up to " << maxDifference << std::endl;
+    return equivalent;
+}
+
+bool InferenceOptimizer::applyInputTransform(const Matrix<float>& dataSamples, Matrix<float>& transformed)
+{
+    int inputSize = dataSamples.getSizeX();
+    if ((!inputScale.empty() && (int) inputScale.size() != inputSize) || (!inputShift.empty() && (int) inputShift.size() != inputSize))
+    {
+        std::cout << "Inference optimizer: The input scale and shift must have " << inputSize << " entries!" << std::endl;
+        return false;
+    }
+
+    transformed = dataSamples;
+    if (inputScale.empty() && inputShift.empty())
+        return true;
+
+    // Every feature is a contiguous row over the samples
+    int numberOfSamples = dataSamples.getSizeY();
+    float* sample = transformed.getArrayRef();
+    for (int k = 0; k < inputSize; k++)
+    {
+        float scale = inputScale.empty() ? 1 : inputScale[k];
+        float shift = inputShift.empty() ? 0 : inputShift[k];
+        for (int s = 0; s < numberOfSamples; s++)
+            sample[k * numberOfSamples + s] = sample[k * numberOfSamples + s] * scale + shift;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef INFERENCEOPTIMIZER_H
+#define INFERENCEOPTIMIZER_H
+
+#include <vector>
+#include "Matrix.h"
+#include "NetworkSnapshot.h"
+
+class NeuralNetwork;
+
+/**
+    Rewrites a trained network into a smaller model with the same outputs, for
+    inference only.
+
+    A LINEAR layer followed by any layer is one affine map less than it seems:
+    W2 (W1 x + b1) + b2 = (W2 W1) x + (W2 b1 + b2), so the pair is replaced by a
+    single layer with the precomputed product (in double precision) and the
+    activation of the second. A pair is folded only if the product has no more
+    weights than the two layers, which holds whenever the linear layer is no
+    narrower than its input or its successor (set foldAlways to fold regardless).
+
+    A constant pre-processing of the features, x * inputScale + inputShift (e.g.
+    a standardisation), is folded into the first layer the same way, so the model
+    takes the raw features. The pass-through input layer is already gone in a
+    NetworkSnapshot, which is the optimized model (see also ModelExporter).
+
+        InferenceOptimizer optimizer;
+        NetworkSnapshot model;
+        if (optimizer.optimize(network, model) && optimizer.verify(original, model, rawSamples))
+            ...
+*/
+class InferenceOptimizer
+{
+    public:
+        InferenceOptimizer();
+        ~InferenceOptimizer();
+
+        bool optimize(NeuralNetwork& network, NetworkSnapshot& optimized);
+        bool optimize(const NetworkSnapshot& model, NetworkSnapshot& optimized);
+
+        // Compares the outputs on the raw samples (inputSize, numberOfSamples), the original gets them pre-processed
+        bool verify(const NetworkSnapshot& original, const NetworkSnapshot& optimized, const Matrix<float>& dataSamples);
+
+        std::vector<float> inputScale, inputShift; // Per feature, empty for none
+        bool foldAlways;
+        float tolerance; // Allowed difference relative to 1 + |output|
+
+        int foldedLayers; // Layers removed by the last optimize
+        float maxDifference; // Largest difference found by the last verify
+
+    private:
+        bool applyInputTransform(const Matrix<float>& dataSamples, Matrix<float>& transformed);
+};
+
+#endif // INFERENCEOPTIMIZER_H
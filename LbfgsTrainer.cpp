@@ -0,0 +1,268 @@
+#include "LbfgsTrainer.h"
+#include "NeuralNetwork.h"
+#include "NetworkSnapshot.h"
+#include <iostream>
+#include <thread>
+#include <deque>
+#include <math.h>
+
+static double getDot(const std::vector<double>& a, const std::vector<double>& b)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+LbfgsTrainer::LbfgsTrainer(NeuralNetwork& _network)
+{
+    network = &_network;
+    historySize = 10;
+    maxIterations = 500;
+    gradientTolerance = 1e-5f;
+    targetLoss = 0;
+    batchSize = 256;
+    numberOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    iterations = 0;
+    loss = 0;
+    gradientNorm = 0;
+    dataSamples = nullptr;
+    targets = nullptr;
+}
+
+LbfgsTrainer::~LbfgsTrainer()
+{
+
+}
+
+std::vector<float> LbfgsTrainer::getLosses()
+{
+    return losses;
+}
+
+bool LbfgsTrainer::train(const Matrix<float>& _dataSamples, const Matrix<float>& _targets)
+{
+    iterations = 0;
+    losses.clear();
+
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(*network))
+    {
+        std::cout << "L-BFGS trainer: Only fully connected networks can be trained!" << std::endl;
+        return false;
+    }
+    if (_dataSamples.getSizeX() != snapshot.getInputSize() || _targets.getSizeX() != snapshot.getOutputSize()
+        || _dataSamples.getSizeY() != _targets.getSizeY() || _dataSamples.getSizeY() == 0)
+    {
+        std::cout << "L-BFGS trainer: The samples must be (" << snapshot.getInputSize() << ", n) and the targets ("
+            << snapshot.getOutputSize() << ", n)!" << std::endl;
+        return false;
+    }
+
+    dataSamples = &_dataSamples;
+    targets = &_targets;
+    layerSizes = snapshot.layerSizes;
+    activationFunctions = snapshot.activationFunctions;
+    offsets.assign(snapshot.getNumberOfLayers(), 0);
+    for (int i = 1; i < snapshot.getNumberOfLayers(); i++)
+        offsets[i] = offsets[i - 1] + (size_t) layerSizes[i] * (layerSizes[i - 1] + 1);
+
+    size_t parameterCount = snapshot.weights.size();
+    std::vector<float> weights = snapshot.weights, trialWeights(parameterCount);
+    std::vector<double> gradient(parameterCount), trialGradient(parameterCount), direction(parameterCount);
+    std::deque<std::vector<double>> steps, gradientChanges; // s and y of the last iterations, oldest first
+    std::deque<double> curvatures; // 1 / (y . s)
+    std::vector<double> alphas;
+
+    loss = computeLoss(weights, gradient);
+    for (; iterations < maxIterations; iterations++)
+    {
+        losses.push_back(loss);
+        gradientNorm = (float) sqrt(getDot(gradient, gradient));
+        if (gradientNorm <= gradientTolerance || loss <= targetLoss)
+            break;
+
+        /// 1) Direction -H g by the two loop recursion
+        direction = gradient;
+        alphas.resize(steps.size());
+        for (int i = steps.size() - 1; i >= 0; i--)
+        {
+            alphas[i] = curvatures[i] * getDot(steps[i], direction);
+            for (size_t j = 0; j < parameterCount; j++)
+                direction[j] -= alphas[i] * gradientChanges[i][j];
+        }
+        if (!steps.empty())
+        {
+            // Initial Hessian scaled by the latest curvature
+            double scale = getDot(steps.back(), gradientChanges.back()) / getDot(gradientChanges.back(), gradientChanges.back());
+            for (size_t j = 0; j < parameterCount; j++)
+                direction[j] *= scale;
+        }
+        for (int i = 0; i < (int) steps.size(); i++)
+        {
+            double beta = curvatures[i] * getDot(gradientChanges[i], direction);
+            for (size_t j = 0; j < parameterCount; j++)
+                direction[j] += (alphas[i] - beta) * steps[i][j];
+        }
+        for (size_t j = 0; j < parameterCount; j++)
+            direction[j] = -direction[j];
+
+        double slope = getDot(gradient, direction);
+        if (slope >= 0)
+        {
+            // No descent direction, start over from the gradient
+            steps.clear();
+            gradientChanges.clear();
+            curvatures.clear();
+            for (size_t j = 0; j < parameterCount; j++)
+                direction[j] = -gradient[j];
+            slope = -getDot(gradient, gradient);
+        }
+
+        /// 2) Backtracking line search, the first step without history is of length 1 at most
+        double stepLength = steps.empty() ? std::min(1.0, 1.0 / gradientNorm) : 1.0;
+        float trialLoss = loss;
+        bool accepted = false;
+        for (int attempt = 0; attempt < 40 && !accepted; attempt++)
+        {
+            for (size_t j = 0; j < parameterCount; j++)
+                trialWeights[j] = (float) (weights[j] + stepLength * direction[j]);
+            trialLoss = computeLoss(trialWeights, trialGradient);
+            if (trialLoss <= loss + 1e-4 * stepLength * slope)
+                accepted = true;
+            else
+                stepLength /= 2;
+        }
+        if (!accepted)
+        {
+            if (steps.empty())
+                break; // Not even the gradient decreases the loss (in float)
+            steps.clear();
+            gradientChanges.clear();
+            curvatures.clear();
+            continue;
+        }
+
+        /// 3) Remember the step if it has enough curvature
+        std::vector<double> step(parameterCount), gradientChange(parameterCount);
+        for (size_t j = 0; j < parameterCount; j++)
+        {
+            step[j] = (double) trialWeights[j] - weights[j];
+            gradientChange[j] = trialGradient[j] - gradient[j];
+        }
+        double curvature = getDot(step, gradientChange);
+        if (curvature > 1e-10 * getDot(gradientChange, gradientChange))
+        {
+            steps.push_back(step);
+            gradientChanges.push_back(gradientChange);
+            curvatures.push_back(1 / curvature);
+            if ((int) steps.size() > historySize)
+            {
+                steps.pop_front();
+                gradientChanges.pop_front();
+                curvatures.pop_front();
+            }
+        }
+
+        weights.swap(trialWeights);
+        gradient.swap(trialGradient);
+        loss = trialLoss;
+    }
+    gradientNorm = (float) sqrt(getDot(gradient, gradient));
+
+    snapshot.weights = weights;
+    return snapshot.restore(*network);
+}
+
+/**
+    Half the mean squared error over all samples and its gradient, every thread
+    accumulates the gradient of its share of the samples
+*/
+float LbfgsTrainer::computeLoss(const std::vector<float>& weights, std::vector<double>& gradient)
+{
+    int numberOfSamples = dataSamples->getSizeY();
+    int threads = std::max(1, std::min(numberOfThreads, numberOfSamples));
+    int groupSize = (numberOfSamples + threads - 1) / threads;
+
+    std::vector<std::vector<float>> partialGradients(threads, std::vector<float>(weights.size(), 0.0f));
+    std::vector<double> squaredErrors(threads, 0.0);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads && i * groupSize < numberOfSamples; i++)
+    {
+        int last = std::min((i + 1) * groupSize, numberOfSamples);
+        workers.push_back(std::thread(&LbfgsTrainer::computeRange, this, std::cref(weights), i * groupSize, last,
+                                      std::ref(partialGradients[i]), std::ref(squaredErrors[i])));
+    }
+
+    // The first range is computed on the calling thread
+    computeRange(weights, 0, std::min(groupSize, numberOfSamples), partialGradients[0], squaredErrors[0]);
+    for (int i = 0; i < (int) workers.size(); i++)
+        workers[i].join();
+
+    // The kernels accumulate (t - y) * f' * x, the descent direction
+    double squaredError = 0;
+    std::fill(gradient.begin(), gradient.end(), 0.0);
+    for (int i = 0; i < threads; i++)
+    {
+        squaredError += squaredErrors[i];
+        for (size_t j = 0; j < gradient.size(); j++)
+            gradient[j] -= partialGradients[i][j];
+    }
+    for (size_t j = 0; j < gradient.size(); j++)
+        gradient[j] /= numberOfSamples;
+    return (float) (squaredError / (2.0 * numberOfSamples));
+}
+
+void LbfgsTrainer::computeRange(const std::vector<float>& weights, int firstSample, int lastSample, std::vector<float>& gradient, double& squaredError)
+{
+    int numberOfLayers = activationFunctions.size();
+    int numberOfSamples = dataSamples->getSizeY();
+    int inputSize = layerSizes[0];
+    int outputSize = layerSizes[numberOfLayers];
+    const float* sampleArray = dataSamples->getArrayRef();
+    const float* targetArray = targets->getArrayRef();
+    int size = std::max(1, batchSize);
+
+    // outputs[0] holds the batch, every feature a contiguous row over the samples
+    std::vector<std::vector<float>> outputs(numberOfLayers + 1), netInputs(numberOfLayers);
+    std::vector<float> delta, inputError;
+    for (int start = firstSample; start < lastSample; start += size)
+    {
+        int count = std::min(size, lastSample - start);
+        outputs[0].resize((size_t) inputSize * count);
+        for (int k = 0; k < inputSize; k++)
+            std::copy_n(sampleArray + (size_t) k * numberOfSamples + start, count, outputs[0].data() + (size_t) k * count);
+
+        for (int layer = 0; layer < numberOfLayers; layer++)
+        {
+            netInputs[layer].resize((size_t) layerSizes[layer + 1] * count);
+            outputs[layer + 1].resize((size_t) layerSizes[layer + 1] * count);
+            NeuralNetworkLayer::forwardBatch(weights.data() + offsets[layer], layerSizes[layer], layerSizes[layer + 1], activationFunctions[layer],
+                                             outputs[layer].data(), count, netInputs[layer].data(), outputs[layer + 1].data());
+        }
+
+        // Error in the delta rule direction: (t - y)
+        delta.resize((size_t) outputSize * count);
+        const float* output = outputs[numberOfLayers].data();
+        for (int i = 0; i < outputSize; i++)
+        {
+            for (int s = 0; s < count; s++)
+            {
+                float error = targetArray[(size_t) i * numberOfSamples + start + s] - output[(size_t) i * count + s];
+                delta[(size_t) i * count + s] = error;
+                squaredError += error * error;
+            }
+        }
+
+        for (int layer = numberOfLayers - 1; layer >= 0; layer--)
+        {
+            if (layer > 0)
+                inputError.resize((size_t) layerSizes[layer] * count);
+            NeuralNetworkLayer::backwardBatch(weights.data() + offsets[layer], layerSizes[layer], layerSizes[layer + 1], activationFunctions[layer],
+                                              outputs[layer].data(), netInputs[layer].data(), delta.data(), count,
+                                              gradient.data() + offsets[layer], layer > 0 ? inputError.data() : nullptr);
+            if (layer > 0)
+                delta.swap(inputError);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef LBFGSTRAINER_H
+#define LBFGSTRAINER_H
+
+#include <vector>
+#include "Matrix.h"
+#include "EActivationFunction.h"
+
+class NeuralNetwork;
+
+/**
+    Full batch training with the limited memory BFGS quasi-Newton method, for
+    networks whose data set fits in memory.
+
+    All weights are one parameter vector in the layout of NetworkSnapshot. Every
+    iteration computes the loss, half the mean squared error over all samples, and
+    its gradient with the batched kernels of NeuralNetworkLayer (forwardBatch and
+    backwardBatch), the samples split over numberOfThreads threads, each working
+    through its share in batches of batchSize. The search direction comes from
+    the last historySize steps and gradient changes (the two loop recursion, in
+    double precision), the step length from a backtracking line search on the
+    sufficient decrease condition. Steps with too little curvature are not
+    remembered, and if the direction is no descent direction the history is
+    dropped and the gradient is followed instead.
+
+    Training stops when the gradient norm falls below gradientTolerance, the loss
+    below targetLoss, the line search fails or after maxIterations. Only fully
+    connected networks are supported (see NetworkSnapshot).
+*/
+class LbfgsTrainer
+{
+    public:
+        LbfgsTrainer(NeuralNetwork& network);
+        ~LbfgsTrainer();
+
+        // Samples (inputSize, numberOfSamples) and targets (outputSize, numberOfSamples), false if nothing could be trained
+        bool train(const Matrix<float>& dataSamples, const Matrix<float>& targets);
+
+        std::vector<float> getLosses(); // The loss before every iteration of the last call to train
+
+        int historySize;
+        int maxIterations;
+        float gradientTolerance;
+        float targetLoss;
+        int batchSize; // Samples per batched pass
+        int numberOfThreads;
+
+        int iterations; // Of the last call to train
+        float loss;
+        float gradientNorm;
+
+    private:
+        float computeLoss(const std::vector<float>& weights, std::vector<double>& gradient);
+        void computeRange(const std::vector<float>& weights, int firstSample, int lastSample, std::vector<float>& gradient, double& squaredError);
+
+        NeuralNetwork* network;
+        std::vector<int> layerSizes;
+        std::vector<EActivationFunction> activationFunctions;
+        std::vector<size_t> offsets; // Of the weights of every layer
+        const Matrix<float>* dataSamples;
+        const Matrix<float>* targets;
+        std::vector<float> losses;
+};
+
+#endif // LBFGSTRAINER_H
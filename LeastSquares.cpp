@@ -0,0 +1,370 @@
+#include "LeastSquares.h"
+#include "Neuron.h"
+#include "NeuralNetwork.h"
+#include "NetworkSnapshot.h"
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+static const int BLOCK_SIZE = 4; // Columns of X per register block of the rank-k update
+static const int MAX_BATCH = 256; // Samples per streamed block
+
+LeastSquares::LeastSquares(int _featureSize, int _outputSize)
+{
+    featureSize = _featureSize;
+    outputSize = _outputSize;
+    size = featureSize + 1;
+    method = CHOLESKY;
+    ridge = 0;
+    reset();
+}
+
+LeastSquares::~LeastSquares()
+{
+
+}
+
+void LeastSquares::reset()
+{
+    int blockedSize = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    gram.assign((size_t) blockedSize * blockedSize, 0.0);
+    moment.assign((size_t) outputSize * size, 0.0);
+    factor.assign((size_t) size * size, 0.0);
+    rotatedTargets.assign((size_t) outputSize * size, 0.0);
+    numberOfSamples = 0;
+}
+
+void LeastSquares::add(const Matrix<float>& dataSamples, const Matrix<float>& targets)
+{
+    if (dataSamples.getSizeX() != featureSize || targets.getSizeX() != outputSize || dataSamples.getSizeY() != targets.getSizeY())
+    {
+        std::cout << "Least squares: Expected (" << featureSize << ", n) samples and (" << outputSize << ", n) targets, got ("
+            << dataSamples.getSizeX() << ", " << dataSamples.getSizeY() << ") and (" << targets.getSizeX() << ", " << targets.getSizeY() << ")!" << std::endl;
+        return;
+    }
+
+    // Every feature (and target) row is contiguous over the samples
+    int total = dataSamples.getSizeY();
+    for (int first = 0; first < total; first += MAX_BATCH)
+    {
+        int batchSize = std::min(MAX_BATCH, total - first);
+        addBatch(dataSamples.getArrayRef() + first, total, targets.getArrayRef() + first, total, batchSize);
+    }
+}
+
+/**
+    Copies a block of samples into the augmented batch (bias column, feature columns,
+    zero columns up to a multiple of BLOCK_SIZE, target columns) and folds it in
+*/
+void LeastSquares::addBatch(const float* dataSamples, int dataStride, const float* targets, int targetStride, int batchSize)
+{
+    int blockedSize = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    batch.assign((size_t) (blockedSize + outputSize) * batchSize, 0.0);
+    std::fill(batch.begin(), batch.begin() + batchSize, 1.0);
+    for (int k = 0; k < featureSize; k++)
+        for (int s = 0; s < batchSize; s++)
+            batch[(size_t) (k + 1) * batchSize + s] = dataSamples[(size_t) k * dataStride + s];
+    for (int o = 0; o < outputSize; o++)
+        for (int s = 0; s < batchSize; s++)
+            batch[(size_t) (blockedSize + o) * batchSize + s] = targets[(size_t) o * targetStride + s];
+
+    if (method == QR)
+        updateFactor(factor, rotatedTargets, batch, batchSize, blockedSize);
+    else
+        accumulateNormalEquations(batchSize);
+    numberOfSamples += batchSize;
+}
+
+/**
+    X^T X and X^T t of the batch, the lower triangle only (SYRK) in blocks of
+    BLOCK_SIZE x BLOCK_SIZE accumulators kept in registers
+*/
+void LeastSquares::accumulateNormalEquations(int batchSize)
+{
+    int blockedSize = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    const double* columns = batch.data();
+
+    for (int i0 = 0; i0 < blockedSize; i0 += BLOCK_SIZE)
+    {
+        for (int j0 = 0; j0 <= i0; j0 += BLOCK_SIZE)
+        {
+            double sums[BLOCK_SIZE][BLOCK_SIZE] = {};
+            for (int s = 0; s < batchSize; s++)
+            {
+                double x[BLOCK_SIZE], y[BLOCK_SIZE];
+                for (int a = 0; a < BLOCK_SIZE; a++)
+                {
+                    x[a] = columns[(size_t) (i0 + a) * batchSize + s];
+                    y[a] = columns[(size_t) (j0 + a) * batchSize + s];
+                }
+                for (int a = 0; a < BLOCK_SIZE; a++)
+                    for (int b = 0; b < BLOCK_SIZE; b++)
+                        sums[a][b] += x[a] * y[b];
+            }
+            for (int a = 0; a < BLOCK_SIZE; a++)
+                for (int b = 0; b < BLOCK_SIZE; b++)
+                    gram[(size_t) (i0 + a) * blockedSize + j0 + b] += sums[a][b];
+        }
+    }
+
+    for (int o = 0; o < outputSize; o++)
+    {
+        const double* target = columns + (size_t) (blockedSize + o) * batchSize;
+        for (int i = 0; i < size; i++)
+        {
+            const double* column = columns + (size_t) i * batchSize;
+            double sum = 0;
+            for (int s = 0; s < batchSize; s++)
+                sum += column[s] * target[s];
+            moment[(size_t) o * size + i] += sum;
+        }
+    }
+}
+
+/**
+    Householder QR of [R; rows], R stays upper triangular and z = Q^T t is rotated
+    along. A reflection only mixes row j of R with the new rows, so a batch costs
+    O(rows * size^2) however many samples came before it.
+*/
+void LeastSquares::updateFactor(std::vector<double>& r, std::vector<double>& z, std::vector<double>& rows, int numberOfRows, int targetColumn)
+{
+    for (int j = 0; j < size; j++)
+    {
+        double* v = rows.data() + (size_t) j * numberOfRows;
+        double sigma = 0;
+        for (int s = 0; s < numberOfRows; s++)
+            sigma += v[s] * v[s];
+        if (sigma == 0)
+            continue; // The column is triangular already
+
+        double alpha = r[(size_t) j * size + j];
+        double norm = sqrt(alpha * alpha + sigma);
+        double beta = alpha > 0 ? -norm : norm; // The new diagonal, the sign avoids cancellation
+        double v0 = alpha - beta;
+        double scale = 2.0 / (v0 * v0 + sigma);
+
+        // Reflect the remaining columns of R and the rotated targets
+        for (int c = j + 1; c < size + outputSize; c++)
+        {
+            double& head = c < size ? r[(size_t) j * size + c] : z[(size_t) (c - size) * size + j];
+            double* column = rows.data() + (size_t) (c < size ? c : targetColumn + c - size) * numberOfRows;
+            double dot = v0 * head;
+            for (int s = 0; s < numberOfRows; s++)
+                dot += v[s] * column[s];
+            double f = scale * dot;
+            head -= f * v0;
+            for (int s = 0; s < numberOfRows; s++)
+                column[s] -= f * v[s];
+        }
+        r[(size_t) j * size + j] = beta;
+    }
+}
+
+bool LeastSquares::solve(std::vector<float>& weights)
+{
+    if (numberOfSamples == 0)
+    {
+        std::cout << "Least squares: No samples were added!" << std::endl;
+        return false;
+    }
+
+    weights.resize((size_t) outputSize * size);
+    return method == QR ? solveQR(weights) : solveCholesky(weights);
+}
+
+bool LeastSquares::solveCholesky(std::vector<float>& weights)
+{
+    int blockedSize = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+    /// 1) L L^T = X^T X + ridge (the bias is not penalised)
+    std::vector<double> l((size_t) size * size, 0.0);
+    for (int j = 0; j < size; j++)
+    {
+        double diagonal = gram[(size_t) j * blockedSize + j] + (j > 0 ? ridge : 0);
+        double d = diagonal;
+        for (int k = 0; k < j; k++)
+            d -= l[(size_t) j * size + k] * l[(size_t) j * size + k];
+        if (d <= 1e-12 * diagonal || d <= 0)
+        {
+            std::cout << "Least squares: The normal equations are singular at weight " << j << ", use a ridge penalty or QR!" << std::endl;
+            return false;
+        }
+        l[(size_t) j * size + j] = sqrt(d);
+
+        for (int i = j + 1; i < size; i++)
+        {
+            double sum = gram[(size_t) i * blockedSize + j];
+            for (int k = 0; k < j; k++)
+                sum -= l[(size_t) i * size + k] * l[(size_t) j * size + k];
+            l[(size_t) i * size + j] = sum / l[(size_t) j * size + j];
+        }
+    }
+
+    /// 2) Forward and back substitution for every output
+    std::vector<double> y(size);
+    for (int o = 0; o < outputSize; o++)
+    {
+        const double* b = moment.data() + (size_t) o * size;
+        for (int i = 0; i < size; i++)
+        {
+            double sum = b[i];
+            for (int k = 0; k < i; k++)
+                sum -= l[(size_t) i * size + k] * y[k];
+            y[i] = sum / l[(size_t) i * size + i];
+        }
+        for (int i = size - 1; i >= 0; i--)
+        {
+            double sum = y[i];
+            for (int k = i + 1; k < size; k++)
+                sum -= l[(size_t) k * size + i] * y[k];
+            y[i] = sum / l[(size_t) i * size + i];
+        }
+        for (int i = 0; i < size; i++)
+            weights[(size_t) o * size + i] = y[i];
+    }
+    return true;
+}
+
+bool LeastSquares::solveQR(std::vector<float>& weights)
+{
+    std::vector<double> r = factor;
+    std::vector<double> z = rotatedTargets;
+
+    /// 1) The ridge penalty is sqrt(ridge) * I appended to X (with target 0), folded in as one more batch
+    if (ridge > 0)
+    {
+        int numberOfRows = featureSize;
+        std::vector<double> rows((size_t) (size + outputSize) * numberOfRows, 0.0);
+        for (int k = 0; k < featureSize; k++)
+            rows[(size_t) (k + 1) * numberOfRows + k] = sqrt(ridge);
+        updateFactor(r, z, rows, numberOfRows, size);
+    }
+
+    /// 2) Back substitution R w = Q^T t
+    double largest = 0;
+    for (int i = 0; i < size; i++)
+        largest = std::max(largest, fabs(r[(size_t) i * size + i]));
+    for (int i = 0; i < size; i++)
+    {
+        if (fabs(r[(size_t) i * size + i]) <= 1e-10 * largest)
+        {
+            std::cout << "Least squares: The samples do not determine weight " << i << ", use a ridge penalty!" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<double> w(size);
+    for (int o = 0; o < outputSize; o++)
+    {
+        for (int i = size - 1; i >= 0; i--)
+        {
+            double sum = z[(size_t) o * size + i];
+            for (int k = i + 1; k < size; k++)
+                sum -= r[(size_t) i * size + k] * w[k];
+            w[i] = sum / r[(size_t) i * size + i];
+        }
+        for (int i = 0; i < size; i++)
+            weights[(size_t) o * size + i] = w[i];
+    }
+    return true;
+}
+
+bool LeastSquares::fit(Neuron& neuron, Matrix<float>& featureMatrix, Array<float>& classificationVector)
+{
+    if (neuron.activationFunctionEnum != LINEAR || outputSize != 1)
+    {
+        std::cout << "Least squares: Only a LINEAR neuron can be fitted in closed form!" << std::endl;
+        return false;
+    }
+
+    if (featureMatrix.getSizeY() != classificationVector.size())
+    {
+        std::cout << "Least squares: The number of samples in the feature matrix must equal to the classification vector size!" << std::endl;
+        return false;
+    }
+
+    Matrix<float> targets(1, classificationVector.size());
+    for (int i = 0; i < classificationVector.size(); i++)
+        targets[0][i] = classificationVector[i];
+
+    reset();
+    add(featureMatrix, targets);
+    std::vector<float> weights;
+    if (numberOfSamples == 0 || !solve(weights))
+        return false;
+
+    if (neuron.weightMatrix.getSizeX() != size)
+        neuron.initWeightMatrix(featureSize);
+    for (int i = 0; i < size; i++)
+        neuron.weightMatrix[i][0] = weights[i];
+    return true;
+}
+
+/**
+    Propagates the samples through the hidden layers in batches and fits the output
+    layer on their outputs, the hidden layers are not changed
+*/
+bool LeastSquares::fitOutputLayer(NeuralNetwork& network, const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize)
+{
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(network))
+    {
+        std::cout << "Least squares: Only fully connected networks can be fitted!" << std::endl;
+        return false;
+    }
+
+    int numberOfLayers = snapshot.layerSizes.size();
+    if (snapshot.activationFunctions.back() != LINEAR)
+    {
+        std::cout << "Least squares: Only a LINEAR output layer can be fitted in closed form!" << std::endl;
+        return false;
+    }
+    if (snapshot.layerSizes[numberOfLayers - 2] != featureSize || snapshot.getOutputSize() != outputSize
+        || dataSamples.getSizeX() != snapshot.getInputSize() || targets.getSizeX() != outputSize
+        || dataSamples.getSizeY() != targets.getSizeY())
+    {
+        std::cout << "Least squares: The network, the samples or the targets do not match the least squares problem!" << std::endl;
+        return false;
+    }
+
+    reset();
+    int total = dataSamples.getSizeY();
+    batchSize = std::max(1, std::min(batchSize, MAX_BATCH));
+    std::vector<float> current, next, netInput;
+    for (int first = 0; first < total; first += batchSize)
+    {
+        int count = std::min(batchSize, total - first);
+
+        // Gather the block of samples, (inputSize, count)
+        int inputSize = snapshot.getInputSize();
+        current.resize((size_t) inputSize * count);
+        for (int k = 0; k < inputSize; k++)
+            std::copy_n(dataSamples.getArrayRef() + (size_t) k * total + first, count, current.data() + (size_t) k * count);
+
+        // Through the hidden layers
+        const float* weight = snapshot.weights.data();
+        for (int layer = 1; layer < numberOfLayers - 1; layer++)
+        {
+            int previousSize = snapshot.layerSizes[layer - 1];
+            int layerSize = snapshot.layerSizes[layer];
+            next.resize((size_t) layerSize * count);
+            netInput.resize((size_t) layerSize * count);
+            NeuralNetworkLayer::forwardBatch(weight, previousSize, layerSize, snapshot.activationFunctions[layer - 1],
+                                             current.data(), count, netInput.data(), next.data());
+            weight += (size_t) layerSize * (previousSize + 1);
+            current.swap(next);
+        }
+
+        addBatch(current.data(), count, targets.getArrayRef() + first, total, count);
+    }
+
+    std::vector<float> weights;
+    if (!solve(weights))
+        return false;
+
+    NeuralNetworkLayer& outputLayer = network.layers[network.layers.size() - 1];
+    for (int o = 0; o < outputSize; o++)
+        for (int i = 0; i < size; i++)
+            outputLayer.neurons[o].weightMatrix[i][0] = weights[(size_t) o * size + i];
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef LEASTSQUARES_H
+#define LEASTSQUARES_H
+
+#include <vector>
+#include "Matrix.h"
+#include "Array.h"
+#include "ELeastSquaresMethod.h"
+
+class Neuron;
+class NeuralNetwork;
+
+/**
+    Closed form fit of linear neurons, the optimum the delta rule converges to in
+    a single pass over the data.
+
+    The samples are streamed in with add, (featureSize, batch) as everywhere else,
+    and augmented with the constant 1 of the bias. CHOLESKY accumulates the normal
+    equations X^T X (a blocked rank-k update of the lower triangle) and X^T t in
+    double precision and solves them with a Cholesky factorisation. QR keeps the R
+    factor of X instead and folds every batch in with Householder reflections, which
+    avoids squaring the condition number. The optional ridge penalty is added to all
+    weights except the biases.
+
+    The solution is output by output, bias first, as in a neuron's weight matrix.
+*/
+class LeastSquares
+{
+    public:
+        LeastSquares(int featureSize, int outputSize = 1);
+        ~LeastSquares();
+
+        void reset(); // Forgets all samples
+        void add(const Matrix<float>& dataSamples, const Matrix<float>& targets); // (featureSize, batch) and (outputSize, batch)
+        bool solve(std::vector<float>& weights); // outputSize * (featureSize + 1) weights, false if the system is singular
+
+        // Fits a LINEAR neuron like deltaLearning, the samples are (featureSize, numberOfSamples)
+        bool fit(Neuron& neuron, Matrix<float>& featureMatrix, Array<float>& classificationVector);
+
+        // Fits the LINEAR output layer on the features of the frozen hidden layers
+        bool fitOutputLayer(NeuralNetwork& network, const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize = 256);
+
+        ELeastSquaresMethod method; // Set before adding samples
+        double ridge; // L2 penalty on the weights (not the biases)
+        long long numberOfSamples;
+
+    private:
+        void addBatch(const float* dataSamples, int dataStride, const float* targets, int targetStride, int batchSize);
+        void accumulateNormalEquations(int batchSize);
+        void updateFactor(std::vector<double>& r, std::vector<double>& z, std::vector<double>& rows, int numberOfRows, int targetColumn);
+        bool solveCholesky(std::vector<float>& weights);
+        bool solveQR(std::vector<float>& weights);
+
+        int featureSize, outputSize, size; // size = featureSize + 1
+        std::vector<double> gram; // CHOLESKY, X^T X (lower triangle), rounded up to whole blocks
+        std::vector<double> moment; // CHOLESKY, X^T t, outputSize * size
+        std::vector<double> factor; // QR, R (upper triangle), size * size
+        std::vector<double> rotatedTargets; // QR, Q^T t, outputSize * size
+        std::vector<double> batch; // Augmented batch, column by column: bias, features, zero padding, targets
+};
+
+#endif // LEASTSQUARES_H
@@ -4,6 +4,16 @@
 #include <memory>
 #include <math.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include "MatrixAllocator.h"
+#include "EMatrixLayout.h"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 /**
     UPDATE: 8/7/2018
@@ -13,37 +23,96 @@
 
     Given (i, j), access becomes: i * sizeY + j.
     A little counter intuitive but actually makes more sense this way
+
+    That is the COLUMN_MAJOR layout (the default). ROW_MAJOR matrices store the
+    element (i, j) at j * sizeX + i instead; matrix[i][j] works the same for both.
+
+    Copies share the same storage (copy on write). The first write access through
+    a non-const operator[], getElement or getArrayRef of a shared matrix makes a
+    private copy; the const overloads never copy nor check. Pointers returned by the
+    non-const accessors must not be kept across copies of the matrix.
+*/
+/**
+    Accessor returned by operator [] of row major matrices: the elements of one
+    x (column) are sizeX apart in memory
 */
 template <class T>
+class StridedArray
+{
+    T* start;
+    int stride;
+
+    public:
+        StridedArray(T* _start, int _stride) : start(_start), stride(_stride) {}
+        T& operator [] (int index) const { return start[(size_t) index * stride]; }
+};
+
+/**
+    Number of rows of the column major dot product computed together, 0 for whole
+    columns. Installed by the Autotuner, called with the element type and the sizes
+    x1, x2 and y1 of the product. Atomic since it may be swapped while other
+    threads multiply, the function itself must be safe to call from any thread.
+*/
+typedef int (*MatrixDotBlockSizeFunction)(const char* type, int x1, int x2, int y1);
+inline std::atomic<MatrixDotBlockSizeFunction> matrixDotBlockSize(nullptr);
+static const long long MATRIX_DOT_TUNING_WORK = 1 << 16; // Smaller products are not worth a lookup
+
+template <class T, EMatrixLayout Layout = COLUMN_MAJOR>
 class Matrix
 {
+    template <class, EMatrixLayout> friend class Matrix;
+
     std::shared_ptr<T[]> ptr;
     int sizeX, sizeY;
 
+    // Column major matrices hand out plain pointers to a column, row major ones a strided accessor
+    typedef typename std::conditional<Layout == COLUMN_MAJOR, T*, StridedArray<T>>::type Column;
+    typedef typename std::conditional<Layout == COLUMN_MAJOR, const T*, StridedArray<const T>>::type ConstColumn;
+
     public:
         Matrix(){sizeX = 0; sizeY = 0;}
         Matrix(int _sizeX, int _sizeY) : sizeX(_sizeX), sizeY(_sizeY)
-            {ptr.reset(new T[sizeX * sizeY]);};
+            {ptr = allocateArray(sizeX * sizeY);};
+        Matrix(int _sizeX, int _sizeY, std::shared_ptr<T[]> storage) : ptr(storage), sizeX(_sizeX), sizeY(_sizeY) {} // Wraps existing storage
+        Matrix(const Matrix<T, Layout>& matrix) : ptr(matrix.ptr), sizeX(matrix.sizeX), sizeY(matrix.sizeY) {} // Shares the storage
         ~Matrix(){};
 
         // Methods
         int getSizeX() const {return sizeX;}
         int getSizeY() const {return sizeY;}
         int getSize() const { return sizeX * sizeY;}
+        static constexpr EMatrixLayout getLayout() {return Layout;}
+
+        /**
+        Position of the element (x, y) within the storage
+        */
+        int index(int x, int y) const
+        {
+            if constexpr (Layout == COLUMN_MAJOR)
+                return x * sizeY + y;
+            else
+                return y * sizeX + x;
+        }
 
         /**
         Matrix element access method
         */
         T& getElement(int x, int y)
         {
-            return ptr[x * sizeY + y];
+            detach();
+            return ptr[index(x, y)];
+        }
+
+        const T& getElement(int x, int y) const
+        {
+            return ptr[index(x, y)];
         }
 
         /**
         Creates and returns a sub matrix given the dimensions
         relative to the current matrix
         */
-        Matrix<T> subMatrix(int minX, int maxX, int minY, int maxY)
+        Matrix<T, Layout> subMatrix(int minX, int maxX, int minY, int maxY) const
         {
             /// 1) Limit the parameters
             if (minX < 0) minX = 0;
@@ -51,11 +120,19 @@ class Matrix
             if (minY < 0) minY = 0;
             if (maxY >= sizeY) maxY = sizeY - 1;
 
-            /// 2) Create the sub matrix
-            Matrix<T> matrix(maxX - minX + 1, maxY - minY + 1);
-            for (int x = 0; x < matrix.getSizeX(); x++)
+            /// 2) Create the sub matrix, copying contiguous runs of the storage
+            Matrix<T, Layout> matrix(maxX - minX + 1, maxY - minY + 1);
+            T* target = matrix.ptr.get();
+            if constexpr (Layout == COLUMN_MAJOR)
+            {
+                for (int x = 0; x < matrix.getSizeX(); x++)
+                    std::copy_n(&ptr[index(x + minX, minY)], matrix.getSizeY(), target + matrix.index(x, 0));
+            }
+            else
+            {
                 for (int y = 0; y < matrix.getSizeY(); y++)
-                    matrix[x][y] = (*this)[x + minX][y + minY];
+                    std::copy_n(&ptr[index(minX, y + minY)], matrix.getSizeX(), target + matrix.index(0, y));
+            }
 
             /// 3) Return the sub matrix
             return matrix;
@@ -66,68 +143,140 @@ class Matrix
         */
         void fill(T value)
         {
+            detach();
             for (int i = 0; i < sizeX * sizeY; i++)
                 ptr[i] = value;
         }
 
         /// Operators
-        T* operator [] (int index)
+        Column operator [] (int index)
         {
-            return &ptr[index * sizeY];
+            detach();
+            if constexpr (Layout == COLUMN_MAJOR)
+                return &ptr[index * sizeY];
+            else
+                return StridedArray<T>(&ptr[index], sizeX);
+        }
+
+        ConstColumn operator [] (int index) const
+        {
+            if constexpr (Layout == COLUMN_MAJOR)
+                return &ptr[index * sizeY];
+            else
+                return StridedArray<const T>(&ptr[index], sizeX);
         }
 
         void setSize(int newSizeX, int newSizeY)
         {
-            T* newArray = new T[newSizeX * newSizeY];
+            Matrix<T, Layout> newMatrix(newSizeX, newSizeY);
 
             // Copy over the array contents of the current array to the new array.
-            for (int y = 0; y < newSizeY && y < sizeY; y++)
-                for (int x = 0; x < newSizeX && x < sizeX; x++)
-                {
-                    newArray[(x * newSizeY) + y] = ptr[(x * sizeY) + y];
-                }
+            // The inner loop walks the contiguous direction of the layout.
+            int overlapX = std::min(newSizeX, sizeX);
+            int overlapY = std::min(newSizeY, sizeY);
+            if constexpr (Layout == COLUMN_MAJOR)
+            {
+                for (int x = 0; x < overlapX; x++)
+                    std::copy_n(&ptr[index(x, 0)], overlapY, &newMatrix.ptr[newMatrix.index(x, 0)]);
+            }
+            else
+            {
+                for (int y = 0; y < overlapY; y++)
+                    std::copy_n(&ptr[index(0, y)], overlapX, &newMatrix.ptr[newMatrix.index(0, y)]);
+            }
 
-            // Delete the old array as it is no longer needed
-            ptr.reset(newArray);
+            // Release the old array as it is no longer needed
+            ptr = newMatrix.ptr;
             sizeX = newSizeX;
             sizeY = newSizeY;
         }
 
         T* getArrayRef()
+        {
+            detach();
+            return ptr.get();
+        }
+
+        const T* getArrayRef() const
         {
             return ptr.get();
         }
 
-//        void operator= (Matrix<T> &matrix) // Deep copy for same typed matrices
-        void operator= (Matrix<T> matrix) // Deep copy for same typed matrices
+        /**
+        Checks if the storage is shared with another matrix
+        */
+        bool isShared() const
+        {
+            if (ptr.use_count() > 1)
+                return true;
+            std::atomic_thread_fence(std::memory_order_acquire); // See detach
+            return false;
+        }
+
+        /**
+        Returns the storage to the allocator (for reuse by the next matrix of a
+        similar size) and leaves an empty matrix
+        */
+        void release()
+        {
+            ptr.reset();
+            sizeX = 0;
+            sizeY = 0;
+        }
+
+        /**
+        Reinterprets the storage as the transpose in the other layout, without copying.
+        A column major (x, y) matrix has the same memory as a row major (y, x) one.
+        */
+        Matrix<T, Layout == COLUMN_MAJOR ? ROW_MAJOR : COLUMN_MAJOR> transposedView() const
         {
+            return Matrix<T, Layout == COLUMN_MAJOR ? ROW_MAJOR : COLUMN_MAJOR>(sizeY, sizeX, ptr);
+        }
+
+        /**
+        Copies a matrix of any layout into this one, converting the layout
+        */
+        template <EMatrixLayout OtherLayout>
+        void copyFrom(const Matrix<T, OtherLayout> &matrix)
+        {
+            if constexpr (OtherLayout == Layout)
+            {
+                *this = matrix;
+                detach();
+            }
+            else
+            {
+                // The source of the other layout is the transpose of this layout, copy it over block by block
+                ptr = allocateArray(matrix.getSize());
+                sizeX = matrix.getSizeX();
+                sizeY = matrix.getSizeY();
+                if constexpr (Layout == COLUMN_MAJOR)
+                    transposeBlocked(matrix.ptr.get(), ptr.get(), sizeY, sizeX);
+                else
+                    transposeBlocked(matrix.ptr.get(), ptr.get(), sizeX, sizeY);
+            }
+        }
+
+        void operator= (const Matrix<T, Layout> &matrix) // Copy on write for same typed matrices
+        {
+            ptr = matrix.ptr;
             sizeX = matrix.getSizeX();
             sizeY = matrix.getSizeY();
-            ptr.reset(new T[sizeX * sizeY]);
-            for (int y = 0; y < sizeY; y++)
-                for (int x = 0; x < sizeX; x++)
-                    ptr[(x * sizeY) + y] = matrix[x][y];
         }
 
-        void operator= (Matrix<T> *matrix) // Deep copy for same typed matrices
+        void operator= (const Matrix<T, Layout> *matrix) // Copy on write for same typed matrices
         {
+            ptr = matrix->ptr;
             sizeX = matrix->getSizeX();
             sizeY = matrix->getSizeY();
-            ptr.reset(new T[sizeX * sizeY]);
-            for (int y = 0; y < sizeY; y++)
-                for (int x = 0; x < sizeX; x++)
-                    ptr[(x * sizeY) + y] = (*matrix)[x][y];
         }
 
-        Matrix<T> operator + (Matrix<T> matrix)
+        Matrix<T, Layout> operator + (const Matrix<T, Layout> &matrix) const
         {
             if (sizeX == matrix.getSizeX() && sizeY == matrix.getSizeY())
             {
-                Matrix<T> toReturn;
-                toReturn.setSize(sizeX, sizeY);
-                for (int x = 0; x < sizeX ; x++)
-                    for (int y = 0; y < sizeY ; y++)
-                        toReturn[x][y] = (*this)[x][y] + matrix[x][y];
+                Matrix<T, Layout> toReturn;
+                toReturn.add(*this, matrix);
                 return toReturn;
             }
             else
@@ -137,15 +286,12 @@ class Matrix
             }
         }
 
-        Matrix<T> operator - (Matrix<T> matrix)
+        Matrix<T, Layout> operator - (const Matrix<T, Layout> &matrix) const
         {
             if (sizeX == matrix.getSizeX() && sizeY == matrix.getSizeY())
             {
-                Matrix<T> toReturn;
-                toReturn.setSize(sizeX, sizeY);
-                for (int x = 0; x < sizeX ; x++)
-                    for (int y = 0; y < sizeY ; y++)
-                        toReturn[x][y] = (*this)[x][y] - matrix[x][y];
+                Matrix<T, Layout> toReturn;
+                toReturn.deduct(*this, matrix);
                 return toReturn;
             }
             else
@@ -159,48 +305,48 @@ class Matrix
         /**
         Produces the result of adding both matrices given that they apply
         */
-        void add(Matrix<T> &matrix1, Matrix<T> &matrix2)
+        void add(const Matrix<T, Layout> &matrix1, const Matrix<T, Layout> &matrix2)
         {
             // Check if both matrices have the same dimensions
             if (matrix1.getSizeX() == matrix2.getSizeX() && matrix1.getSizeY() == matrix2.getSizeY())
             {
-                // Reassign memory space for the pointer to match the size of the two matrices
+                // Assign new memory space to match the size of the two matrices
+                // (either of them may be this matrix)
+                std::shared_ptr<T[]> newArray = allocateArray(matrix1.getSize());
+
+                // Perform addition on both matrices to this matrix, all three share the same layout
+                const T* array1 = matrix1.ptr.get();
+                const T* array2 = matrix2.ptr.get();
+                for (int i = 0; i < matrix1.getSize(); i++)
+                    newArray[i] = array1[i] + array2[i];
+
+                ptr = newArray;
                 sizeX = matrix1.getSizeX();
                 sizeY = matrix1.getSizeY();
-                ptr.reset(new T[sizeX * sizeY]);
-
-                // Perform addition on both matrices to this matrix
-                for (int x = 0; x < sizeX ; x++)
-                {
-                    for (int y = 0; y < sizeY ; y++)
-                    {
-                        ptr[x * sizeY + y] = matrix1[x][y] + matrix2[x][y];
-                    }
-                }
             }
         }
 
         /**
         Produces the result of adding both matrices given that they apply
         */
-        void deduct(Matrix<T> &matrix1, Matrix<T> &matrix2)
+        void deduct(const Matrix<T, Layout> &matrix1, const Matrix<T, Layout> &matrix2)
         {
             // Check if both matrices have the same dimensions
             if (matrix1.getSizeX() == matrix2.getSizeX() && matrix1.getSizeY() == matrix2.getSizeY())
             {
-                // Reassign memory space for the pointer to match the size of the two matrices
+                // Assign new memory space to match the size of the two matrices
+                // (either of them may be this matrix)
+                std::shared_ptr<T[]> newArray = allocateArray(matrix1.getSize());
+
+                // Perform deduction on both matrices to this matrix, all three share the same layout
+                const T* array1 = matrix1.ptr.get();
+                const T* array2 = matrix2.ptr.get();
+                for (int i = 0; i < matrix1.getSize(); i++)
+                    newArray[i] = array1[i] - array2[i];
+
+                ptr = newArray;
                 sizeX = matrix1.getSizeX();
                 sizeY = matrix1.getSizeY();
-                ptr.reset(new T[sizeX * sizeY]);
-
-                // Perform addition on both matrices to this matrix
-                for (int x = 0; x < sizeX ; x++)
-                {
-                    for (int y = 0; y < sizeY ; y++)
-                    {
-                        ptr[x * sizeY + y] = matrix1[x][y] - matrix2[x][y];
-                    }
-                }
             }
         }
 
@@ -210,46 +356,86 @@ class Matrix
         */
         void multiply(T value)
         {
-            for (int x = 0; x < sizeX; x++)
-            {
-                for (int y = 0; y < sizeY; y++)
-                {
-                    ptr[x * sizeY + y] *= value;
-                }
-            }
+            detach();
+            for (int i = 0; i < sizeX * sizeY; i++)
+                ptr[i] *= value;
         }
 
         /**
         Dot product
         Produces the result of multiplying both matrices given that they apply
         Algorithm: Naive multiplication O(n^3)
+        The loop order depends on the layouts so that the innermost loop walks
+        contiguous memory: column major results accumulate whole columns of
+        matrix1, row major results whole rows of matrix2, otherwise each element is
+        an inner product of a row of matrix1 with a column of matrix2. Large column
+        major products are computed in blocks of rows (see matrixDotBlockSize) so the
+        rows of matrix1 being reused stay in the cache.
         */
-        void dot(Matrix<T> matrix1, Matrix<T> matrix2)
+        template <EMatrixLayout Layout1, EMatrixLayout Layout2>
+        void dot(const Matrix<T, Layout1> &matrix1, const Matrix<T, Layout2> &matrix2)
         {
             // Checking if the both matrices are compatible for multiplication
             if (matrix1.getSizeX() == matrix2.getSizeY())
             {
-                // Reassign memory space for the pointer to match the size of the two matrices
+                // Assign new memory space to match the size of the two matrices
+                // (either of them may be this matrix)
                 int x1 = matrix1.getSizeX();
                 int x2 = matrix2.getSizeX();
                 int y1 = matrix1.getSizeY();
                 // int y2 = matrix2.getSizeY();
-                ptr.reset(new T[x2 * y1]);
-                sizeX = x2;
-                sizeY = y1;
+                Matrix<T, Layout> result(x2, y1);
+                T* target = result.ptr.get();
+                const T* array1 = matrix1.ptr.get();
+                const T* array2 = matrix2.ptr.get();
 
                 // Perform multiplication on both matrices
-                for (int i1 = 0; i1 < y1; i1++)
+                // (a single row result is one inner product per element, which is contiguous as well)
+                if (y1 == 1)
+                    dotInnerProducts(matrix1, matrix2, result);
+                else if constexpr (Layout == COLUMN_MAJOR && Layout1 == COLUMN_MAJOR)
+                {
+                    // result[i2] += matrix1[i3] * matrix2[i2][i3], columns are contiguous
+                    std::fill_n(target, x2 * y1, T(0));
+                    int blockSize = getDotBlockSize(x1, x2, y1);
+                    for (int first = 0; first < y1; first += blockSize)
+                    {
+                        int last = std::min(y1, first + blockSize);
+                        for (int i2 = 0; i2 < x2; i2++)
+                        {
+                            T* column = target + (size_t) i2 * y1;
+                            for (int i3 = 0; i3 < x1; i3++)
+                            {
+                                T factor = array2[matrix2.index(i2, i3)];
+                                const T* column1 = array1 + (size_t) i3 * y1;
+                                for (int i1 = first; i1 < last; i1++)
+                                    column[i1] += column1[i1] * factor;
+                            }
+                        }
+                    }
+                }
+                else if constexpr (Layout == ROW_MAJOR && Layout2 == ROW_MAJOR)
                 {
-                    for (int i2 = 0; i2 < x2; i2++)
+                    // Row i1 of the result += matrix1[i3][i1] * row i3 of matrix2, rows are contiguous
+                    std::fill_n(target, x2 * y1, T(0));
+                    for (int i1 = 0; i1 < y1; i1++)
                     {
-                        T sum = 0;
+                        T* row = target + (size_t) i1 * x2;
                         for (int i3 = 0; i3 < x1; i3++)
-                            sum += matrix1[i3][i1] * matrix2[i2][i3];
-
-                        (*this)[i2][i1] = sum;
+                        {
+                            T factor = array1[matrix1.index(i3, i1)];
+                            const T* row2 = array2 + (size_t) i3 * x2;
+                            for (int i2 = 0; i2 < x2; i2++)
+                                row[i2] += factor * row2[i2];
+                        }
                     }
                 }
+                else
+                    dotInnerProducts(matrix1, matrix2, result);
+
+                ptr = result.ptr;
+                sizeX = x2;
+                sizeY = y1;
             }
             else
             {
@@ -259,23 +445,67 @@ class Matrix
 
         /**
         Transposes the matrix
+        Square matrices are transposed in place, otherwise the elements are copied
+        block by block into a new heap buffer so neither side of the copy misses
+        the cache on every element. No stack memory proportional to the size is used.
         */
         void transpose()
         {
-            // Create an temporary array
-            int size = sizeX * sizeY;
-            T tempArray[size];
-            for (int i = 0; i < size; i++)
-                tempArray[i] = ptr[i];
+            if (sizeX == sizeY)
+            {
+                detach();
+                transposeSquareInPlace(ptr.get(), sizeX);
+                return;
+            }
 
-            // Then simply change the layout of everything
-            for (int y = 0; y < sizeY; y++)
-                for (int x = 0; x < sizeX; x++)
-                    ptr[y * sizeY + x] = tempArray[x * sizeY + y];
+            std::shared_ptr<T[]> newArray = allocateArray(sizeX * sizeY);
+            transposeBlocked(ptr.get(), newArray.get(), getOuterSize(), getInnerSize());
+            ptr = newArray;
 
             // Reverse the sizes
+            int temp = sizeX;
             sizeX = sizeY;
-            sizeY = size / sizeX;
+            sizeY = temp;
+        }
+
+        /**
+        Transposes the matrix without allocating a second buffer by following the
+        permutation cycles. Slower than transpose() for non-square matrices, but
+        only needs one bit of (heap) bookkeeping per element.
+        */
+        void transposeInPlace()
+        {
+            detach();
+            if (sizeX == sizeY)
+            {
+                transposeSquareInPlace(ptr.get(), sizeX);
+                return;
+            }
+
+            // The element at position p moves to p * outer size mod (size - 1),
+            // the first and the last elements never move
+            long long size = (long long) sizeX * sizeY;
+            long long outerSize = getOuterSize();
+            std::vector<bool> moved(size, false);
+            for (long long start = 1; start < size - 1; start++)
+            {
+                if (moved[start])
+                    continue;
+
+                T value = ptr[start];
+                long long position = start;
+                do
+                {
+                    position = position * outerSize % (size - 1);
+                    std::swap(value, ptr[position]);
+                    moved[position] = true;
+                } while (position != start);
+            }
+
+            // Reverse the sizes
+            int temp = sizeX;
+            sizeX = sizeY;
+            sizeY = temp;
         }
 
         /**
@@ -283,13 +513,9 @@ class Matrix
         */
         void clear()
         {
-            for (int x = 0; x < sizeX; x++)
-                {
-                    for (int y = 0; y < sizeY; y++)
-                    {
-                        ptr[x * sizeY + y] = 0;
-                    }
-                }
+            detach();
+            for (int i = 0; i < sizeX * sizeY; i++)
+                ptr[i] = 0;
         }
 
         /**
@@ -301,17 +527,198 @@ class Matrix
             // If the size specified is valid (larger than 0
             if (size > 0)
             {
-                ptr.reset(new T[size * size]);
+                ptr = allocateArray(size * size);
                 sizeX = size;
                 sizeY = size;
 
                 clear();
                 for (int i = 0; i < size; i++)
                 {
-                    ptr[i * sizeY + i] = 1;
+                    ptr[index(i, i)] = 1;
+                }
+            }
+        }
+
+    private:
+        /**
+        Dot product with one inner product per element of the result,
+        contiguous when matrix1 is row major and matrix2 column major
+        */
+        template <EMatrixLayout Layout1, EMatrixLayout Layout2>
+        static void dotInnerProducts(const Matrix<T, Layout1> &matrix1, const Matrix<T, Layout2> &matrix2, Matrix<T, Layout> &result)
+        {
+            int x1 = matrix1.getSizeX();
+            int x2 = matrix2.getSizeX();
+            int y1 = matrix1.getSizeY();
+            const T* array1 = matrix1.ptr.get();
+            const T* array2 = matrix2.ptr.get();
+            T* target = result.ptr.get();
+            for (int i1 = 0; i1 < y1; i1++)
+            {
+                for (int i2 = 0; i2 < x2; i2++)
+                {
+                    T sum = 0;
+                    for (int i3 = 0; i3 < x1; i3++)
+                        sum += array1[matrix1.index(i3, i1)] * array2[matrix2.index(i2, i3)];
+
+                    target[result.index(i2, i1)] = sum;
+                }
+            }
+        }
+
+        static int getDotBlockSize(int x1, int x2, int y1)
+        {
+            const char* type = std::is_same<T, float>::value ? "float" : std::is_same<T, double>::value ? "double" : nullptr;
+            if (type == nullptr || (long long) x1 * x2 * y1 < MATRIX_DOT_TUNING_WORK)
+                return y1;
+            MatrixDotBlockSizeFunction function = matrixDotBlockSize.load(std::memory_order_acquire);
+            if (function == nullptr)
+                return y1;
+
+            int blockSize = function(type, x1, x2, y1);
+            return blockSize > 0 && blockSize < y1 ? blockSize : y1;
+        }
+
+        // The storage seen as a two dimensional array: outer index and contiguous inner index
+        int getOuterSize() const {return Layout == COLUMN_MAJOR ? sizeX : sizeY;}
+        int getInnerSize() const {return Layout == COLUMN_MAJOR ? sizeY : sizeX;}
+
+        /**
+        Gives this matrix its own copy of the storage if it is shared.
+        use_count is a relaxed load, a count of 1 left by a copy released on another
+        thread only orders that thread's reads before the writes here after the fence.
+        */
+        void detach()
+        {
+            if (ptr.use_count() > 1)
+            {
+                std::shared_ptr<T[]> newArray = allocateArray(sizeX * sizeY);
+                std::copy(ptr.get(), ptr.get() + sizeX * sizeY, newArray.get());
+                ptr = newArray;
+            }
+            else
+                std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        /**
+        Allocates the storage for count elements. Plain data types come from the
+        matrix allocator (cache line aligned, pooled), everything else from new[].
+        */
+        static std::shared_ptr<T[]> allocateArray(int count)
+        {
+            if constexpr (std::is_trivially_default_constructible<T>::value && std::is_trivially_destructible<T>::value)
+            {
+                size_t bytes = sizeof(T) * (size_t) count;
+                MatrixAllocator* allocator = MatrixAllocator::getAllocator();
+                T* array = (T*) allocator->allocate(bytes);
+                return std::shared_ptr<T[]>(array, [allocator, bytes](T* pointer) { allocator->deallocate(pointer, bytes); });
+            }
+            else
+                return std::shared_ptr<T[]>(new T[count]);
+        }
+
+        static const int TRANSPOSE_BLOCK_SIZE = 32; // 32 * 32 elements of both sides stay in the L1 cache
+
+        /**
+        Copies the transpose of a rows x columns array (rows being the outer index)
+        into the destination, one cache sized block at a time
+        */
+        static void transposeBlocked(const T* source, T* destination, int rows, int columns)
+        {
+            for (int rowBlock = 0; rowBlock < rows; rowBlock += TRANSPOSE_BLOCK_SIZE)
+            {
+                int rowEnd = std::min(rowBlock + TRANSPOSE_BLOCK_SIZE, rows);
+                for (int columnBlock = 0; columnBlock < columns; columnBlock += TRANSPOSE_BLOCK_SIZE)
+                {
+                    int columnEnd = std::min(columnBlock + TRANSPOSE_BLOCK_SIZE, columns);
+                    transposeTile(source, destination, rows, columns, rowBlock, rowEnd, columnBlock, columnEnd);
+                }
+            }
+        }
+
+        static void transposeTile(const T* source, T* destination, int rows, int columns,
+                                  int rowBlock, int rowEnd, int columnBlock, int columnEnd)
+        {
+            int row = rowBlock;
+#ifdef __AVX__
+            // 8x8 tiles of floats are transposed within the registers
+            if constexpr (std::is_same<T, float>::value)
+            {
+                for (; row + 8 <= rowEnd; row += 8)
+                {
+                    int column = columnBlock;
+                    for (; column + 8 <= columnEnd; column += 8)
+                        transpose8x8(source + (size_t) row * columns + column, columns, destination + (size_t) column * rows + row, rows);
+                    for (int r = row; r < row + 8; r++)
+                        for (int c = column; c < columnEnd; c++)
+                            destination[(size_t) c * rows + r] = source[(size_t) r * columns + c];
+                }
+            }
+#endif
+            for (; row < rowEnd; row++)
+                for (int column = columnBlock; column < columnEnd; column++)
+                    destination[(size_t) column * rows + row] = source[(size_t) row * columns + column];
+        }
+
+        /**
+        Swaps the elements across the diagonal, one pair of blocks at a time
+        */
+        static void transposeSquareInPlace(T* array, int size)
+        {
+            for (int rowBlock = 0; rowBlock < size; rowBlock += TRANSPOSE_BLOCK_SIZE)
+            {
+                int rowEnd = std::min(rowBlock + TRANSPOSE_BLOCK_SIZE, size);
+                for (int columnBlock = rowBlock; columnBlock < size; columnBlock += TRANSPOSE_BLOCK_SIZE)
+                {
+                    int columnEnd = std::min(columnBlock + TRANSPOSE_BLOCK_SIZE, size);
+                    for (int row = rowBlock; row < rowEnd; row++)
+                        for (int column = std::max(columnBlock, row + 1); column < columnEnd; column++)
+                            std::swap(array[(size_t) row * size + column], array[(size_t) column * size + row]);
                 }
             }
         }
+
+#ifdef __AVX__
+        static void transpose8x8(const float* source, int sourceStride, float* destination, int destinationStride)
+        {
+            __m256 r0 = _mm256_loadu_ps(source + 0 * (size_t) sourceStride);
+            __m256 r1 = _mm256_loadu_ps(source + 1 * (size_t) sourceStride);
+            __m256 r2 = _mm256_loadu_ps(source + 2 * (size_t) sourceStride);
+            __m256 r3 = _mm256_loadu_ps(source + 3 * (size_t) sourceStride);
+            __m256 r4 = _mm256_loadu_ps(source + 4 * (size_t) sourceStride);
+            __m256 r5 = _mm256_loadu_ps(source + 5 * (size_t) sourceStride);
+            __m256 r6 = _mm256_loadu_ps(source + 6 * (size_t) sourceStride);
+            __m256 r7 = _mm256_loadu_ps(source + 7 * (size_t) sourceStride);
+
+            // Interleave pairs of rows, then pairs of pairs, then swap the 128 bit halves
+            __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+            __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+            __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+            __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+            __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+            __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+            __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+            __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+            __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+            _mm256_storeu_ps(destination + 0 * (size_t) destinationStride, _mm256_permute2f128_ps(s0, s4, 0x20));
+            _mm256_storeu_ps(destination + 1 * (size_t) destinationStride, _mm256_permute2f128_ps(s1, s5, 0x20));
+            _mm256_storeu_ps(destination + 2 * (size_t) destinationStride, _mm256_permute2f128_ps(s2, s6, 0x20));
+            _mm256_storeu_ps(destination + 3 * (size_t) destinationStride, _mm256_permute2f128_ps(s3, s7, 0x20));
+            _mm256_storeu_ps(destination + 4 * (size_t) destinationStride, _mm256_permute2f128_ps(s0, s4, 0x31));
+            _mm256_storeu_ps(destination + 5 * (size_t) destinationStride, _mm256_permute2f128_ps(s1, s5, 0x31));
+            _mm256_storeu_ps(destination + 6 * (size_t) destinationStride, _mm256_permute2f128_ps(s2, s6, 0x31));
+            _mm256_storeu_ps(destination + 7 * (size_t) destinationStride, _mm256_permute2f128_ps(s3, s7, 0x31));
+        }
+#endif
 };
 
 #endif // MATRIX_H_INCLUDED
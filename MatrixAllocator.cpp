@@ -0,0 +1,318 @@
+#include "MatrixAllocator.h"
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <algorithm>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static const int MINIMUM_CLASS_SHIFT = 6; // 64 bytes
+static const int NUMBER_OF_CLASSES = 21; // Up to 64MB, larger buffers are not pooled
+
+// Only the system allocations are counted globally, the pool counters are per thread
+static std::atomic<long long> residentBytes(0);
+
+static std::atomic<bool> hugePagesEnabled(false);
+static std::atomic<size_t> maximumCachedBytes(256 * 1024 * 1024);
+
+static PooledMatrixAllocator defaultAllocator;
+static std::atomic<MatrixAllocator*> currentAllocator(&defaultAllocator);
+
+// Counters only ever written by their own thread, relaxed so getStats can read them from any thread
+static void increase(std::atomic<long long>& counter, long long value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+// --------------------------------------- System memory ---------------------------------------
+static size_t getSystemAlignment(size_t bytes)
+{
+    if (hugePagesEnabled && bytes >= PooledMatrixAllocator::HUGE_PAGE_SIZE)
+        return PooledMatrixAllocator::HUGE_PAGE_SIZE;
+    return MatrixAllocator::ALIGNMENT;
+}
+
+/**
+    Sizes of a huge page and more are rounded to whole huge pages whether they are
+    enabled or not, so the size freed never depends on setHugePages calls made
+    since the allocation and residentBytes stays exact. Pooled classes are such
+    multiples already, only unpooled buffers can grow and their tail is never touched.
+*/
+static size_t getSystemSize(size_t bytes)
+{
+    size_t multiple = bytes >= PooledMatrixAllocator::HUGE_PAGE_SIZE ? PooledMatrixAllocator::HUGE_PAGE_SIZE : MatrixAllocator::ALIGNMENT;
+    return (bytes + multiple - 1) / multiple * multiple; // aligned_alloc needs a multiple of the alignment
+}
+
+static void* systemAllocate(size_t bytes)
+{
+    size_t alignment = getSystemAlignment(bytes);
+    bytes = getSystemSize(bytes);
+    void* pointer = aligned_alloc(alignment, bytes);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+
+#ifdef __linux__
+    if (alignment == PooledMatrixAllocator::HUGE_PAGE_SIZE)
+        madvise(pointer, bytes, MADV_HUGEPAGE);
+#endif
+
+    residentBytes += bytes;
+    return pointer;
+}
+
+static void systemDeallocate(void* pointer, size_t bytes)
+{
+    residentBytes -= getSystemSize(bytes);
+    free(pointer);
+}
+
+/**
+    Rounds the size up to its size class, returns -1 for sizes which are not pooled
+*/
+static int getSizeClass(size_t bytes, size_t& classBytes)
+{
+    int sizeClass = 0;
+    classBytes = (size_t) 1 << MINIMUM_CLASS_SHIFT;
+    while (classBytes < bytes)
+    {
+        classBytes <<= 1;
+        sizeClass++;
+    }
+
+    if (sizeClass >= NUMBER_OF_CLASSES)
+    {
+        classBytes = bytes;
+        return -1;
+    }
+    return sizeClass;
+}
+
+
+// --------------------------------------- Shared lists ---------------------------------------
+/**
+    Buffers freed by a thread with a full cache, taken by threads whose own list
+    is empty. A consumer freeing what a producer allocated hands the buffers back
+    this way. Never destroyed, threads may still exit after the static objects.
+*/
+struct SharedLists
+{
+    std::mutex mutexes[NUMBER_OF_CLASSES];
+    std::vector<void*> freeLists[NUMBER_OF_CLASSES];
+    std::atomic<int> counts[NUMBER_OF_CLASSES] = {}; // Checked without the lock on a miss
+    std::atomic<size_t> bytes{0};
+
+    bool push(int sizeClass, void* pointer, size_t classBytes)
+    {
+        // The limit is on all cached memory the threads do not hold themselves
+        size_t cached = bytes.load(std::memory_order_relaxed);
+        do
+        {
+            if (cached + classBytes > maximumCachedBytes)
+                return false;
+        } while (!bytes.compare_exchange_weak(cached, cached + classBytes, std::memory_order_relaxed));
+
+        std::lock_guard<std::mutex> lock(mutexes[sizeClass]);
+        freeLists[sizeClass].push_back(pointer);
+        counts[sizeClass]++;
+        return true;
+    }
+
+    void* pop(int sizeClass, size_t classBytes)
+    {
+        if (counts[sizeClass].load(std::memory_order_relaxed) == 0)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(mutexes[sizeClass]);
+        if (freeLists[sizeClass].empty())
+            return nullptr;
+        void* pointer = freeLists[sizeClass].back();
+        freeLists[sizeClass].pop_back();
+        counts[sizeClass]--;
+        bytes -= classBytes;
+        return pointer;
+    }
+};
+
+static SharedLists& getSharedLists()
+{
+    static SharedLists* lists = new SharedLists();
+    return *lists;
+}
+
+
+// --------------------------------------- Thread cache ---------------------------------------
+struct ThreadCache;
+
+/**
+    Every live thread cache and the counters of the threads which have exited, for
+    getStats. Created on first use and never destroyed, like the shared lists.
+*/
+struct ThreadRegistry
+{
+    std::mutex mutex;
+    std::vector<ThreadCache*> threadCaches;
+    MatrixAllocatorStats exitedThreads = {};
+};
+
+static ThreadRegistry& getThreadRegistry()
+{
+    static ThreadRegistry* registry = new ThreadRegistry();
+    return *registry;
+}
+
+struct ThreadCache
+{
+    std::vector<void*> freeLists[NUMBER_OF_CLASSES];
+    std::atomic<long long> bytes{0};
+    std::atomic<long long> allocations{0}, poolHits{0}, poolMisses{0};
+
+    ThreadCache()
+    {
+        ThreadRegistry& registry = getThreadRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threadCaches.push_back(this);
+    }
+
+    // Returns the free lists to the shared lists, or to the system if those are full too
+    void release(bool toSystem)
+    {
+        for (int i = 0; i < NUMBER_OF_CLASSES; i++)
+        {
+            size_t classBytes = (size_t) 1 << (i + MINIMUM_CLASS_SHIFT);
+            for (int j = 0; j < (int) freeLists[i].size(); j++)
+            {
+                if (toSystem || !getSharedLists().push(i, freeLists[i][j], classBytes))
+                    systemDeallocate(freeLists[i][j], classBytes);
+            }
+            freeLists[i].clear();
+        }
+        bytes = 0;
+    }
+
+    ~ThreadCache();
+};
+
+// Matrices destroyed after the cache of their thread (static ones) skip the thread cache
+static thread_local bool threadCacheDestroyed = false;
+static thread_local ThreadCache threadCache;
+
+ThreadCache::~ThreadCache()
+{
+    release(false);
+    threadCacheDestroyed = true;
+
+    ThreadRegistry& registry = getThreadRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.exitedThreads.allocations += allocations;
+    registry.exitedThreads.poolHits += poolHits;
+    registry.exitedThreads.poolMisses += poolMisses;
+    registry.threadCaches.erase(std::find(registry.threadCaches.begin(), registry.threadCaches.end(), this));
+}
+
+
+// --------------------------------------- Matrix allocator ---------------------------------------
+MatrixAllocator* MatrixAllocator::getAllocator()
+{
+    return currentAllocator;
+}
+
+void MatrixAllocator::setAllocator(MatrixAllocator* allocator)
+{
+    currentAllocator = allocator != nullptr ? allocator : &defaultAllocator;
+}
+
+void* PooledMatrixAllocator::allocate(size_t bytes)
+{
+    size_t classBytes;
+    int sizeClass = getSizeClass(bytes, classBytes);
+    if (threadCacheDestroyed)
+        return systemAllocate(classBytes);
+
+    increase(threadCache.allocations, 1);
+    if (sizeClass >= 0)
+    {
+        /// 1) The list of this thread
+        std::vector<void*>& freeList = threadCache.freeLists[sizeClass];
+        if (!freeList.empty())
+        {
+            void* pointer = freeList.back();
+            freeList.pop_back();
+            increase(threadCache.bytes, -(long long) classBytes);
+            increase(threadCache.poolHits, 1);
+            return pointer;
+        }
+
+        /// 2) Buffers other threads freed
+        void* pointer = getSharedLists().pop(sizeClass, classBytes);
+        if (pointer != nullptr)
+        {
+            increase(threadCache.poolHits, 1);
+            return pointer;
+        }
+    }
+
+    increase(threadCache.poolMisses, 1);
+    return systemAllocate(classBytes);
+}
+
+void PooledMatrixAllocator::deallocate(void* pointer, size_t bytes)
+{
+    if (pointer == nullptr)
+        return;
+
+    size_t classBytes;
+    int sizeClass = getSizeClass(bytes, classBytes);
+    if (sizeClass < 0 || threadCacheDestroyed)
+    {
+        systemDeallocate(pointer, classBytes);
+        return;
+    }
+
+    if (threadCache.bytes.load(std::memory_order_relaxed) + classBytes <= PooledMatrixAllocator::THREAD_CACHE_BYTES)
+    {
+        threadCache.freeLists[sizeClass].push_back(pointer);
+        increase(threadCache.bytes, classBytes);
+    }
+    else if (!getSharedLists().push(sizeClass, pointer, classBytes))
+        systemDeallocate(pointer, classBytes);
+}
+
+MatrixAllocatorStats PooledMatrixAllocator::getStats()
+{
+    ThreadRegistry& registry = getThreadRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    MatrixAllocatorStats stats = registry.exitedThreads;
+    stats.cachedBytes = getSharedLists().bytes;
+    for (int i = 0; i < (int) registry.threadCaches.size(); i++)
+    {
+        const ThreadCache* cache = registry.threadCaches[i];
+        stats.allocations += cache->allocations.load(std::memory_order_relaxed);
+        stats.poolHits += cache->poolHits.load(std::memory_order_relaxed);
+        stats.poolMisses += cache->poolMisses.load(std::memory_order_relaxed);
+        stats.cachedBytes += cache->bytes.load(std::memory_order_relaxed);
+    }
+    stats.residentBytes = residentBytes;
+    return stats;
+}
+
+void PooledMatrixAllocator::releaseThreadCache()
+{
+    if (!threadCacheDestroyed)
+        threadCache.release(true);
+}
+
+void PooledMatrixAllocator::setHugePages(bool enabled)
+{
+    hugePagesEnabled = enabled;
+}
+
+void PooledMatrixAllocator::setMaximumCachedBytes(size_t bytes)
+{
+    maximumCachedBytes = bytes;
+}
@@ -0,0 +1,59 @@
+#ifndef MATRIXALLOCATOR_H
+#define MATRIXALLOCATOR_H
+
+#include <stddef.h>
+
+struct MatrixAllocatorStats
+{
+    long long allocations; // Number of buffers handed out
+    long long poolHits; // Allocations served from a free list
+    long long poolMisses; // Allocations which had to go to the system
+    long long residentBytes; // Bytes held from the system, in use or cached
+    long long cachedBytes; // Bytes sitting in the free lists
+
+    float getHitRate() const { return allocations > 0 ? poolHits / (float) allocations : 0; }
+};
+
+/**
+    Allocator for the storage of Matrix.
+    Every buffer must be aligned to at least ALIGNMENT bytes. The allocator which
+    handed out a buffer is the one it is returned to, so it can be replaced at any time.
+*/
+class MatrixAllocator
+{
+    public:
+        virtual ~MatrixAllocator() {}
+
+        virtual void* allocate(size_t bytes) = 0;
+        virtual void deallocate(void* pointer, size_t bytes) = 0;
+
+        static MatrixAllocator* getAllocator(); // The allocator used by every new Matrix buffer
+        static void setAllocator(MatrixAllocator* allocator); // nullptr restores the pooled allocator
+
+        static const size_t ALIGNMENT = 64; // One cache line, enough for aligned AVX-512 loads
+};
+
+/**
+    The default allocator: cache line aligned buffers recycled through thread local
+    free lists of power of two size classes, so the allocation of a Matrix rarely
+    reaches malloc and does not contend with other threads. A thread keeps up to
+    THREAD_CACHE_BYTES itself and frees the rest into lists shared by all threads,
+    where a thread with an empty list finds the buffers its consumers freed.
+*/
+class PooledMatrixAllocator : public MatrixAllocator
+{
+    public:
+        void* allocate(size_t bytes) override;
+        void deallocate(void* pointer, size_t bytes) override;
+
+        static MatrixAllocatorStats getStats();
+        static void releaseThreadCache(); // Returns the free lists of the calling thread to the system
+
+        static void setHugePages(bool enabled); // Align buffers of 2MB and more to 2MB and ask for huge pages
+        static void setMaximumCachedBytes(size_t bytes); // Limit of the shared lists, on top of the thread caches
+
+        static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+        static const size_t THREAD_CACHE_BYTES = 2 * 1024 * 1024; // Free lists a thread keeps to itself
+};
+
+#endif // MATRIXALLOCATOR_H
@@ -0,0 +1,203 @@
+#include "ModelExporter.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+
+static const int FLOATS_PER_CACHE_LINE = 16;
+
+static int getPaddedSize(int size)
+{
+    return (size + FLOATS_PER_CACHE_LINE - 1) / FLOATS_PER_CACHE_LINE * FLOATS_PER_CACHE_LINE;
+}
+
+ModelExporter::ModelExporter()
+{
+
+}
+
+ModelExporter::~ModelExporter()
+{
+
+}
+
+bool ModelExporter::exportHeader(NeuralNetwork& network, const std::string& fileName, const std::string& name)
+{
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(network))
+    {
+        std::cout << "Model exporter: Only fully connected networks can be exported!" << std::endl;
+        return false;
+    }
+    return exportHeader(snapshot, fileName, name);
+}
+
+bool ModelExporter::exportHeader(const NetworkSnapshot& snapshot, const std::string& fileName, const std::string& name)
+{
+    std::string source = generate(snapshot, name);
+    if (source.empty())
+        return false;
+
+    std::ofstream file(fileName, std::ios::trunc);
+    file << source;
+    if (!file.flush())
+    {
+        std::cout << "Model exporter: Could not write " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string ModelExporter::generate(const NetworkSnapshot& snapshot, const std::string& name)
+{
+    if (snapshot.isEmpty())
+    {
+        std::cout << "Model exporter: The snapshot is empty!" << std::endl;
+        return "";
+    }
+    bool validName = !name.empty() && !isdigit((unsigned char) name[0]);
+    for (int i = 0; i < (int) name.size(); i++)
+        validName = validName && (isalnum((unsigned char) name[i]) || name[i] == '_');
+    if (!validName)
+    {
+        std::cout << "Model exporter: " << name << " is not a valid C++ identifier!" << std::endl;
+        return "";
+    }
+    for (int i = 0; i < (int) snapshot.weights.size(); i++)
+    {
+        if (!isfinite(snapshot.weights[i]))
+        {
+            std::cout << "Model exporter: The network has weights which are not finite!" << std::endl;
+            return "";
+        }
+    }
+
+    std::string guard = name;
+    for (int i = 0; i < (int) guard.size(); i++)
+        guard[i] = toupper((unsigned char) guard[i]);
+    guard += "_H";
+
+    std::ostringstream source;
+    source << "// Generated by ModelExporter, " << snapshot.getNumberOfLayers() << " layers, " << snapshot.getParameterCount() << " parameters\n";
+    source << "#ifndef " << guard << "\n#define " << guard << "\n\n#include <math.h>\n\n";
+    source << "namespace " << name << "\n{\n";
+    source << "    constexpr int inputSize = " << snapshot.getInputSize() << ";\n";
+    source << "    constexpr int outputSize = " << snapshot.getOutputSize() << ";\n";
+
+    /// 1) The weights, (inputs, padded neurons) and the biases per layer
+    const float* weight = snapshot.weights.data();
+    for (int layer = 1; layer < (int) snapshot.layerSizes.size(); layer++)
+    {
+        int inputSize = snapshot.layerSizes[layer - 1];
+        int size = snapshot.layerSizes[layer];
+        int paddedSize = getPaddedSize(size);
+
+        source << "\n    alignas(64) constexpr float layer" << layer << "Biases[" << paddedSize << "] =\n    {";
+        for (int n = 0; n < paddedSize; n++)
+            source << (n % 8 == 0 ? "\n        " : " ") << getLiteral(n < size ? weight[n * (inputSize + 1)] : 0) << ",";
+        source << "\n    };\n";
+
+        source << "    alignas(64) constexpr float layer" << layer << "Weights[" << inputSize << "][" << paddedSize << "] =\n    {";
+        for (int k = 0; k < inputSize; k++)
+        {
+            source << "\n        {";
+            for (int n = 0; n < paddedSize; n++)
+                source << (n % 8 == 0 ? "\n            " : " ") << getLiteral(n < size ? weight[n * (inputSize + 1) + k + 1] : 0) << ",";
+            source << "\n        },";
+        }
+        source << "\n    };\n";
+        weight += size * (inputSize + 1);
+    }
+
+    /// 2) predict, one block per layer
+    source << "\n    // input holds inputSize features, output receives outputSize values\n";
+    source << "    inline void predict(const float* input, float* output)\n    {\n";
+    for (int layer = 1; layer < (int) snapshot.layerSizes.size(); layer++)
+    {
+        int inputSize = snapshot.layerSizes[layer - 1];
+        int paddedSize = getPaddedSize(snapshot.layerSizes[layer]);
+        std::string current = "layer" + std::to_string(layer);
+        std::string previous = layer == 1 ? "input" : "layer" + std::to_string(layer - 1);
+        EActivationFunction function = snapshot.activationFunctions[layer - 1];
+
+        source << (layer > 1 ? "\n" : "") << "        // Layer " << layer << ", " << snapshot.layerSizes[layer] << " neurons\n";
+        source << "        alignas(64) float " << current << "[" << paddedSize << "];\n";
+        source << "        for (int n = 0; n < " << paddedSize << "; n++)\n";
+        source << "            " << current << "[n] = " << current << "Biases[n];\n";
+        source << "        for (int k = 0; k < " << inputSize << "; k++)\n        {\n";
+        source << "            const float x = " << previous << "[k];\n";
+        source << "            for (int n = 0; n < " << paddedSize << "; n++)\n";
+        source << "                " << current << "[n] += x * " << current << "Weights[k][n];\n";
+        source << "        }\n";
+        if (function != LINEAR && function != NOT_SPECIFIED)
+        {
+            source << "        for (int n = 0; n < " << paddedSize << "; n++)\n        {\n";
+            source << "            const float x = " << current << "[n];\n";
+            source << "            " << current << "[n] = " << getActivationExpression(function, "x") << ";\n";
+            source << "        }\n";
+        }
+    }
+    source << "\n        for (int n = 0; n < outputSize; n++)\n";
+    source << "            output[n] = layer" << snapshot.getNumberOfLayers() << "[n];\n";
+    source << "    }\n}\n\n#endif // " << guard << "\n";
+    return source.str();
+}
+
+/**
+    The activation functions of ActivationFunction.h as C expressions in float
+*/
+std::string ModelExporter::getActivationExpression(EActivationFunction function, const std::string& x)
+{
+    switch (function)
+    {
+        case HEAVISIDE:
+            return x + " > 0 ? 1.0f : (" + x + " == 0 ? 0.5f : 0.0f)";
+
+        case LOGISTIC:
+            return "1.0f / (1.0f + expf(-" + x + "))";
+
+        case SOFTMAX:
+            return "0.0f";
+
+        case TANH:
+            return "tanhf(" + x + ")";
+
+        case TANH01:
+            return "tanhf(" + x + ") / 2.0f + 0.5f";
+
+        case RECTIFIED_LINEAR_UNIT:
+            return x + " < 0 ? 0.0f : " + x;
+
+        case ARCTAN:
+            return "atanf(" + x + ")";
+
+        case ARCTAN01:
+            return "atanf(" + x + ") / 3.14159265358979f + 0.5f";
+
+        case SYMMETRICAL_HARD_LIMIT:
+            return x + " > 0 ? 1.0f : (" + x + " == 0 ? 0.0f : -1.0f)";
+
+        case SINUSOID:
+            return "sinf(" + x + ")";
+
+        case SINUSOID01:
+            return "sinf(" + x + ") / 2.0f + 0.5f";
+
+        case GAUSSIAN:
+            return "expf(-" + x + " * " + x + ")";
+
+        default:
+            return x; // Linear
+    }
+}
+
+// Nine significant digits, a float survives the round trip through the source exactly
+std::string ModelExporter::getLiteral(float value)
+{
+    char literal[32];
+    snprintf(literal, sizeof(literal), "%.8ef", value);
+    return literal;
+}
@@ -0,0 +1,45 @@
+#ifndef MODELEXPORTER_H
+#define MODELEXPORTER_H
+
+#include <string>
+#include "NetworkSnapshot.h"
+
+class NeuralNetwork;
+
+/**
+    Writes a trained network out as a self contained C++ header for deployments
+    without any model loading at run time.
+
+    The generated header depends on <math.h> only. It holds the weights of every
+    layer as alignas(64) constexpr arrays and one predict function with a block of
+    code per layer, all sizes compile time constants, so the compiler can propagate,
+    unroll and vectorize the whole model:
+
+        #include "xorNetwork.h"
+        float output[xorNetwork::outputSize];
+        xorNetwork::predict(input, output);
+
+    The weights are stored transposed, (inputs, neurons) with every row padded to
+    a whole cache line of zeros, so a layer is a sequence of aligned multiply-adds
+    over its neurons rather than a dot product per neuron (which compilers only
+    vectorize with -ffast-math). The results match NetworkSnapshot::predict up to
+    float rounding. Only fully connected networks are supported (see NetworkSnapshot).
+*/
+class ModelExporter
+{
+    public:
+        ModelExporter();
+        ~ModelExporter();
+
+        // Writes the header, name is the namespace of the generated code
+        bool exportHeader(NeuralNetwork& network, const std::string& fileName, const std::string& name);
+        bool exportHeader(const NetworkSnapshot& snapshot, const std::string& fileName, const std::string& name);
+
+        std::string generate(const NetworkSnapshot& snapshot, const std::string& name); // Source of the header, empty on failure
+
+    private:
+        std::string getActivationExpression(EActivationFunction function, const std::string& x);
+        std::string getLiteral(float value);
+};
+
+#endif // MODELEXPORTER_H
@@ -0,0 +1,289 @@
+#include "NetworkSnapshot.h"
+#include "NeuralNetwork.h"
+#include "ActivationFunction.h"
+#include "OutputRanking.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string.h>
+#include <math.h>
+
+NetworkSnapshot::NetworkSnapshot()
+{
+
+}
+
+NetworkSnapshot::~NetworkSnapshot()
+{
+
+}
+
+bool NetworkSnapshot::capture(NeuralNetwork& network)
+{
+    // Snapshots hold fully connected layers only, the caller reports it
+    for (int i = 1; i < network.layers.size(); i++)
+    {
+        if (network.layers[i].layerType != FULLY_CONNECTED)
+        {
+            layerSizes.clear();
+            activationFunctions.clear();
+            weights.clear();
+            return false;
+        }
+    }
+
+    // Record the topology
+    layerSizes.resize(network.layers.size());
+    activationFunctions.resize(network.layers.size() - 1);
+    layerSizes[0] = network.layers[0].size();
+    for (int i = 1; i < network.layers.size(); i++)
+    {
+        layerSizes[i] = network.layers[i].size();
+        activationFunctions[i - 1] = network.layers[i].neurons[0].activationFunctionEnum;
+    }
+
+    if (!matches(network))
+    {
+        std::cout << "Network snapshot: Every neuron must be connected to all neurons of the previous layer!" << std::endl;
+        layerSizes.clear();
+        activationFunctions.clear();
+        weights.clear();
+        return false;
+    }
+
+    // Copy the weights (the vector keeps its capacity so repeated captures do not allocate)
+    weights.resize(getParameterCount());
+    float* target = weights.data();
+    for (int i = 1; i < network.layers.size(); i++)
+    {
+        for (int j = 0; j < network.layers[i].size(); j++)
+        {
+            Matrix<float>& weightMatrix = network.layers[i].neurons[j].weightMatrix;
+            memcpy(target, weightMatrix.getArrayRef(), sizeof(float) * weightMatrix.getSize());
+            target += weightMatrix.getSize();
+        }
+    }
+    return true;
+}
+
+bool NetworkSnapshot::restore(NeuralNetwork& network)
+{
+    if (!matches(network))
+    {
+        std::cout << "Network snapshot: The snapshot cannot be restored into a network of a different topology!" << std::endl;
+        return false;
+    }
+
+    const float* source = weights.data();
+    for (int i = 1; i < network.layers.size(); i++)
+    {
+        for (int j = 0; j < network.layers[i].size(); j++)
+        {
+            Matrix<float>& weightMatrix = network.layers[i].neurons[j].weightMatrix;
+            memcpy(weightMatrix.getArrayRef(), source, sizeof(float) * weightMatrix.getSize());
+            network.layers[i].neurons[j].activationFunctionEnum = activationFunctions[i - 1];
+            source += weightMatrix.getSize();
+        }
+    }
+    return true;
+}
+
+bool NetworkSnapshot::matches(NeuralNetwork& network)
+{
+    if (network.layers.size() != (int) layerSizes.size())
+        return false;
+
+    for (int i = 0; i < network.layers.size(); i++)
+    {
+        if (network.layers[i].size() != layerSizes[i] || network.layers[i].layerType != FULLY_CONNECTED)
+            return false;
+
+        // Every neuron must be connected to all the neurons of the previous layer
+        for (int j = 0; i > 0 && j < network.layers[i].size(); j++)
+            if (network.layers[i].neurons[j].weightMatrix.getSize() != layerSizes[i - 1] + 1)
+                return false;
+    }
+    return true;
+}
+
+void NetworkSnapshot::predict(const Matrix<float>& dataSample, Matrix<float>& output) const
+{
+    if (dataSample.getSizeX() != getInputSize())
+    {
+        std::cout << "Network snapshot: Incorrect number of feature dimension entered for data sample. Got "
+            << dataSample.getSizeX() << ". Expected " << getInputSize() << std::endl;
+        return;
+    }
+
+    // Layer outputs, swapped after every layer
+    std::vector<float> current(dataSample.getSizeX());
+    std::vector<float> next;
+    for (int i = 0; i < dataSample.getSizeX(); i++)
+        current[i] = dataSample[i][0];
+
+    const float* weight = weights.data();
+    for (int layer = 1; layer < (int) layerSizes.size(); layer++)
+    {
+        int inputSize = layerSizes[layer - 1];
+        next.resize(layerSizes[layer]);
+        for (int neuron = 0; neuron < layerSizes[layer]; neuron++)
+        {
+            // Bias first, then the weighted inputs
+            float sum = weight[0];
+            for (int k = 0; k < inputSize; k++)
+                sum += weight[k + 1] * current[k];
+            next[neuron] = activate(activationFunctions[layer - 1], sum);
+            weight += inputSize + 1;
+        }
+        current.swap(next);
+    }
+
+    output.setSize(getOutputSize(), 1);
+    for (int i = 0; i < getOutputSize(); i++)
+        output[i][0] = current[i];
+}
+
+/**
+    Forward propagation of a whole batch. The outputs of a layer are kept
+    (neurons, batch) so the inner loop runs over the contiguous samples.
+*/
+void NetworkSnapshot::predictBatch(const Matrix<float>& dataSamples, Matrix<float>& outputs) const
+{
+    if (dataSamples.getSizeX() != getInputSize())
+    {
+        std::cout << "Network snapshot: Incorrect number of feature dimension entered for data samples. Got "
+            << dataSamples.getSizeX() << ". Expected " << getInputSize() << std::endl;
+        return;
+    }
+
+    int batchSize = dataSamples.getSizeY();
+    std::vector<float> current(dataSamples.getArrayRef(), dataSamples.getArrayRef() + dataSamples.getSize());
+    std::vector<float> next;
+
+    const float* weight = weights.data();
+    for (int layer = 1; layer < (int) layerSizes.size(); layer++)
+    {
+        int inputSize = layerSizes[layer - 1];
+        next.resize((size_t) layerSizes[layer] * batchSize);
+        NeuralNetworkLayer::forwardBatch(weight, inputSize, layerSizes[layer], activationFunctions[layer - 1],
+                                         current.data(), batchSize, next.data(), next.data());
+        weight += (size_t) layerSizes[layer] * (inputSize + 1);
+        current.swap(next);
+    }
+
+    if (outputs.getSizeX() != getOutputSize() || outputs.getSizeY() != batchSize)
+        outputs.setSize(getOutputSize(), batchSize);
+    std::copy(current.begin(), current.end(), outputs.getArrayRef());
+}
+
+/**
+    Splits the samples into one contiguous range per thread, every thread
+    predicts its range batch by batch and counts into a result of its own
+*/
+EvaluationResult NetworkSnapshot::evaluate(const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize, int numberOfThreads) const
+{
+    EvaluationResult result;
+    int outputSize = getOutputSize();
+    result.reset(outputSize == 1 ? 2 : outputSize, outputSize);
+    if (dataSamples.getSizeX() != getInputSize() || targets.getSizeX() != outputSize || targets.getSizeY() != dataSamples.getSizeY())
+    {
+        std::cout << "Network snapshot: The samples or the targets do not match the network!" << std::endl;
+        return result;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    int numberOfSamples = dataSamples.getSizeY();
+    int threads = numberOfThreads < 1 ? 1 : numberOfThreads;
+    int groupSize = (numberOfSamples + threads - 1) / threads;
+    if (batchSize < 1)
+        batchSize = 1;
+
+    std::vector<EvaluationResult> partialResults(threads, result);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads && i * groupSize < numberOfSamples; i++)
+    {
+        int last = (i + 1) * groupSize < numberOfSamples ? (i + 1) * groupSize : numberOfSamples;
+        workers.push_back(std::thread(&NetworkSnapshot::evaluateRange, this, std::cref(dataSamples), std::cref(targets),
+                                      i * groupSize, last, batchSize, std::ref(partialResults[i])));
+    }
+
+    // The first range is evaluated on the calling thread
+    evaluateRange(dataSamples, targets, 0, groupSize < numberOfSamples ? groupSize : numberOfSamples, batchSize, partialResults[0]);
+    for (int i = 0; i < (int) workers.size(); i++)
+        workers[i].join();
+
+    for (int i = 0; i < threads; i++)
+        result.merge(partialResults[i]);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.finish();
+    return result;
+}
+
+void NetworkSnapshot::evaluateRange(const Matrix<float>& dataSamples, const Matrix<float>& targets, int firstSample, int lastSample,
+                                    int batchSize, EvaluationResult& result) const
+{
+    Matrix<float> outputs;
+    std::vector<int> predictedClasses;
+    std::vector<float> maxResponses;
+    int outputSize = getOutputSize();
+    int numberOfSamples = targets.getSizeY();
+    const float* targetArray = targets.getArrayRef();
+    for (int start = firstSample; start < lastSample; start += batchSize)
+    {
+        int end = start + batchSize < lastSample ? start + batchSize : lastSample;
+        predictBatch(dataSamples.subMatrix(0, getInputSize() - 1, start, end - 1), outputs);
+        OutputRanking::argMax(outputs, predictedClasses, maxResponses);
+        const float* outputArray = outputs.getArrayRef();
+        int size = end - start;
+
+        for (int s = 0; s < size; s++)
+        {
+            int predictedClass = predictedClasses[s], actualClass = 0;
+            for (int j = 0; j < outputSize; j++)
+            {
+                float output = outputArray[j * size + s];
+                float target = targetArray[(size_t) j * numberOfSamples + start + s];
+                result.squaredError += (target - output) * (target - output);
+                if (target > targetArray[(size_t) actualClass * numberOfSamples + start + s]) actualClass = j;
+            }
+
+            // A single output is a binary classification, right only if the response rounds to the target
+            if (outputSize == 1)
+            {
+                float target = targetArray[start + s];
+                actualClass = target >= 0.5f;
+                predictedClass = round(outputArray[s]) == target ? actualClass : 1 - actualClass;
+            }
+            result.confusionMatrix[actualClass * result.numberOfClasses + predictedClass]++;
+        }
+        result.numberOfSamples += size;
+    }
+}
+
+bool NetworkSnapshot::isEmpty() const
+{
+    return layerSizes.size() < 2;
+}
+
+int NetworkSnapshot::getInputSize() const
+{
+    return isEmpty() ? 0 : layerSizes[0];
+}
+
+int NetworkSnapshot::getOutputSize() const
+{
+    return isEmpty() ? 0 : layerSizes.back();
+}
+
+int NetworkSnapshot::getNumberOfLayers() const
+{
+    return isEmpty() ? 0 : layerSizes.size() - 1;
+}
+
+int NetworkSnapshot::getParameterCount() const
+{
+    int count = 0;
+    for (int i = 1; i < (int) layerSizes.size(); i++)
+        count += layerSizes[i] * (layerSizes[i - 1] + 1);
+    return count;
+}
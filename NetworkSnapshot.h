@@ -0,0 +1,54 @@
+#ifndef NETWORKSNAPSHOT_H
+#define NETWORKSNAPSHOT_H
+
+#include <vector>
+#include "Matrix.h"
+#include "EActivationFunction.h"
+#include "Evaluation.h"
+
+class NeuralNetwork;
+
+/**
+    A copy of the weights of a neural network which can be evaluated on its own.
+
+    All weights are kept in one flat vector (layer by layer, neuron by neuron,
+    bias first) so taking a snapshot is a handful of memcpys and does not
+    disturb the network it came from. The input layer is not stored since it
+    only passes the data sample through.
+
+    Snapshots hold fully connected layers only. A network with convolution or
+    pooling layers is not captured, capture returns false and leaves the
+    snapshot empty without reporting it, so callers decide how to say so once.
+*/
+class NetworkSnapshot
+{
+    public:
+        NetworkSnapshot();
+        ~NetworkSnapshot();
+
+        bool capture(NeuralNetwork& network); // Copies the weights out of the network, false if it cannot be held
+        bool restore(NeuralNetwork& network); // Copies the weights back into a network of the same topology
+        bool matches(NeuralNetwork& network); // Checks if the network has the same topology
+
+        void predict(const Matrix<float>& dataSample, Matrix<float>& output) const; // Forward propagation on the snapshot
+        void predictBatch(const Matrix<float>& dataSamples, Matrix<float>& outputs) const; // (inputSize, batch) to (outputSize, batch)
+
+        // Metrics over the samples (inputSize, numberOfSamples) and their targets (outputSize, numberOfSamples)
+        EvaluationResult evaluate(const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize = 256, int numberOfThreads = 1) const;
+
+        bool isEmpty() const;
+        int getInputSize() const;
+        int getOutputSize() const;
+        int getNumberOfLayers() const; // Excluding the input layer
+        int getParameterCount() const;
+
+        std::vector<int> layerSizes; // Number of neurons per layer, index 0 is the input size
+        std::vector<EActivationFunction> activationFunctions; // Per layer, excluding the input layer
+        std::vector<float> weights; // Every weight of the network, see above
+
+    private:
+        void evaluateRange(const Matrix<float>& dataSamples, const Matrix<float>& targets, int firstSample, int lastSample,
+                           int batchSize, EvaluationResult& result) const;
+};
+
+#endif // NETWORKSNAPSHOT_H
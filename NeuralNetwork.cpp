@@ -1,20 +1,95 @@
 #include "NeuralNetwork.h"
+#include "TrainingMonitor.h"
+#include "Checkpointer.h"
+#include "NetworkSnapshot.h"
+#include "Random.h"
+#include "ActivationFunction.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <math.h>
 
 
+// --------------------------------------- Image helpers ---------------------------------------
+/**
+    im2col: column p of the result holds the input patch seen by output position p,
+    row k is (channel * kernelSize + ky) * kernelSize + kx. Positions outside of the
+    input (padding) are 0.
+*/
+static void imageToColumns(const float* image, int width, int height, int channels, int kernelSize, int stride, int padding,
+                           int outputWidth, int outputHeight, float* columns)
+{
+    int positions = outputWidth * outputHeight;
+    for (int c = 0; c < channels; c++)
+    {
+        for (int ky = 0; ky < kernelSize; ky++)
+        {
+            for (int kx = 0; kx < kernelSize; kx++)
+            {
+                float* row = columns + (size_t) ((c * kernelSize + ky) * kernelSize + kx) * positions;
+                for (int oy = 0; oy < outputHeight; oy++)
+                {
+                    int y = oy * stride - padding + ky;
+                    for (int ox = 0; ox < outputWidth; ox++)
+                    {
+                        int x = ox * stride - padding + kx;
+                        bool inside = y >= 0 && y < height && x >= 0 && x < width;
+                        row[oy * outputWidth + ox] = inside ? image[((size_t) c * height + y) * width + x] : 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+    col2im: the reverse of the above, overlapping patches are summed
+*/
+static void columnsToImage(const float* columns, int width, int height, int channels, int kernelSize, int stride, int padding,
+                           int outputWidth, int outputHeight, float* image)
+{
+    int positions = outputWidth * outputHeight;
+    std::fill(image, image + (size_t) channels * height * width, 0.0f);
+    for (int c = 0; c < channels; c++)
+    {
+        for (int ky = 0; ky < kernelSize; ky++)
+        {
+            for (int kx = 0; kx < kernelSize; kx++)
+            {
+                const float* row = columns + (size_t) ((c * kernelSize + ky) * kernelSize + kx) * positions;
+                for (int oy = 0; oy < outputHeight; oy++)
+                {
+                    int y = oy * stride - padding + ky;
+                    if (y < 0 || y >= height)
+                        continue;
+                    for (int ox = 0; ox < outputWidth; ox++)
+                    {
+                        int x = ox * stride - padding + kx;
+                        if (x >= 0 && x < width)
+                            image[((size_t) c * height + y) * width + x] += row[oy * outputWidth + ox];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
 // --------------------------------------- Neural Network Layer ---------------------------------------
 NeuralNetworkLayer::NeuralNetworkLayer()
 {
     isInputLayer = false;
+    layerType = FULLY_CONNECTED;
+    inputWidth = inputHeight = inputChannels = 0;
+    outputWidth = outputHeight = outputChannels = 0;
+    kernelSize = stride = 1;
+    padding = 0;
 }
 
-NeuralNetworkLayer::NeuralNetworkLayer(int inputSize, int numberOfNeurons)
+NeuralNetworkLayer::NeuralNetworkLayer(int inputSize, int numberOfNeurons) : NeuralNetworkLayer()
 {
     setNumberOfNeurons(numberOfNeurons);
     setInputSize(inputSize);
-    isInputLayer = false;
 }
 
 NeuralNetworkLayer::~NeuralNetworkLayer()
@@ -24,6 +99,15 @@ NeuralNetworkLayer::~NeuralNetworkLayer()
 
 void NeuralNetworkLayer::setInputSize(int size)
 {
+    if (layerType != FULLY_CONNECTED)
+    {
+        // The input size is part of the image dimensions
+        if (size != inputWidth * inputHeight * inputChannels)
+            std::cout << "Neural network layer: The previous layer has " << size << " outputs, the layer expects an image of "
+                << inputWidth * inputHeight * inputChannels << " values!" << std::endl;
+        return;
+    }
+
     for (int i = 0; i < neurons.size(); i++)
         neurons[i].initWeightMatrix(size);
 
@@ -37,7 +121,51 @@ void NeuralNetworkLayer::setNumberOfNeurons(int numberOfNeurons)
 void NeuralNetworkLayer::setNextLayer(NeuralNetworkLayer& _nextLayer)
 {
     nextLayer = &_nextLayer;
-    nextLayer->setInputSize(neurons.size());
+    nextLayer->setInputSize(size());
+}
+
+void NeuralNetworkLayer::setConvolution(int _inputWidth, int _inputHeight, int _inputChannels, int _outputChannels,
+                                        int _kernelSize, int _stride, int _padding)
+{
+    layerType = CONVOLUTION;
+    inputWidth = _inputWidth;
+    inputHeight = _inputHeight;
+    inputChannels = _inputChannels;
+    outputChannels = _outputChannels;
+    kernelSize = _kernelSize;
+    stride = _stride;
+    padding = _padding;
+    outputWidth = (inputWidth + 2 * padding - kernelSize) / stride + 1;
+    outputHeight = (inputHeight + 2 * padding - kernelSize) / stride + 1;
+
+    // One neuron per output channel, its weights are the filter (bias first)
+    EActivationFunction activationFunction = neurons.size() > 0 ? neurons[0].activationFunctionEnum : HEAVISIDE;
+    neurons.setSize(outputChannels);
+    for (int i = 0; i < neurons.size(); i++)
+    {
+        neurons[i].initWeightMatrix(inputChannels * kernelSize * kernelSize);
+        neurons[i].activationFunctionEnum = activationFunction;
+    }
+}
+
+void NeuralNetworkLayer::setPooling(ELayerType type, int _inputWidth, int _inputHeight, int channels, int poolSize, int _stride)
+{
+    if (type != MAX_POOLING && type != AVERAGE_POOLING)
+    {
+        std::cout << "Neural network layer: Pooling must be MAX_POOLING or AVERAGE_POOLING!" << std::endl;
+        return;
+    }
+
+    layerType = type;
+    inputWidth = _inputWidth;
+    inputHeight = _inputHeight;
+    inputChannels = outputChannels = channels;
+    kernelSize = poolSize;
+    stride = _stride;
+    padding = 0;
+    outputWidth = (inputWidth - kernelSize) / stride + 1;
+    outputHeight = (inputHeight - kernelSize) / stride + 1;
+    neurons.setSize(0); // No weights
 }
 
 void NeuralNetworkLayer::setActivationFunction(EActivationFunction activationFunction)
@@ -58,19 +186,321 @@ void NeuralNetworkLayer::forwardPropagation(Matrix<float>& dataSample)
     else
     {
         // Not input layer, perform prediction of data
-        results.setSize(neurons.size(), 1);
-
-        for (int i = 0; i < neurons.size(); i++)
-            results[i][0] = neurons[i].predict(dataSample);
+        switch (layerType)
+        {
+            case FULLY_CONNECTED:
+                results.setSize(neurons.size(), 1);
+                for (int i = 0; i < neurons.size(); i++)
+                    results[i][0] = neurons[i].predict(dataSample);
+                break;
+
+            case CONVOLUTION:
+                convolutionForward(dataSample);
+                break;
+
+            case MAX_POOLING:
+            case AVERAGE_POOLING:
+                poolingForward(dataSample);
+                break;
+        }
 
         if (nextLayer != nullptr)
             nextLayer->forwardPropagation(results);
     }
 }
 
+/**
+    Only the weights of the non-zero features contribute to the net input
+*/
+void NeuralNetworkLayer::forwardPropagation(const SparseVector& dataSample)
+{
+    if (layerType != FULLY_CONNECTED || isInputLayer)
+    {
+        std::cout << "Neural network layer: Sparse samples can only be propagated through a fully connected layer!" << std::endl;
+        return;
+    }
+
+    const int* indices = dataSample.indices.data();
+    const float* values = dataSample.values.data();
+    int count = dataSample.getNonZeroCount();
+    results.setSize(neurons.size(), 1);
+    for (int i = 0; i < neurons.size(); i++)
+    {
+        const Matrix<float>& weightMatrix = neurons[i].weightMatrix;
+        if (weightMatrix.getSizeX() != dataSample.getSize() + 1)
+        {
+            std::cout << "Incorrect number of feature dimension entered for data point. Got " << dataSample.getSize()
+                << ". Expected " << weightMatrix.getSizeX() - 1 << std::endl;
+            return;
+        }
+
+        const float* weights = weightMatrix.getArrayRef();
+        float netInput = weights[0]; // Bias
+        for (int k = 0; k < count; k++)
+            netInput += weights[indices[k] + 1] * values[k];
+        neurons[i].lastNetInput = netInput;
+        results[i][0] = neurons[i].activationFunction(netInput);
+    }
+
+    if (nextLayer != nullptr)
+        nextLayer->forwardPropagation(results);
+}
+
+/**
+    The convolution as one matrix product: the output (outputChannels, positions)
+    is the im2col of the input times the filters
+*/
+void NeuralNetworkLayer::convolutionForward(const Matrix<float>& dataSample)
+{
+    if (dataSample.getSize() != inputWidth * inputHeight * inputChannels)
+    {
+        std::cout << "Neural network layer: Incorrect input size for the convolution. Got " << dataSample.getSize()
+            << ". Expected " << inputWidth * inputHeight * inputChannels << std::endl;
+        return;
+    }
+
+    /// 1) Unfold the input patches
+    int patchSize = inputChannels * kernelSize * kernelSize;
+    int positions = outputWidth * outputHeight;
+    columns.setSize(patchSize, positions);
+    imageToColumns(dataSample.getArrayRef(), inputWidth, inputHeight, inputChannels, kernelSize, stride, padding,
+                   outputWidth, outputHeight, columns.getArrayRef());
+
+    /// 2) Gather the filters, (outputChannels, patchSize)
+    Matrix<float> filters(outputChannels, patchSize);
+    float* filterArray = filters.getArrayRef();
+    for (int c = 0; c < outputChannels; c++)
+    {
+        const Matrix<float>& weightMatrix = neurons[c].weightMatrix;
+        std::copy_n(weightMatrix.getArrayRef() + 1, patchSize, filterArray + (size_t) c * patchSize);
+    }
+
+    /// 3) Multiply, add the biases and activate
+    Matrix<float> product;
+    product.dot(columns, filters); // (outputChannels, positions), [c][p] = sum of columns[k][p] * filters[c][k]
+    const float* productArray = product.getArrayRef();
+
+    netInputs.setSize(size(), 1);
+    results.setSize(size(), 1);
+    float* netInputArray = netInputs.getArrayRef();
+    float* resultArray = results.getArrayRef();
+    for (int c = 0; c < outputChannels; c++)
+    {
+        float bias = neurons[c].weightMatrix[0][0];
+        EActivationFunction activationFunction = neurons[c].activationFunctionEnum;
+        for (int p = 0; p < positions; p++)
+        {
+            int i = c * positions + p;
+            netInputArray[i] = productArray[i] + bias;
+            resultArray[i] = activate(activationFunction, netInputArray[i]);
+        }
+    }
+}
+
+void NeuralNetworkLayer::poolingForward(const Matrix<float>& dataSample)
+{
+    if (dataSample.getSize() != inputWidth * inputHeight * inputChannels)
+    {
+        std::cout << "Neural network layer: Incorrect input size for the pooling. Got " << dataSample.getSize()
+            << ". Expected " << inputWidth * inputHeight * inputChannels << std::endl;
+        return;
+    }
+
+    const float* input = dataSample.getArrayRef();
+    results.setSize(size(), 1);
+    float* resultArray = results.getArrayRef();
+    if (layerType == MAX_POOLING)
+        poolingIndices.resize(size());
+
+    for (int c = 0; c < outputChannels; c++)
+    {
+        for (int oy = 0; oy < outputHeight; oy++)
+        {
+            for (int ox = 0; ox < outputWidth; ox++)
+            {
+                int output = (c * outputHeight + oy) * outputWidth + ox;
+                int best = ((c * inputHeight + oy * stride) * inputWidth) + ox * stride;
+                float sum = 0;
+                for (int ky = 0; ky < kernelSize; ky++)
+                {
+                    for (int kx = 0; kx < kernelSize; kx++)
+                    {
+                        int i = (c * inputHeight + oy * stride + ky) * inputWidth + ox * stride + kx;
+                        sum += input[i];
+                        if (input[i] > input[best])
+                            best = i;
+                    }
+                }
+
+                if (layerType == MAX_POOLING)
+                {
+                    resultArray[output] = input[best];
+                    poolingIndices[output] = best;
+                }
+                else
+                    resultArray[output] = sum / (kernelSize * kernelSize);
+            }
+        }
+    }
+}
+
+void NeuralNetworkLayer::propagateError(const Matrix<float>& delta, Matrix<float>& inputError)
+{
+    int inputSize = inputWidth * inputHeight * inputChannels;
+    inputError.setSize(inputSize, 1);
+    float* errorArray = inputError.getArrayRef();
+    const float* deltaArray = delta.getArrayRef();
+
+    switch (layerType)
+    {
+        case CONVOLUTION:
+        {
+            // Error of the patches = filters transposed times delta, folded back into the image
+            int patchSize = inputChannels * kernelSize * kernelSize;
+            int positions = outputWidth * outputHeight;
+            Matrix<float> deltaMatrix(outputChannels, positions);
+            std::copy_n(deltaArray, deltaMatrix.getSize(), deltaMatrix.getArrayRef());
+
+            Matrix<float> filters(outputChannels, patchSize);
+            float* filterArray = filters.getArrayRef();
+            for (int c = 0; c < outputChannels; c++)
+            {
+                const Matrix<float>& weightMatrix = neurons[c].weightMatrix;
+                std::copy_n(weightMatrix.getArrayRef() + 1, patchSize, filterArray + (size_t) c * patchSize);
+            }
+
+            Matrix<float> columnError;
+            columnError.dot(deltaMatrix, filters.transposedView()); // (patchSize, positions)
+            columnsToImage(columnError.getArrayRef(), inputWidth, inputHeight, inputChannels, kernelSize, stride, padding,
+                           outputWidth, outputHeight, errorArray);
+            break;
+        }
+
+        case MAX_POOLING:
+            // Only the chosen input receives the error
+            std::fill(errorArray, errorArray + inputSize, 0.0f);
+            for (int i = 0; i < size(); i++)
+                errorArray[poolingIndices[i]] += deltaArray[i];
+            break;
+
+        case AVERAGE_POOLING:
+        {
+            std::fill(errorArray, errorArray + inputSize, 0.0f);
+            float scale = 1.0f / (kernelSize * kernelSize);
+            for (int c = 0; c < outputChannels; c++)
+                for (int oy = 0; oy < outputHeight; oy++)
+                    for (int ox = 0; ox < outputWidth; ox++)
+                        for (int ky = 0; ky < kernelSize; ky++)
+                            for (int kx = 0; kx < kernelSize; kx++)
+                                errorArray[(c * inputHeight + oy * stride + ky) * inputWidth + ox * stride + kx]
+                                    += deltaArray[(c * outputHeight + oy) * outputWidth + ox] * scale;
+            break;
+        }
+
+        default:
+            std::cout << "Neural network layer: Fully connected layers propagate their error in NeuralNetwork::backpropagation!" << std::endl;
+    }
+}
+
+/**
+    Gradient of the filters: delta times the im2col of the input transposed,
+    the bias gradient is the delta summed over the positions
+*/
+void NeuralNetworkLayer::getConvolutionGradient(const Matrix<float>& delta, Matrix<float>& gradient)
+{
+    int patchSize = inputChannels * kernelSize * kernelSize;
+    int positions = outputWidth * outputHeight;
+    Matrix<float> deltaMatrix(outputChannels, positions);
+    std::copy_n(delta.getArrayRef(), deltaMatrix.getSize(), deltaMatrix.getArrayRef());
+
+    Matrix<float> filterGradient;
+    filterGradient.dot(columns.transposedView(), deltaMatrix); // (outputChannels, patchSize)
+
+    gradient.setSize(outputChannels * (patchSize + 1), 1);
+    float* gradientArray = gradient.getArrayRef();
+    const float* deltaArray = deltaMatrix.getArrayRef();
+    const float* filterGradientArray = filterGradient.getArrayRef();
+    for (int c = 0; c < outputChannels; c++)
+    {
+        float* target = gradientArray + (size_t) c * (patchSize + 1);
+        target[0] = 0;
+        for (int p = 0; p < positions; p++)
+            target[0] += deltaArray[c * positions + p];
+        std::copy_n(filterGradientArray + (size_t) c * patchSize, patchSize, target + 1);
+    }
+}
+
 int NeuralNetworkLayer::size()
 {
-    return neurons.size();
+    if (layerType == FULLY_CONNECTED)
+        return neurons.size();
+    return outputChannels * outputHeight * outputWidth;
+}
+
+void NeuralNetworkLayer::forwardBatch(const float* weights, int inputSize, int numberOfNeurons, EActivationFunction activationFunction,
+                                      const float* input, int batchSize, float* netInput, float* output)
+{
+    for (int neuron = 0; neuron < numberOfNeurons; neuron++)
+    {
+        const float* weight = weights + (size_t) neuron * (inputSize + 1);
+        float* sum = netInput + (size_t) neuron * batchSize;
+        for (int s = 0; s < batchSize; s++)
+            sum[s] = weight[0];
+        for (int k = 0; k < inputSize; k++)
+        {
+            const float* inputRow = input + (size_t) k * batchSize;
+            float w = weight[k + 1];
+            for (int s = 0; s < batchSize; s++)
+                sum[s] += w * inputRow[s];
+        }
+
+        float* result = output + (size_t) neuron * batchSize;
+        for (int s = 0; s < batchSize; s++)
+            result[s] = activate(activationFunction, sum[s]);
+    }
+}
+
+void NeuralNetworkLayer::backwardBatch(const float* weights, int inputSize, int numberOfNeurons, EActivationFunction activationFunction,
+                                       const float* input, const float* netInput, float* delta, int batchSize,
+                                       float* gradient, float* inputError)
+{
+    if (inputError != nullptr)
+        std::fill(inputError, inputError + (size_t) inputSize * batchSize, 0.0f);
+
+    for (int neuron = 0; neuron < numberOfNeurons; neuron++)
+    {
+        const float* weight = weights + (size_t) neuron * (inputSize + 1);
+        float* neuronGradient = gradient + (size_t) neuron * (inputSize + 1);
+        float* neuronDelta = delta + (size_t) neuron * batchSize;
+        const float* neuronNetInput = netInput + (size_t) neuron * batchSize;
+
+        // delta = error * derived activation function
+        float biasGradient = 0;
+        for (int s = 0; s < batchSize; s++)
+        {
+            neuronDelta[s] *= activateDerived(activationFunction, neuronNetInput[s]);
+            biasGradient += neuronDelta[s];
+        }
+        neuronGradient[0] += biasGradient;
+
+        for (int k = 0; k < inputSize; k++)
+        {
+            const float* inputRow = input + (size_t) k * batchSize;
+            float sum = 0;
+            for (int s = 0; s < batchSize; s++)
+                sum += neuronDelta[s] * inputRow[s];
+            neuronGradient[k + 1] += sum;
+
+            // Weight k + 1 connects input k, the bias is not propagated
+            if (inputError != nullptr)
+            {
+                float* errorRow = inputError + (size_t) k * batchSize;
+                float w = weight[k + 1];
+                for (int s = 0; s < batchSize; s++)
+                    errorRow[s] += w * neuronDelta[s];
+            }
+        }
+    }
 }
 
 float NeuralNetworkLayer::activationFunction(float input)
@@ -81,6 +511,19 @@ float NeuralNetworkLayer::activationFunction(float input)
     exit(-1);
 }
 
+float NeuralNetworkLayer::getDerivative(int outputID)
+{
+    switch (layerType)
+    {
+        case FULLY_CONNECTED:
+            return derivedActivationFunction(neurons[outputID].lastNetInput);
+        case CONVOLUTION:
+            return activateDerived(neurons[outputID / (outputWidth * outputHeight)].activationFunctionEnum, netInputs[outputID][0]);
+        default:
+            return 1; // Pooling has no activation function
+    }
+}
+
 float NeuralNetworkLayer::derivedActivationFunction(float input)
 {
     if (neurons.size() > 0)
@@ -95,6 +538,7 @@ float NeuralNetworkLayer::derivedActivationFunction(float input)
 NeuralNetwork::NeuralNetwork(int inputLayerSize, int hiddenLayerSize, int outputLayerSize, int numberOfHiddenLayers)
 {
     learningRate = 0.5f;
+    shuffleSeed = Random::getThreadGenerator().next();
 
     // Create the layers and set the appropriate parameters/settings
     layers.setSize(2 + numberOfHiddenLayers);
@@ -104,18 +548,16 @@ NeuralNetwork::NeuralNetwork(int inputLayerSize, int hiddenLayerSize, int output
         if (i == 0)
         {
             layers[i].setNumberOfNeurons(inputLayerSize);
-            layers[i].isInputLayer = true;
-            layers[i].setInputSize(inputLayerSize);
+            layers[i].isInputLayer = true; // Passes the data through, its neurons carry no weights
         }
         else if (i < layers.size() - 1)
             layers[i].setNumberOfNeurons(hiddenLayerSize);
         else
             layers[i].setNumberOfNeurons(outputLayerSize);
-
-        // Link the current layer to the previous layer
-        if (i != 0)
-            layers[i - 1].setNextLayer(layers[i]);
     }
+
+    // Link every layer to the previous layer
+    linkLayers();
 }
 
 NeuralNetwork::~NeuralNetwork()
@@ -123,16 +565,94 @@ NeuralNetwork::~NeuralNetwork()
 
 }
 
+/**
+    Links every layer to the next one again, to be called after the layers were
+    replaced, e.g. by convolution or pooling layers
+*/
+void NeuralNetwork::linkLayers()
+{
+    for (int i = 1; i < layers.size(); i++)
+        layers[i - 1].setNextLayer(layers[i]);
+
+    parameterCount = 0;
+    for (int i = 0; i < layers.size(); i++)
+        for (int j = 0; j < layers[i].neurons.size(); j++)
+            parameterCount += layers[i].neurons[j].weightMatrix.getSizeX();
+}
+
 void NeuralNetwork::forwardPropagation(Matrix<float>& dataSample)
 {
     layers[0].forwardPropagation(dataSample);
 }
 
+void NeuralNetwork::forwardPropagation(const SparseVector& dataSample)
+{
+    // The input layer is skipped, it would only pass the sample through as a dense matrix
+    if (!isValidSample(dataSample))
+        return;
+    layers[1].forwardPropagation(dataSample);
+}
+
 void NeuralNetwork::backpropagation(Matrix<float>& dataSample, Array<float>& classificationVector)
 {
     /// First forward propagate
     forwardPropagation(dataSample);
+    backpropagateError(classificationVector, nullptr);
+}
+
+void NeuralNetwork::backpropagation(const SparseVector& dataSample, Array<float>& classificationVector)
+{
+    /// First forward propagate
+    if (!isValidSample(dataSample))
+        return;
+    layers[1].forwardPropagation(dataSample);
+    backpropagateError(classificationVector, &dataSample);
+}
 
+bool NeuralNetwork::isValidSample(const SparseVector& dataSample)
+{
+    if (layers.size() < 2 || dataSample.getSize() != layers[0].size())
+    {
+        std::cout << "Error: The sparse sample has " << dataSample.getSize() << " dimensions, the network expects " << layers[0].size() << "!" << std::endl;
+        return false;
+    }
+    if (dataSample.indices.size() != dataSample.values.size())
+    {
+        std::cout << "Error: The sparse sample has " << dataSample.indices.size() << " indices but " << dataSample.values.size() << " values!" << std::endl;
+        return false;
+    }
+
+    // One pass over the non-zero features, marking every index seen
+    int size = dataSample.getSize();
+    int nonZeroCount = dataSample.indices.size();
+    const int* indices = dataSample.indices.data();
+    if ((int) seenIndices.size() != size)
+        seenIndices.assign(size, false);
+
+    int k = 0;
+    for (; k < nonZeroCount; k++)
+    {
+        if ((unsigned int) indices[k] >= (unsigned int) size)
+        {
+            std::cout << "Error: Index " << indices[k] << " of the sparse sample is outside of the " << size << " dimensions!" << std::endl;
+            break;
+        }
+        if (seenIndices[indices[k]])
+        {
+            std::cout << "Error: Index " << indices[k] << " occurs more than once in the sparse sample, sort it to add up the duplicates!" << std::endl;
+            break;
+        }
+        seenIndices[indices[k]] = true;
+    }
+
+    // Unmark only the indices that were marked
+    for (int j = 0; j < k; j++)
+        seenIndices[indices[j]] = false;
+    return k == nonZeroCount;
+}
+
+void NeuralNetwork::backpropagateError(Array<float>& classificationVector, const SparseVector* sparseSample)
+{
     /// Second calculate delta value for each layer except the input layer
     // Using Matrix instead of Array to ease delta * weight calculation
     Array<Matrix<float>> delta(layers.size());
@@ -145,46 +665,124 @@ void NeuralNetwork::backpropagation(Matrix<float>& dataSample, Array<float>& cla
     {
         // (t - y) * derived_activation_function
         delta[outputLayer][outputNeuronID][0] = classificationVector[outputNeuronID] - layers[outputLayer].results[outputNeuronID][0]; // (t - y)
-        delta[outputLayer][outputNeuronID][0] *= layers[outputLayer].derivedActivationFunction(layers[outputLayer].neurons[outputNeuronID].lastNetInput); // Derived value multiplied
+        delta[outputLayer][outputNeuronID][0] *= layers[outputLayer].getDerivative(outputNeuronID); // Derived value multiplied
     }
 
     // Calculate the delta values for all hidden layers
     // (Loop starts from the second last layer backwards)
     for (int x = layers.size() - 2; x >= 1; x--) // x >= 1 because ignore the input layer
     {
-        // The number of delta per layer is equivalent to the number of neurons
+        // The number of delta per layer is equivalent to the number of outputs
         delta[x].setSize(layers[x].size(), 1);
 
+        // Convolution and pooling layers route their error back themselves
+        if (layers[x + 1].layerType != FULLY_CONNECTED)
+            layers[x + 1].propagateError(delta[x + 1], delta[x]);
+
         // Calculate the delta for each neuron
         for (int y = 0; y < layers[x].size(); y++)
         {
-            delta[x][y][0] = 0;
-            for (int z = 0; z < layers[x + 1].size(); z++)
-                delta[x][y][0] += layers[x + 1].neurons[z].weightMatrix[y][0] * delta[x + 1][z][0]; // w * delta
-            delta[x][y][0] *= layers[x].derivedActivationFunction(layers[x].neurons[y].lastNetInput); // Derived value multiplied
+            if (layers[x + 1].layerType == FULLY_CONNECTED)
+            {
+                delta[x][y][0] = 0;
+                for (int z = 0; z < layers[x + 1].size(); z++)
+                    delta[x][y][0] += layers[x + 1].neurons[z].weightMatrix[y + 1][0] * delta[x + 1][z][0]; // w * delta (index 0 is the bias)
+            }
+            delta[x][y][0] *= layers[x].getDerivative(y); // Derived value multiplied
         }
     }
 
-    /// Third update the weights for all hidden layers and the output layer
-    // Loop for each layer
+    /// Third update the weights of all hidden layers and the output layer
+    // (Re)create the optimizer state if the network has changed shape
+    if (optimizer.getParameterCount() != parameterCount)
+        optimizer.initState(parameterCount);
+    optimizer.nextStep();
+
+    // Every weight matrix is updated in place by one call of the fused kernel,
+    // its gradient only passes through a small buffer which stays in the cache
+    Matrix<float> gradient;
+    int offset = 0; // Input layer weights are never updated, skip over their state
+    for (int j = 0; j < layers[0].neurons.size(); j++)
+        offset += layers[0].neurons[j].weightMatrix.getSizeX();
     for (int i = 1; i < layers.size(); i++)
     {
+        if (layers[i].layerType == CONVOLUTION)
+        {
+            // The gradient of all filters at once, each bias followed by its weights like the weight matrices
+            layers[i].getConvolutionGradient(delta[i], gradient);
+            const float* filterGradient = gradient.getArrayRef();
+            for (int j = 0; j < layers[i].neurons.size(); j++)
+            {
+                Matrix<float> &weightMatrix = layers[i].neurons[j].weightMatrix;
+                int size = weightMatrix.getSizeX();
+                optimizer.update(weightMatrix.getArrayRef(), filterGradient, offset, size, learningRate);
+                filterGradient += size;
+                offset += size;
+            }
+            continue;
+        }
+        if (layers[i].layerType != FULLY_CONNECTED)
+            continue; // Pooling has no weights
+
+        if (i == 1 && sparseSample != nullptr)
+        {
+            // Only the bias and the weights of the non-zero features have a gradient
+            int count = sparseSample->getNonZeroCount();
+            sparseIndices.resize(count + 1);
+            sparseGradient.resize(count + 1);
+            sparseIndices[0] = 0;
+            for (int k = 0; k < count; k++)
+                sparseIndices[k + 1] = sparseSample->indices[k] + 1;
+
+            for (int j = 0; j < layers[i].size(); j++)
+            {
+                Matrix<float> &targetWeightMatrix = layers[i].neurons[j].weightMatrix;
+                int size = targetWeightMatrix.getSizeX();
+                sparseGradient[0] = delta[i][j][0];
+                for (int k = 0; k < count; k++)
+                    sparseGradient[k + 1] = sparseSample->values[k] * delta[i][j][0];
+
+                optimizer.updateSparse(targetWeightMatrix.getArrayRef(), sparseIndices.data(), sparseGradient.data(), count + 1, offset, size, learningRate);
+                offset += size;
+            }
+            continue;
+        }
+
+        // Read only access so the results shared with the data sample are not copied
+        const Matrix<float> &previousResultsMatrix = layers[i - 1].results;
+        const float* previousResults = previousResultsMatrix.getArrayRef();
+        neuronGradient.resize(layers[i - 1].size() + 1);
+
         // Loop for each neuron
         for (int j = 0; j < layers[i].size(); j++)
         {
-            Matrix<float> &targetWeightMatrix = layers[i].neurons[j].weightMatrix;
+            Matrix<float> &weightMatrix = layers[i].neurons[j].weightMatrix;
+            int size = weightMatrix.getSizeX();
 
-            // Update bias: (learning_rate * 1 (bias) * delta_value)
-            targetWeightMatrix[0][0] += learningRate * 1 * delta[i][j][0];
+            // Bias: (1 (bias) * delta_value), all else: (activation_value in layer i - 1 * delta_value)
+            float neuronDelta = delta[i][j][0];
+            neuronGradient[0] = neuronDelta;
+            for (int k = 1; k < size; k++)
+                neuronGradient[k] = previousResults[k - 1] * neuronDelta;
 
-            // Update all else: (learning_rate * activation_value in layer i - 1 * delta_value)
-            for (int k = 1; k < targetWeightMatrix.getSizeX(); k++)
-                targetWeightMatrix[k][0] += learningRate * layers[i - 1].results[k - 1][0] * delta[i][j][0];
+            optimizer.update(weightMatrix.getArrayRef(), neuronGradient.data(), offset, size, learningRate);
+            offset += size;
         }
     }
 }
 
-void NeuralNetwork::backpropagationStochastic(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs)
+void NeuralNetwork::backpropagationStochastic(Array<Matrix<float>>& dataSamples, Array<Array<float>>& classificationVectors, int epochs, int startEpoch)
+{
+    trainStochastic(dataSamples, classificationVectors, epochs, startEpoch);
+}
+
+void NeuralNetwork::backpropagationStochastic(Array<SparseVector>& dataSamples, Array<Array<float>>& classificationVectors, int epochs, int startEpoch)
+{
+    trainStochastic(dataSamples, classificationVectors, epochs, startEpoch);
+}
+
+template <class Sample>
+void NeuralNetwork::trainStochastic(Array<Sample>& dataSamples, Array<Array<float>>& classificationVectors, int epochs, int startEpoch)
 {
     if (dataSamples.size() != classificationVectors.size())
     {
@@ -192,21 +790,67 @@ void NeuralNetwork::backpropagationStochastic(Array<Matrix<float>>& dataSamples,
         return;
     }
 
+    if (trainingMonitor != nullptr)
+        trainingMonitor->begin(*this);
+
     // Learn the samples epochs times
-    for (int x = 0; x < epochs; x++)
+    for (int x = startEpoch; x < epochs; x++)
     {
-        // Access all samples stochastically
-        std::vector<int> indicesLeft;
+        // Access all samples stochastically, the order only depends on the seed and the epoch
+        std::vector<int> order(dataSamples.size());
         for (int i = 0; i < dataSamples.size(); i++)
-            indicesLeft.push_back(i);
+            order[i] = i;
+        Random random(shuffleSeed, x);
+        for (int i = order.size() - 1; i > 0; i--)
+            std::swap(order[i], order[random.nextInt(i + 1)]);
+
+        bool stoppedEarly = false;
+        for (int i = 0; i < (int) order.size(); i++)
+        {
+            backpropagation(dataSamples[order[i]], classificationVectors[order[i]]);
+
+            if (trainingMonitor != nullptr)
+            {
+                trainingMonitor->sampleProcessed(*this);
+                stoppedEarly = trainingMonitor->shouldStop();
+                if (stoppedEarly)
+                    break;
+            }
+        }
 
-        while (indicesLeft.size() != 0)
+        // A checkpoint of a cut short epoch would resume after samples which were never learnt
+        if (checkpointer != nullptr && !stoppedEarly)
+            checkpointer->epochFinished(*this, x);
+
+        if (trainingMonitor != nullptr)
         {
-            int randomAccessIndex = rand() % indicesLeft.size();
-            backpropagation(dataSamples[randomAccessIndex], classificationVectors[randomAccessIndex]);
-            indicesLeft.erase(indicesLeft.begin() + randomAccessIndex);
+            trainingMonitor->epochFinished(*this);
+            if (trainingMonitor->shouldStop())
+                break;
         }
     }
+
+    if (trainingMonitor != nullptr)
+        trainingMonitor->end(*this);
+}
+
+/**
+    Evaluates a snapshot of the weights, the network itself is left untouched
+*/
+EvaluationResult NeuralNetwork::evaluate(const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize, int numberOfThreads)
+{
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(*this))
+    {
+        std::cout << "Error: Only fully connected networks can be evaluated!" << std::endl;
+        return EvaluationResult();
+    }
+    return snapshot.evaluate(dataSamples, targets, batchSize, numberOfThreads);
+}
+
+int NeuralNetwork::getParameterCount()
+{
+    return parameterCount;
 }
 
 /**
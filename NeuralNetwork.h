@@ -1,9 +1,17 @@
 #ifndef NEURALNETWORK_H
 #define NEURALNETWORK_H
 
+#include <vector>
 #include "Array.h"
 #include "Matrix.h"
 #include "Neuron.h"
+#include "Optimizer.h"
+#include "Evaluation.h"
+#include "ELayerType.h"
+#include "SparseVector.h"
+
+class TrainingMonitor;
+class Checkpointer;
 
 class NeuralNetworkLayer
 {
@@ -17,19 +25,61 @@ class NeuralNetworkLayer
         void setActivationFunction(EActivationFunction activationFunction);
         void setNextLayer(NeuralNetworkLayer& _nextLayer);
         void forwardPropagation(Matrix<float> &dataSample);
+        void forwardPropagation(const SparseVector& dataSample); // Fully connected layers, only the weights of the non-zero features are read
+
+        /**
+            Turns the layer into a convolution or pooling layer. The input and the output
+            are images stored channel by channel, row by row: (channel * height + y) * width + x.
+            Call NeuralNetwork::linkLayers afterwards so the next layer sees the new size.
+            NetworkSnapshot holds fully connected layers only, so NeuralNetwork::evaluate,
+            TrainingMonitor, Checkpointer and the snapshot based trainers and exporters
+            do not support networks with these layers.
+        */
+        void setConvolution(int inputWidth, int inputHeight, int inputChannels, int outputChannels,
+                            int kernelSize, int stride = 1, int padding = 0);
+        void setPooling(ELayerType type, int inputWidth, int inputHeight, int channels, int poolSize, int stride);
 
         float outputValue(Matrix<float>& dataSample, int neuronID);
         float activationFunction(float input);
         float derivedActivationFunction(float input);
+        float getDerivative(int outputID); // Derived activation function at the last net input of the output
+
+        // Backpropagation through convolution and pooling layers
+        void propagateError(const Matrix<float>& delta, Matrix<float>& inputError); // delta of the outputs to the error of the inputs
+        void getConvolutionGradient(const Matrix<float>& delta, Matrix<float>& gradient); // (bias, weights) of every filter, one after the other
 
-        int size();
+        int size(); // Number of outputs
+
+        /**
+            Batched kernels over flat weights, (numberOfNeurons, inputSize + 1) with the bias
+            first as in a neuron's weight matrix. Activations are (neurons, batch) so the
+            inner loops run over contiguous samples.
+        */
+        static void forwardBatch(const float* weights, int inputSize, int numberOfNeurons, EActivationFunction activationFunction,
+                                 const float* input, int batchSize, float* netInput, float* output);
+        // delta holds dE/d(output) on entry (delta rule sign) and the neuron deltas on return, the
+        // weight gradient is accumulated and inputError (if not null) receives the error of the inputs
+        static void backwardBatch(const float* weights, int inputSize, int numberOfNeurons, EActivationFunction activationFunction,
+                                  const float* input, const float* netInput, float* delta, int batchSize,
+                                  float* gradient, float* inputError);
 
         bool isInputLayer;
         Matrix<float> results;
         Array<Neuron> neurons;
 
+        ELayerType layerType;
+        int inputWidth, inputHeight, inputChannels; // CONVOLUTION and pooling
+        int outputWidth, outputHeight, outputChannels;
+        int kernelSize, stride, padding; // The pool size for pooling
+        Matrix<float> netInputs; // CONVOLUTION, per output
+
     private:
+        void convolutionForward(const Matrix<float>& dataSample);
+        void poolingForward(const Matrix<float>& dataSample);
+
         NeuralNetworkLayer* nextLayer = nullptr;
+        Matrix<float> columns; // im2col of the last input, (inputChannels * kernelSize * kernelSize, positions)
+        std::vector<int> poolingIndices; // MAX_POOLING, input chosen by every output
 };
 
 /**
@@ -41,10 +91,21 @@ class NeuralNetwork
         NeuralNetwork(int inputLayerSize, int hiddenLayerSize, int outputLayerSize, int numberOfHiddenLayers);
         virtual ~NeuralNetwork();
 
+        void linkLayers(); // Reconnects the layers after their sizes changed and counts their weights
+
         // Neural network related functions
         void forwardPropagation(Matrix<float> &dataSample);
         void backpropagation(Matrix<float> &dataSample, Array<float> &classificationVector);
-        void backpropagationStochastic(Array<Matrix<float>> &dataSamples, Array<Array<float>> &classificationVectors, int epochs);
+        void backpropagationStochastic(Array<Matrix<float>> &dataSamples, Array<Array<float>> &classificationVectors, int epochs, int startEpoch = 0);
+
+        /**
+            Sparse inputs, e.g. one-hot or hashed features. The first layer after the input
+            layer only reads and updates the weights of the non-zero features, so its cost
+            is O(non-zeros x neurons) instead of O(dimensions x neurons).
+        */
+        void forwardPropagation(const SparseVector& dataSample);
+        void backpropagation(const SparseVector& dataSample, Array<float> &classificationVector);
+        void backpropagationStochastic(Array<SparseVector> &dataSamples, Array<Array<float>> &classificationVectors, int epochs, int startEpoch = 0);
 
         // Functions for retrieving the result calculated
         int getClassWithMaxResponse();
@@ -56,12 +117,33 @@ class NeuralNetwork
         int getNegatedMaxResponse();
         int getNegatedMinResponse();
 
+        // Batched, multithreaded metrics over the samples (inputSize, numberOfSamples) and targets (outputSize, numberOfSamples)
+        EvaluationResult evaluate(const Matrix<float>& dataSamples, const Matrix<float>& targets, int batchSize = 256, int numberOfThreads = 1);
+
+        int getParameterCount(); // Total number of weights (including biases) in the network, as of the last linkLayers
+
         Array<NeuralNetworkLayer> layers;
         float learningRate;
+        Optimizer optimizer; // Weight update rule, plain SGD by default
+        TrainingMonitor* trainingMonitor = nullptr; // Optional validation and early stopping for backpropagationStochastic
+        Checkpointer* checkpointer = nullptr; // Optional background checkpointing for backpropagationStochastic
+        unsigned int shuffleSeed; // Seeds the sample order of every epoch, so a resumed run sees the same order
 
     protected:
 
     private:
+        // Deltas and weight updates after the forward propagation, sparseSample is the input if it was sparse
+        void backpropagateError(Array<float> &classificationVector, const SparseVector* sparseSample);
+        bool isValidSample(const SparseVector& dataSample); // The indices and values are public, checked before any weight is read
+
+        template <class Sample>
+        void trainStochastic(Array<Sample> &dataSamples, Array<Array<float>> &classificationVectors, int epochs, int startEpoch);
+
+        std::vector<int> sparseIndices; // Buffers of the sparse weight update
+        std::vector<float> sparseGradient;
+        std::vector<float> neuronGradient; // Gradient of one weight matrix, reused by every neuron
+        std::vector<bool> seenIndices; // Duplicate check of isValidSample, all false between calls
+        int parameterCount; // Counted by linkLayers
 };
 
 #endif // NEURALNETWORK_H
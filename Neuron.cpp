@@ -1,10 +1,10 @@
 #include "Neuron.h"
+#include "ActivationFunction.h"
+#include "Random.h"
 #include <math.h>
 #include <iostream>
 // #include <limits>
 
-#define EULER_NUMBER 2.71828182845904523536
-
 Neuron::Neuron()
 {
     weightMatrixSet = false;
@@ -29,10 +29,9 @@ void Neuron::initWeightMatrix(int featureSize)
 
 void Neuron::fillWeightMatrixRandomly(int featureSize, int minValue, int maxValue)
 {
-    int range = (maxValue - minValue) * 1000;
+    // Drawn from the generator of the calling thread, see WeightInitializer for seeded initialisation
     weightMatrix[0][0] = 1;
-    for (int i = 1; i < featureSize + 1; i++)
-        weightMatrix[i][0] = (float) (rand() % range) / 1000.0f + minValue;
+    Random::getThreadGenerator().fillUniform(weightMatrix.getArrayRef() + 1, featureSize, minValue, maxValue);
     weightMatrixSet = true;
 }
 
@@ -171,105 +170,12 @@ float Neuron::predict(Matrix<float>& dataPoint)
 
 float Neuron::activationFunction(float input)
 {
-    switch (activationFunctionEnum)
-    {
-        case LINEAR:
-			return input;
-
-		case HEAVISIDE: // 0 to 1
-			if (input > 0) return 1;
-			else if (input == 0) return 0.5f;
-			else return 0;
-
-		case LOGISTIC: // From 0 to 1
-			return 1.0f / (1.0f + (float) pow(EULER_NUMBER, -input));
-
-        case SOFTMAX:
-            return 0;
-
-		case TANH: // From -1 to 1
-			return tanh(input);
-
-		case TANH01: // From 0 to 1
-			return tanh(input) / 2.0f + 0.5f;
-
-        case RECTIFIED_LINEAR_UNIT:
-            if (input < 0) return 0;
-            return input;
-
-		case ARCTAN: // From -pi/2 to pi/2
-			return atan(input);
-
-        case ARCTAN01: // From 0 to 1
-			return atan(input) / 3.14159265358979f + 0.5f;
-
-		case SYMMETRICAL_HARD_LIMIT: // -1 to 1
-			if (input > 0) return 1;
-			else if (input == 0) return 0;
-			else return -1;
-
-		case SINUSOID: // -1 to 1
-			return sin(input);
-
-        case SINUSOID01: // 0 to 1
-			return sin(input) / 2.0f + 0.5f;
-
-		case GAUSSIAN: // 0 to 1
-			return pow(EULER_NUMBER, -input * input);
-
-		default:
-			return input; // Assume linear otherwise
-    }
+    return activate(activationFunctionEnum, input);
 }
 
 float Neuron::derivedActivationFunction(float input)
 {
-    switch (activationFunctionEnum)
-    {
-		case LINEAR:
-			return 1;
-
-		case HEAVISIDE:
-		    // if (input == 0) return std::numeric_limits<float>::infinity();
-			return 0; // Will not work with back propagation
-
-		case LOGISTIC:
-			return atan(input) * (1.0f - atan(input)) / 2.0f;
-
-        case SOFTMAX:
-            return 0;
-
-		case TANH:
-			return 1.0f - pow(activationFunction(input), 2.0f);
-
-		case TANH01:
-			return (1.0f - pow(activationFunction(input), 2.0f)) / 2.0f;
-
-        case RECTIFIED_LINEAR_UNIT:
-            if (input < 0) return 0;
-            return 1;
-
-		case ARCTAN:
-			return 1.0f / (input * input + 1.0f);
-
-        case ARCTAN01:
-			return 1.0f / (input * input + 1.0f) / 3.14159265358979f; // Unsure here
-
-		case SYMMETRICAL_HARD_LIMIT:
-			return 0;
-
-		case SINUSOID:
-			return cos(input);
-
-		case SINUSOID01:
-			return cos(input) / 2.0f;
-
-		case GAUSSIAN:
-			return -2 * input * pow(EULER_NUMBER, -input * input);
-
-		default:
-			return 1; // Assume linear otherwise
-    }
+    return activateDerived(activationFunctionEnum, input);
 }
 
 void Neuron::printWeightMatrix()
@@ -279,7 +185,7 @@ void Neuron::printWeightMatrix()
     std::cout << std::endl;
 }
 
-void Neuron::getAugmentedDataSample(Matrix<float>& input, Matrix<float>& output)
+void Neuron::getAugmentedDataSample(const Matrix<float>& input, Matrix<float>& output)
 {
     output.setSize(1, input.getSizeX() + 1); // Taken outside the loop to speed things up
     output[0][0] = 1; // This value is always 1
@@ -22,7 +22,7 @@ class Neuron
         float activationFunction(float input); // Relays the input to the function specified
         float derivedActivationFunction(float input);
 
-        void getAugmentedDataSample(Matrix<float> &input, Matrix<float> &output);
+        void getAugmentedDataSample(const Matrix<float> &input, Matrix<float> &output);
 
         EActivationFunction activationFunctionEnum; // Specifies the learning response function to be used
         Matrix<float> weightMatrix; // Weight matrix of the perceptron
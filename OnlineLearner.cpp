@@ -0,0 +1,237 @@
+#include "OnlineLearner.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <chrono>
+#include <limits>
+
+OnlineLearner::OnlineLearner(NeuralNetwork& _network, int queueCapacity, int maxReaders) : queue(queueCapacity), readers(maxReaders)
+{
+    network = &_network;
+    publishInterval = 100;
+    maxPublishDelay = 1.0;
+    running = false;
+    current = nullptr;
+    globalEpoch = 1; // 0 marks a reader outside of a critical section
+    updateCount = 0;
+    publishCount = 0;
+    droppedCount = 0;
+}
+
+OnlineLearner::~OnlineLearner()
+{
+    stop();
+
+    // No reader may use the learner any more
+    delete current.load();
+    for (int i = 0; i < (int) retired.size(); i++)
+        delete retired[i].snapshot;
+    for (int i = 0; i < (int) spare.size(); i++)
+        delete spare[i];
+}
+
+void OnlineLearner::start()
+{
+    if (running)
+        return;
+
+    publish(); // Readers can predict right away
+    running = true;
+    trainer = std::thread(&OnlineLearner::trainLoop, this);
+}
+
+void OnlineLearner::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    trainer.join();
+}
+
+bool OnlineLearner::addSample(const Matrix<float>& dataSample, const std::vector<float>& classificationVector)
+{
+    Sample sample;
+    sample.dataSample = dataSample;
+    sample.classificationVector = classificationVector;
+    if (!queue.tryPush(std::move(sample)))
+    {
+        droppedCount++;
+        return false;
+    }
+    return true;
+}
+
+void OnlineLearner::trainLoop()
+{
+    Sample sample;
+    Array<float> classificationVector;
+    int pendingUpdates = 0;
+    auto lastPublish = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        // Read the flag first so every sample queued before stop is still trained
+        bool stopping = !running.load();
+        if (queue.tryPop(sample))
+        {
+            if (classificationVector.size() != (int) sample.classificationVector.size())
+                classificationVector.setSize(sample.classificationVector.size());
+            for (int i = 0; i < classificationVector.size(); i++)
+                classificationVector[i] = sample.classificationVector[i];
+
+            network->backpropagation(sample.dataSample, classificationVector);
+            updateCount++;
+            pendingUpdates++;
+        }
+        else if (stopping)
+            break;
+
+        // Publish every publishInterval updates, or sooner when the stream is slow
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastPublish).count();
+        if (pendingUpdates >= publishInterval || (pendingUpdates > 0 && elapsed >= maxPublishDelay))
+        {
+            publish();
+            pendingUpdates = 0;
+            lastPublish = std::chrono::steady_clock::now();
+        }
+        else if (pendingUpdates == 0 && !stopping)
+        {
+            // Nothing to train, free what the readers let go of and wait for samples
+            if (!retired.empty())
+                reclaim();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    if (pendingUpdates > 0)
+        publish();
+}
+
+/**
+    Swaps in a snapshot of the current weights, the old one is retired
+*/
+void OnlineLearner::publish()
+{
+    NetworkSnapshot* snapshot;
+    if (!spare.empty())
+    {
+        // Reuse a reclaimed snapshot so its weight vector does not allocate again
+        snapshot = spare.back();
+        spare.pop_back();
+    }
+    else
+        snapshot = new NetworkSnapshot();
+    snapshot->capture(*network);
+
+    NetworkSnapshot* old = current.exchange(snapshot);
+    if (old != nullptr)
+    {
+        // Readers which enter from the next epoch on can only see the new snapshot
+        RetiredSnapshot retiredSnapshot;
+        retiredSnapshot.snapshot = old;
+        retiredSnapshot.epoch = globalEpoch.fetch_add(1);
+        retired.push_back(retiredSnapshot);
+    }
+    publishCount++;
+
+    reclaim();
+}
+
+void OnlineLearner::reclaim()
+{
+    // Oldest epoch a reader is still in
+    unsigned long long oldestEpoch = std::numeric_limits<unsigned long long>::max();
+    for (int i = 0; i < (int) readers.size(); i++)
+    {
+        unsigned long long epoch = readers[i].epoch.load();
+        if (epoch != 0 && epoch < oldestEpoch)
+            oldestEpoch = epoch;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < (int) retired.size(); i++)
+    {
+        if (retired[i].epoch < oldestEpoch)
+            spare.push_back(retired[i].snapshot);
+        else
+            retired[kept++] = retired[i];
+    }
+    retired.resize(kept);
+
+    // A couple of spare snapshots cover the usual publish and reclaim cycle
+    while (spare.size() > 2)
+    {
+        delete spare.back();
+        spare.pop_back();
+    }
+}
+
+int OnlineLearner::registerReader()
+{
+    for (int i = 0; i < (int) readers.size(); i++)
+    {
+        bool expected = false;
+        if (readers[i].claimed.compare_exchange_strong(expected, true))
+            return i;
+    }
+
+    std::cout << "Online learner: All " << readers.size() << " reader slots are taken!" << std::endl;
+    return -1;
+}
+
+void OnlineLearner::unregisterReader(int readerID)
+{
+    readers[readerID].epoch = 0;
+    readers[readerID].claimed = false;
+}
+
+/**
+    Enters the critical section of the reader. Wait-free: one load, one store, one load.
+*/
+const NetworkSnapshot* OnlineLearner::acquire(int readerID)
+{
+    // The announcement must be visible before the pointer is read (sequentially consistent)
+    readers[readerID].epoch.store(globalEpoch.load());
+    return current.load();
+}
+
+void OnlineLearner::release(int readerID)
+{
+    readers[readerID].epoch.store(0, std::memory_order_release);
+}
+
+bool OnlineLearner::predict(int readerID, const Matrix<float>& dataSample, Matrix<float>& output)
+{
+    if (readerID < 0 || readerID >= (int) readers.size())
+    {
+        std::cout << "Online learner: Invalid reader ID " << readerID << "!" << std::endl;
+        return false;
+    }
+
+    const NetworkSnapshot* snapshot = acquire(readerID);
+    if (snapshot == nullptr || snapshot->isEmpty())
+    {
+        release(readerID);
+        std::cout << "Online learner: No snapshot has been published yet!" << std::endl;
+        return false;
+    }
+
+    snapshot->predict(dataSample, output);
+    release(readerID);
+    return true;
+}
+
+long long OnlineLearner::getUpdateCount()
+{
+    return updateCount;
+}
+
+long long OnlineLearner::getPublishCount()
+{
+    return publishCount;
+}
+
+long long OnlineLearner::getDroppedCount()
+{
+    return droppedCount;
+}
@@ -0,0 +1,94 @@
+#ifndef ONLINELEARNER_H
+#define ONLINELEARNER_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "Matrix.h"
+#include "NetworkSnapshot.h"
+#include "SpscQueue.h"
+
+class NeuralNetwork;
+
+/**
+    Trains a network on a live sample stream while other threads serve predictions.
+
+    The trainer thread owns the network while the learner runs: it takes samples
+    from a lock-free queue, calls backpropagation on them and every publishInterval
+    updates publishes a NetworkSnapshot of the weights by swapping an atomic
+    pointer. Serving threads never see a network being updated, they read the last
+    published snapshot without locks or waiting:
+
+        int reader = learner.registerReader(); // Once per serving thread
+        learner.predict(reader, dataSample, output);
+
+    Old snapshots are freed with epoch based reclamation. A reader announces the
+    epoch it entered in its own slot, a retired snapshot is deleted once every
+    reader in a critical section entered after it was replaced.
+*/
+class OnlineLearner
+{
+    public:
+        OnlineLearner(NeuralNetwork& network, int queueCapacity = 1024, int maxReaders = 64);
+        ~OnlineLearner();
+
+        void start(); // Publishes the current weights and starts the trainer thread
+        void stop(); // Trains the queued samples, publishes them and stops the trainer thread
+
+        // From a single producer thread, returns false (and drops the sample) if the queue is full
+        bool addSample(const Matrix<float>& dataSample, const std::vector<float>& classificationVector);
+
+        // Readers, every serving thread registers once and uses its own ID
+        int registerReader(); // -1 if all reader slots are taken
+        void unregisterReader(int readerID);
+        const NetworkSnapshot* acquire(int readerID); // The current snapshot, valid until release
+        void release(int readerID);
+        bool predict(int readerID, const Matrix<float>& dataSample, Matrix<float>& output);
+
+        long long getUpdateCount(); // Samples trained
+        long long getPublishCount(); // Snapshots published, including the one of start
+        long long getDroppedCount(); // Samples rejected because the queue was full
+
+        int publishInterval; // Updates between published snapshots
+        double maxPublishDelay; // Seconds after which pending updates are published even if fewer than publishInterval
+
+    private:
+        struct Sample
+        {
+            Matrix<float> dataSample;
+            std::vector<float> classificationVector;
+        };
+
+        struct alignas(64) ReaderSlot
+        {
+            std::atomic<unsigned long long> epoch{0}; // 0 outside of a critical section
+            std::atomic<bool> claimed{false};
+        };
+
+        struct RetiredSnapshot
+        {
+            NetworkSnapshot* snapshot;
+            unsigned long long epoch; // Last epoch in which readers could still have picked it up
+        };
+
+        void trainLoop();
+        void publish();
+        void reclaim();
+
+        NeuralNetwork* network;
+        SpscQueue<Sample> queue;
+        std::thread trainer;
+        std::atomic<bool> running;
+
+        std::atomic<NetworkSnapshot*> current;
+        std::atomic<unsigned long long> globalEpoch;
+        std::vector<ReaderSlot> readers;
+        std::vector<RetiredSnapshot> retired; // Trainer thread only
+        std::vector<NetworkSnapshot*> spare; // Reclaimed snapshots kept for the next publish
+
+        std::atomic<long long> updateCount;
+        std::atomic<long long> publishCount;
+        std::atomic<long long> droppedCount;
+};
+
+#endif // ONLINELEARNER_H
@@ -0,0 +1,300 @@
+#include "Optimizer.h"
+#include <math.h>
+#include <iostream>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+    Update kernels
+    Every kernel updates the weights and the optimizer state in a single pass.
+    The plain loops are left for the compiler to vectorize, the ones needing a
+    square root are written with AVX when it is available and with SSE2 (part
+    of every x86-64 build, so a plain -O2 build gets it too) otherwise.
+*/
+static void sgdUpdate(float* __restrict weights, const float* __restrict gradient, int size, float learningRate)
+{
+    for (int i = 0; i < size; i++)
+        weights[i] += learningRate * gradient[i];
+}
+
+static void momentumUpdate(float* __restrict weights, const float* __restrict gradient, float* __restrict velocity,
+                           int size, float learningRate, float momentum)
+{
+    // v = mv + ng, w = w + v
+    for (int i = 0; i < size; i++)
+    {
+        velocity[i] = momentum * velocity[i] + learningRate * gradient[i];
+        weights[i] += velocity[i];
+    }
+}
+
+static void nesterovUpdate(float* __restrict weights, const float* __restrict gradient, float* __restrict velocity,
+                           int size, float learningRate, float momentum)
+{
+    // v = mv + ng, w = w + mv + ng (look ahead along the new velocity)
+    for (int i = 0; i < size; i++)
+    {
+        float step = learningRate * gradient[i];
+        velocity[i] = momentum * velocity[i] + step;
+        weights[i] += momentum * velocity[i] + step;
+    }
+}
+
+static void rmspropUpdate(float* __restrict weights, const float* __restrict gradient, float* __restrict meanSquare,
+                          int size, float learningRate, float decayRate, float epsilon)
+{
+    // s = ps + (1 - p)gg, w = w + ng / (sqrt(s) + e)
+    int i = 0;
+#ifdef __AVX__
+    __m256 rate = _mm256_set1_ps(learningRate);
+    __m256 decay = _mm256_set1_ps(decayRate);
+    __m256 oneMinusDecay = _mm256_set1_ps(1.0f - decayRate);
+    __m256 eps = _mm256_set1_ps(epsilon);
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256 g = _mm256_loadu_ps(gradient + i);
+        __m256 s = _mm256_loadu_ps(meanSquare + i);
+        s = _mm256_add_ps(_mm256_mul_ps(decay, s), _mm256_mul_ps(_mm256_mul_ps(oneMinusDecay, g), g));
+        _mm256_storeu_ps(meanSquare + i, s);
+        __m256 step = _mm256_div_ps(_mm256_mul_ps(rate, g), _mm256_add_ps(_mm256_sqrt_ps(s), eps));
+        _mm256_storeu_ps(weights + i, _mm256_add_ps(_mm256_loadu_ps(weights + i), step));
+    }
+#elif defined(__SSE2__)
+    __m128 rate = _mm_set1_ps(learningRate);
+    __m128 decay = _mm_set1_ps(decayRate);
+    __m128 oneMinusDecay = _mm_set1_ps(1.0f - decayRate);
+    __m128 eps = _mm_set1_ps(epsilon);
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128 g = _mm_loadu_ps(gradient + i);
+        __m128 s = _mm_loadu_ps(meanSquare + i);
+        s = _mm_add_ps(_mm_mul_ps(decay, s), _mm_mul_ps(_mm_mul_ps(oneMinusDecay, g), g));
+        _mm_storeu_ps(meanSquare + i, s);
+        __m128 step = _mm_div_ps(_mm_mul_ps(rate, g), _mm_add_ps(_mm_sqrt_ps(s), eps));
+        _mm_storeu_ps(weights + i, _mm_add_ps(_mm_loadu_ps(weights + i), step));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        meanSquare[i] = decayRate * meanSquare[i] + (1.0f - decayRate) * gradient[i] * gradient[i];
+        weights[i] += learningRate * gradient[i] / (sqrtf(meanSquare[i]) + epsilon);
+    }
+}
+
+static void adamUpdate(float* __restrict weights, const float* __restrict gradient, float* __restrict mean,
+                       float* __restrict meanSquare, int size, float stepSize, float beta1, float beta2, float epsilon)
+{
+    // m = b1m + (1 - b1)g, v = b2v + (1 - b2)gg, w = w + a * m / (sqrt(v) + e)
+    // The step size a already contains the bias correction of both moments
+    int i = 0;
+#ifdef __AVX__
+    __m256 rate = _mm256_set1_ps(stepSize);
+    __m256 b1 = _mm256_set1_ps(beta1);
+    __m256 oneMinusB1 = _mm256_set1_ps(1.0f - beta1);
+    __m256 b2 = _mm256_set1_ps(beta2);
+    __m256 oneMinusB2 = _mm256_set1_ps(1.0f - beta2);
+    __m256 eps = _mm256_set1_ps(epsilon);
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256 g = _mm256_loadu_ps(gradient + i);
+        __m256 m = _mm256_add_ps(_mm256_mul_ps(b1, _mm256_loadu_ps(mean + i)), _mm256_mul_ps(oneMinusB1, g));
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(b2, _mm256_loadu_ps(meanSquare + i)), _mm256_mul_ps(_mm256_mul_ps(oneMinusB2, g), g));
+        _mm256_storeu_ps(mean + i, m);
+        _mm256_storeu_ps(meanSquare + i, v);
+        __m256 step = _mm256_div_ps(_mm256_mul_ps(rate, m), _mm256_add_ps(_mm256_sqrt_ps(v), eps));
+        _mm256_storeu_ps(weights + i, _mm256_add_ps(_mm256_loadu_ps(weights + i), step));
+    }
+#elif defined(__SSE2__)
+    __m128 rate = _mm_set1_ps(stepSize);
+    __m128 b1 = _mm_set1_ps(beta1);
+    __m128 oneMinusB1 = _mm_set1_ps(1.0f - beta1);
+    __m128 b2 = _mm_set1_ps(beta2);
+    __m128 oneMinusB2 = _mm_set1_ps(1.0f - beta2);
+    __m128 eps = _mm_set1_ps(epsilon);
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128 g = _mm_loadu_ps(gradient + i);
+        __m128 m = _mm_add_ps(_mm_mul_ps(b1, _mm_loadu_ps(mean + i)), _mm_mul_ps(oneMinusB1, g));
+        __m128 v = _mm_add_ps(_mm_mul_ps(b2, _mm_loadu_ps(meanSquare + i)), _mm_mul_ps(_mm_mul_ps(oneMinusB2, g), g));
+        _mm_storeu_ps(mean + i, m);
+        _mm_storeu_ps(meanSquare + i, v);
+        __m128 step = _mm_div_ps(_mm_mul_ps(rate, m), _mm_add_ps(_mm_sqrt_ps(v), eps));
+        _mm_storeu_ps(weights + i, _mm_add_ps(_mm_loadu_ps(weights + i), step));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        mean[i] = beta1 * mean[i] + (1.0f - beta1) * gradient[i];
+        meanSquare[i] = beta2 * meanSquare[i] + (1.0f - beta2) * gradient[i] * gradient[i];
+        weights[i] += stepSize * mean[i] / (sqrtf(meanSquare[i]) + epsilon);
+    }
+}
+
+/**
+    Sparse update, the rules above applied to the listed weights only. The state of
+    the weights which are not listed is not decayed (a lazy update), so the momentum
+    methods and Adam only approximate their dense result when the gradient is sparse.
+*/
+static void sparseUpdate(EOptimizer optimizerEnum, float* weights, const int* indices, const float* gradient, int count,
+                         float* velocity, float* meanSquare, float learningRate, float momentum, float decayRate,
+                         float stepSize, float beta1, float beta2, float epsilon)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int k = indices[i];
+        float g = gradient[i];
+        switch (optimizerEnum)
+        {
+            case SGD:
+                weights[k] += learningRate * g;
+                break;
+
+            case MOMENTUM:
+                velocity[k] = momentum * velocity[k] + learningRate * g;
+                weights[k] += velocity[k];
+                break;
+
+            case NESTEROV:
+                velocity[k] = momentum * velocity[k] + learningRate * g;
+                weights[k] += momentum * velocity[k] + learningRate * g;
+                break;
+
+            case RMSPROP:
+                meanSquare[k] = decayRate * meanSquare[k] + (1.0f - decayRate) * g * g;
+                weights[k] += learningRate * g / (sqrtf(meanSquare[k]) + epsilon);
+                break;
+
+            case ADAM:
+                velocity[k] = beta1 * velocity[k] + (1.0f - beta1) * g;
+                meanSquare[k] = beta2 * meanSquare[k] + (1.0f - beta2) * g * g;
+                weights[k] += stepSize * velocity[k] / (sqrtf(meanSquare[k]) + epsilon);
+                break;
+        }
+    }
+}
+
+
+// --------------------------------------- Optimizer ---------------------------------------
+Optimizer::Optimizer()
+{
+    optimizerEnum = SGD;
+    momentum = 0.9f;
+    decayRate = 0.9f;
+    beta1 = 0.9f;
+    beta2 = 0.999f;
+    epsilon = 1e-7f;
+    timeStep = 0;
+    beta1Power = 1;
+    beta2Power = 1;
+}
+
+Optimizer::~Optimizer()
+{
+
+}
+
+void Optimizer::setOptimizer(EOptimizer optimizer)
+{
+    optimizerEnum = optimizer;
+    initState(getParameterCount()); // The state of the previous rule means nothing to the new one
+}
+
+void Optimizer::initState(int parameterCount)
+{
+    firstMoment.setSize(parameterCount, 1);
+    secondMoment.setSize(parameterCount, 1);
+    firstMoment.clear();
+    secondMoment.clear();
+    timeStep = 0;
+    beta1Power = 1;
+    beta2Power = 1;
+}
+
+void Optimizer::nextStep()
+{
+    timeStep++;
+    beta1Power *= beta1;
+    beta2Power *= beta2;
+}
+
+/**
+    Continues from the given time step, used when resuming training from a checkpoint
+*/
+void Optimizer::setTimeStep(int _timeStep)
+{
+    timeStep = _timeStep;
+    beta1Power = pow(beta1, timeStep);
+    beta2Power = pow(beta2, timeStep);
+}
+
+int Optimizer::getParameterCount()
+{
+    return firstMoment.getSizeX();
+}
+
+/**
+    Updates the given weights which start at the offset within the optimizer state
+*/
+void Optimizer::update(float* weights, const float* gradient, int offset, int size, float learningRate)
+{
+    if (offset + size > getParameterCount())
+    {
+        std::cout << "Optimizer: The optimizer state is smaller than the weights being updated!" << std::endl;
+        return;
+    }
+
+    float* velocity = firstMoment.getArrayRef() + offset;
+    float* meanSquare = secondMoment.getArrayRef() + offset;
+
+    switch (optimizerEnum)
+    {
+        case SGD:
+            sgdUpdate(weights, gradient, size, learningRate);
+            break;
+
+        case MOMENTUM:
+            momentumUpdate(weights, gradient, velocity, size, learningRate, momentum);
+            break;
+
+        case NESTEROV:
+            nesterovUpdate(weights, gradient, velocity, size, learningRate, momentum);
+            break;
+
+        case RMSPROP:
+            rmspropUpdate(weights, gradient, meanSquare, size, learningRate, decayRate, epsilon);
+            break;
+
+        case ADAM:
+        {
+            // Fold the bias correction of both moments into the step size
+            float stepSize = learningRate;
+            if (timeStep > 0)
+                stepSize *= sqrtf(1.0f - beta2Power) / (1.0f - beta1Power);
+            adamUpdate(weights, gradient, velocity, meanSquare, size, stepSize, beta1, beta2, epsilon);
+            break;
+        }
+    }
+}
+
+/**
+    Updates some of the given weights, size is the number of weights starting at the offset
+*/
+void Optimizer::updateSparse(float* weights, const int* indices, const float* gradient, int count, int offset, int size, float learningRate)
+{
+    if (offset + size > getParameterCount())
+    {
+        std::cout << "Optimizer: The optimizer state is smaller than the weights being updated!" << std::endl;
+        return;
+    }
+
+    float stepSize = learningRate;
+    if (optimizerEnum == ADAM && timeStep > 0)
+        stepSize *= sqrtf(1.0f - beta2Power) / (1.0f - beta1Power);
+
+    sparseUpdate(optimizerEnum, weights, indices, gradient, count, firstMoment.getArrayRef() + offset,
+                 secondMoment.getArrayRef() + offset, learningRate, momentum, decayRate, stepSize, beta1, beta2, epsilon);
+}
@@ -0,0 +1,49 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "Matrix.h"
+#include "EOptimizer.h"
+
+/**
+    Weight update rule used by the neural network.
+
+    The optimizer state (velocity / first moment and second moment) is kept in
+    contiguous buffers which mirror the weights of the whole network: the weights
+    of every neuron are given an offset into these buffers, in layer then neuron order.
+
+    The gradient passed in follows the sign convention of the delta rule,
+    i.e. it is (t - y) * f'(net) * x and the weights move along it.
+*/
+class Optimizer
+{
+    public:
+        Optimizer();
+        ~Optimizer();
+
+        void setOptimizer(EOptimizer optimizer);
+        void initState(int parameterCount); // Allocates and clears the state buffers
+        void nextStep(); // Must be called once before the updates of every training step
+        void setTimeStep(int timeStep);
+        void update(float* weights, const float* gradient, int offset, int size, float learningRate);
+
+        // Updates only weights[indices[i]] with gradient[i], the other weights and their state are left as they are
+        void updateSparse(float* weights, const int* indices, const float* gradient, int count, int offset, int size, float learningRate);
+
+        int getParameterCount();
+
+        EOptimizer optimizerEnum; // Specifies the update rule to be used
+        float momentum; // MOMENTUM and NESTEROV
+        float decayRate; // RMSPROP
+        float beta1, beta2; // ADAM
+        float epsilon; // RMSPROP and ADAM
+
+        Matrix<float> firstMoment; // Velocity for the momentum methods, mean for ADAM
+        Matrix<float> secondMoment; // Mean of the squared gradient for RMSPROP and ADAM
+        int timeStep;
+
+    private:
+        // Adam bias correction for the current time step
+        float beta1Power, beta2Power;
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,207 @@
+#include "OutputRanking.h"
+#include <iostream>
+#include <algorithm>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+static const int TILE_SIZE = 8; // Samples ranked together by topK, one AVX register
+
+template <bool Maximum>
+static inline bool isBetter(float value, float best)
+{
+    return Maximum ? value > best : value < best;
+}
+
+template <bool Maximum>
+void OutputRanking::argExtreme(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values)
+{
+    int outputSize = outputs.getSizeX();
+    int batchSize = outputs.getSizeY();
+    indices.resize(batchSize);
+    values.resize(batchSize);
+    if (outputSize == 0)
+        return;
+
+    const float* array = outputs.getArrayRef();
+    int s = 0;
+#ifdef __AVX__
+    for (; s + 8 <= batchSize; s += 8)
+    {
+        __m256 best = _mm256_loadu_ps(array + s);
+        __m256 bestIndex = _mm256_setzero_ps(); // Integer indices kept in float registers for the blend
+        for (int j = 1; j < outputSize; j++)
+        {
+            __m256 value = _mm256_loadu_ps(array + (size_t) j * batchSize + s);
+            __m256 mask = Maximum ? _mm256_cmp_ps(value, best, _CMP_GT_OQ) : _mm256_cmp_ps(value, best, _CMP_LT_OQ);
+            best = _mm256_blendv_ps(best, value, mask);
+            bestIndex = _mm256_blendv_ps(bestIndex, _mm256_castsi256_ps(_mm256_set1_epi32(j)), mask);
+        }
+        _mm256_storeu_ps(values.data() + s, best);
+        _mm256_storeu_si256((__m256i*) (indices.data() + s), _mm256_castps_si256(bestIndex));
+    }
+#endif
+
+    // Remaining samples, row by row so the reads stay contiguous
+    for (int i = s; i < batchSize; i++)
+    {
+        values[i] = array[i];
+        indices[i] = 0;
+    }
+    for (int j = 1; j < outputSize && s < batchSize; j++)
+    {
+        const float* row = array + (size_t) j * batchSize;
+        for (int i = s; i < batchSize; i++)
+        {
+            if (isBetter<Maximum>(row[i], values[i]))
+            {
+                values[i] = row[i];
+                indices[i] = j;
+            }
+        }
+    }
+}
+
+void OutputRanking::argMax(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values)
+{
+    argExtreme<true>(outputs, indices, values);
+}
+
+void OutputRanking::argMin(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values)
+{
+    argExtreme<false>(outputs, indices, values);
+}
+
+
+// --------------------------------------- Top k ---------------------------------------
+/**
+    Min heap of the k best outputs of a sample, the root is the worst of them.
+    An equal value with a larger output index counts as worse.
+*/
+struct RankingHeap
+{
+    float* values;
+    int* indices;
+    int size;
+
+    static bool isWorse(float value1, int index1, float value2, int index2)
+    {
+        return value1 < value2 || (value1 == value2 && index1 > index2);
+    }
+
+    void siftDown(int i)
+    {
+        while (true)
+        {
+            int worst = i;
+            int left = 2 * i + 1, right = 2 * i + 2;
+            if (left < size && isWorse(values[left], indices[left], values[worst], indices[worst])) worst = left;
+            if (right < size && isWorse(values[right], indices[right], values[worst], indices[worst])) worst = right;
+            if (worst == i)
+                return;
+            std::swap(values[i], values[worst]);
+            std::swap(indices[i], indices[worst]);
+            i = worst;
+        }
+    }
+
+    void build()
+    {
+        for (int i = size / 2 - 1; i >= 0; i--)
+            siftDown(i);
+    }
+
+    void replaceRoot(float value, int index)
+    {
+        values[0] = value;
+        indices[0] = index;
+        siftDown(0);
+    }
+};
+
+void OutputRanking::topK(const Matrix<float>& outputs, int k, Matrix<int>& indices, Matrix<float>& values)
+{
+    int outputSize = outputs.getSizeX();
+    int batchSize = outputs.getSizeY();
+    if (k > outputSize)
+        k = outputSize;
+    if (k <= 0)
+    {
+        std::cout << "Output ranking: k must be larger than 0!" << std::endl;
+        return;
+    }
+
+    if (indices.getSizeX() != k || indices.getSizeY() != batchSize)
+        indices.setSize(k, batchSize);
+    if (values.getSizeX() != k || values.getSizeY() != batchSize)
+        values.setSize(k, batchSize);
+
+    const float* array = outputs.getArrayRef();
+    int* indexArray = indices.getArrayRef();
+    float* valueArray = values.getArrayRef();
+
+    std::vector<float> heapValues(TILE_SIZE * k);
+    std::vector<int> heapIndices(TILE_SIZE * k);
+    std::vector<std::pair<float, int>> ranking(k);
+    RankingHeap heaps[TILE_SIZE];
+    float thresholds[TILE_SIZE]; // Root value of every heap
+
+    for (int s = 0; s < batchSize; s += TILE_SIZE)
+    {
+        int tileSize = batchSize - s < TILE_SIZE ? batchSize - s : TILE_SIZE;
+
+        /// 1) The first k outputs fill the heaps
+        for (int t = 0; t < tileSize; t++)
+        {
+            heaps[t].values = heapValues.data() + t * k;
+            heaps[t].indices = heapIndices.data() + t * k;
+            heaps[t].size = k;
+            for (int j = 0; j < k; j++)
+            {
+                heaps[t].values[j] = array[(size_t) j * batchSize + s + t];
+                heaps[t].indices[j] = j;
+            }
+            heaps[t].build();
+            thresholds[t] = heaps[t].values[0];
+        }
+
+        /// 2) The remaining outputs only enter a heap if they beat its root
+        for (int j = k; j < outputSize; j++)
+        {
+            const float* row = array + (size_t) j * batchSize + s;
+            unsigned int mask = 0;
+#ifdef __AVX__
+            if (tileSize == TILE_SIZE)
+                mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row), _mm256_loadu_ps(thresholds), _CMP_GT_OQ));
+            else
+#endif
+            {
+                for (int t = 0; t < tileSize; t++)
+                    mask |= (unsigned int) (row[t] > thresholds[t]) << t;
+            }
+
+            while (mask != 0)
+            {
+                int t = __builtin_ctz(mask);
+                mask &= mask - 1;
+                heaps[t].replaceRoot(row[t], j);
+                thresholds[t] = heaps[t].values[0];
+            }
+        }
+
+        /// 3) Sort every heap, best first
+        for (int t = 0; t < tileSize; t++)
+        {
+            for (int r = 0; r < k; r++)
+                ranking[r] = std::make_pair(heaps[t].values[r], heaps[t].indices[r]);
+            std::sort(ranking.begin(), ranking.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b)
+                      { return RankingHeap::isWorse(b.first, b.second, a.first, a.second); });
+            for (int r = 0; r < k; r++)
+            {
+                valueArray[(size_t) r * batchSize + s + t] = ranking[r].first;
+                indexArray[(size_t) r * batchSize + s + t] = ranking[r].second;
+            }
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef OUTPUTRANKING_H
+#define OUTPUTRANKING_H
+
+#include <vector>
+#include "Matrix.h"
+
+/**
+    Per sample queries over a batch of network outputs.
+
+    The outputs are (outputSize, batch) as produced by NetworkSnapshot::predictBatch,
+    so every output row is contiguous over the samples: argmax and argmin compare
+    eight samples at a time with AVX and blend in the winning indices, and top-k
+    keeps a partial heap per sample which is only touched when a vector compare
+    against the current k-th best lets a value through.
+
+    Ties are resolved towards the lowest output index, as in the scalar getClassWithMaxResponse.
+*/
+class OutputRanking
+{
+    public:
+        static void argMax(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values);
+        static void argMin(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values);
+
+        // indices and values are (k, batch), row 0 holds the largest output of every sample
+        static void topK(const Matrix<float>& outputs, int k, Matrix<int>& indices, Matrix<float>& values);
+
+    private:
+        template <bool Maximum>
+        static void argExtreme(const Matrix<float>& outputs, std::vector<int>& indices, std::vector<float>& values);
+};
+
+#endif // OUTPUTRANKING_H
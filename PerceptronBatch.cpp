@@ -0,0 +1,282 @@
+#include "PerceptronBatch.h"
+#include "ActivationFunction.h"
+#include "Random.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+PerceptronBatch::PerceptronBatch()
+{
+    activationFunctionEnum = HEAVISIDE;
+    numberOfThreads = 1;
+}
+
+PerceptronBatch::PerceptronBatch(int numberOfNeurons, int featureSize)
+{
+    activationFunctionEnum = HEAVISIDE;
+    numberOfThreads = 1;
+    setSize(numberOfNeurons, featureSize);
+}
+
+PerceptronBatch::~PerceptronBatch()
+{
+
+}
+
+void PerceptronBatch::setSize(int numberOfNeurons, int featureSize)
+{
+    weightMatrix.setSize(featureSize + 1, numberOfNeurons);
+    fillWeightMatrixRandomly(-100, 100); // Same initialisation as a single neuron
+}
+
+void PerceptronBatch::fillWeightMatrixRandomly(int minValue, int maxValue)
+{
+    // The rows after the biases are contiguous, fill them in one go
+    int numberOfNeurons = getNumberOfNeurons();
+    float* weights = weightMatrix.getArrayRef();
+    for (int n = 0; n < numberOfNeurons; n++)
+        weights[n] = 1;
+    Random::getThreadGenerator().fillUniform(weights + numberOfNeurons, (long long) getFeatureSize() * numberOfNeurons, minValue, maxValue);
+}
+
+int PerceptronBatch::getNumberOfNeurons()
+{
+    return weightMatrix.getSizeY();
+}
+
+int PerceptronBatch::getFeatureSize()
+{
+    return weightMatrix.getSizeX() - 1;
+}
+
+bool PerceptronBatch::checkParameters(Matrix<float> &featureMatrix, const char* name)
+{
+    if (featureMatrix.getSizeX() != getFeatureSize())
+    {
+        std::cout << name << ": The feature dimensionality size in the feature matrix must equal to the weight matrix size!" << std::endl;
+        return false;
+    }
+
+    if (featureMatrix.getSizeX() <= 0 || getNumberOfNeurons() <= 0)
+    {
+        std::cout << name << ": The feature dimension and the number of neurons must be larger than 0 for learning to occur!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PerceptronBatch::deltaLearning(Matrix<float> &featureMatrix, Matrix<float> &classificationMatrix, int epoch, float learningRate)
+{
+    if (!checkParameters(featureMatrix, "Batched delta learning"))
+        return;
+
+    if (classificationMatrix.getSizeX() != getNumberOfNeurons() || classificationMatrix.getSizeY() != featureMatrix.getSizeY())
+    {
+        std::cout << "Batched delta learning: The classification matrix must hold one target per neuron for every sample in the feature matrix!" << std::endl;
+        return;
+    }
+
+    learn(featureMatrix, &classificationMatrix, epoch, learningRate);
+}
+
+void PerceptronBatch::hebbianLearning(Matrix<float> &featureMatrix, int epoch, float learningRate)
+{
+    if (!checkParameters(featureMatrix, "Batched hebbian learning"))
+        return;
+
+    learn(featureMatrix, nullptr, epoch, learningRate);
+}
+
+/**
+    Spreads the neuron groups across the threads.
+    Without a classification matrix the hebbian rule is used.
+*/
+void PerceptronBatch::learn(Matrix<float> &featureMatrix, Matrix<float>* classificationMatrix, int epoch, float learningRate)
+{
+    int numberOfNeurons = getNumberOfNeurons();
+    int numberOfSamples = featureMatrix.getSizeY();
+
+    // Reorder the targets so that the targets of one sample are contiguous, like the weights
+    std::vector<float> targets;
+    if (classificationMatrix != nullptr)
+    {
+        targets.resize((size_t) numberOfSamples * numberOfNeurons);
+        for (int n = 0; n < numberOfNeurons; n++)
+            for (int j = 0; j < numberOfSamples; j++)
+                targets[(size_t) j * numberOfNeurons + n] = (*classificationMatrix)[n][j];
+    }
+    const float* targetArray = classificationMatrix != nullptr ? targets.data() : nullptr;
+    const float* features = featureMatrix.getArrayRef();
+    float* weights = weightMatrix.getArrayRef();
+
+    // Split the neurons into groups of whole cache lines
+    int threads = numberOfThreads < 1 ? 1 : numberOfThreads;
+    int groupSize = (numberOfNeurons + threads - 1) / threads;
+    groupSize = (groupSize + 15) / 16 * 16;
+    if (groupSize >= numberOfNeurons)
+    {
+        // A single group is trained in place
+        (this->*getLearnGroup())(features, numberOfSamples, targetArray, weights, numberOfNeurons, 0, numberOfNeurons, epoch, learningRate);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int first = groupSize; first < numberOfNeurons; first += groupSize)
+    {
+        int last = first + groupSize < numberOfNeurons ? first + groupSize : numberOfNeurons;
+        workers.push_back(std::thread(&PerceptronBatch::trainGroup, this, features, numberOfSamples, targetArray, weights, first, last, epoch, learningRate));
+    }
+
+    // The first group is trained on the calling thread
+    trainGroup(features, numberOfSamples, targetArray, weights, 0, groupSize, epoch, learningRate);
+    for (int i = 0; i < (int) workers.size(); i++)
+        workers[i].join();
+}
+
+/**
+    Trains the neurons [firstNeuron, lastNeuron) on a copy of their weights whose rows
+    are padded to whole cache lines, so no two threads ever write the same line
+*/
+void PerceptronBatch::trainGroup(const float* features, int numberOfSamples, const float* targets, float* weights,
+                                 int firstNeuron, int lastNeuron, int epoch, float learningRate)
+{
+    int numberOfNeurons = getNumberOfNeurons();
+    int groupSize = lastNeuron - firstNeuron;
+    int stride = (groupSize + 15) / 16 * 16;
+    int rows = getFeatureSize() + 1;
+
+    Matrix<float> groupWeightMatrix(rows, stride);
+    float* groupWeights = groupWeightMatrix.getArrayRef();
+    for (int k = 0; k < rows; k++)
+        std::copy_n(weights + (size_t) k * numberOfNeurons + firstNeuron, groupSize, groupWeights + (size_t) k * stride);
+
+    (this->*getLearnGroup())(features, numberOfSamples, targets, groupWeights, stride, firstNeuron, groupSize, epoch, learningRate);
+
+    for (int k = 0; k < rows; k++)
+        std::copy_n(groupWeights + (size_t) k * stride, groupSize, weights + (size_t) k * numberOfNeurons + firstNeuron);
+}
+
+PerceptronBatch::LearnGroupFunction PerceptronBatch::getLearnGroup()
+{
+    switch (activationFunctionEnum)
+    {
+        case HEAVISIDE: return &PerceptronBatch::learnGroup<HEAVISIDE>;
+        case LOGISTIC: return &PerceptronBatch::learnGroup<LOGISTIC>;
+        case SOFTMAX: return &PerceptronBatch::learnGroup<SOFTMAX>;
+        case TANH: return &PerceptronBatch::learnGroup<TANH>;
+        case TANH01: return &PerceptronBatch::learnGroup<TANH01>;
+        case RECTIFIED_LINEAR_UNIT: return &PerceptronBatch::learnGroup<RECTIFIED_LINEAR_UNIT>;
+        case ARCTAN: return &PerceptronBatch::learnGroup<ARCTAN>;
+        case ARCTAN01: return &PerceptronBatch::learnGroup<ARCTAN01>;
+        case SYMMETRICAL_HARD_LIMIT: return &PerceptronBatch::learnGroup<SYMMETRICAL_HARD_LIMIT>;
+        case SINUSOID: return &PerceptronBatch::learnGroup<SINUSOID>;
+        case SINUSOID01: return &PerceptronBatch::learnGroup<SINUSOID01>;
+        case GAUSSIAN: return &PerceptronBatch::learnGroup<GAUSSIAN>;
+        default: return &PerceptronBatch::learnGroup<LINEAR>; // Like activate
+    }
+}
+
+/**
+    Trains groupSize neurons in lockstep, row k of their weights starts at weights + k * stride
+*/
+template <EActivationFunction Function>
+void PerceptronBatch::learnGroup(const float* features, int numberOfSamples, const float* targets, float* weights, int stride,
+                                 int firstNeuron, int groupSize, int epoch, float learningRate)
+{
+    int numberOfNeurons = getNumberOfNeurons();
+    int featureDimension = getFeatureSize();
+
+    std::vector<float> netInputs(groupSize);
+    std::vector<float> factors(groupSize);
+    float* __restrict net = netInputs.data();
+    float* __restrict factor = factors.data();
+
+    for (int i = 0; i < epoch; i++)
+    {
+        // Loop through every single data sample
+        for (int j = 0; j < numberOfSamples; j++)
+        {
+            // Calculate the net input of every neuron: bias + sum(w * x)
+            const float* __restrict bias = weights;
+            for (int n = 0; n < groupSize; n++)
+                net[n] = bias[n];
+            for (int k = 0; k < featureDimension; k++)
+            {
+                const float* __restrict row = weights + (size_t) (k + 1) * stride;
+                float x = features[(size_t) k * numberOfSamples + j];
+                for (int n = 0; n < groupSize; n++)
+                    net[n] += row[n] * x;
+            }
+
+            // Delta update rule: n(t - y), hebbian update rule: ny
+            if (targets != nullptr)
+            {
+                const float* target = targets + (size_t) j * numberOfNeurons + firstNeuron;
+                for (int n = 0; n < groupSize; n++)
+                    factor[n] = learningRate * (target[n] - activate(Function, net[n]));
+            }
+            else
+            {
+                for (int n = 0; n < groupSize; n++)
+                    factor[n] = learningRate * activate(Function, net[n]);
+            }
+
+            // Update the weights: w = w + factor * x
+            float* __restrict biasRow = weights;
+            for (int n = 0; n < groupSize; n++)
+                biasRow[n] += factor[n];
+            for (int k = 0; k < featureDimension; k++)
+            {
+                float* __restrict row = weights + (size_t) (k + 1) * stride;
+                float x = features[(size_t) k * numberOfSamples + j];
+                for (int n = 0; n < groupSize; n++)
+                    row[n] += factor[n] * x;
+            }
+        }
+    }
+}
+
+void PerceptronBatch::predict(Matrix<float>& dataPoint, Array<float>& responses)
+{
+    if (dataPoint.getSizeX() != getFeatureSize())
+    {
+        std::cout << "Incorrect number of feature dimension entered for data point. Got " << dataPoint.getSizeX() << ". Expected " << getFeatureSize() << std::endl;
+        return;
+    }
+
+    int numberOfNeurons = getNumberOfNeurons();
+    if (responses.size() != numberOfNeurons)
+        responses.setSize(numberOfNeurons);
+
+    for (int n = 0; n < numberOfNeurons; n++)
+        responses[n] = weightMatrix[0][n];
+    for (int k = 0; k < getFeatureSize(); k++)
+    {
+        float x = dataPoint[k][0];
+        for (int n = 0; n < numberOfNeurons; n++)
+            responses[n] += weightMatrix[k + 1][n] * x;
+    }
+    for (int n = 0; n < numberOfNeurons; n++)
+        responses[n] = activate(activationFunctionEnum, responses[n]);
+}
+
+void PerceptronBatch::setNeuron(int index, Neuron& neuron)
+{
+    if (neuron.weightMatrix.getSizeX() != weightMatrix.getSizeX())
+    {
+        std::cout << "Perceptron batch: The neuron has a different feature size than the batch!" << std::endl;
+        return;
+    }
+
+    for (int k = 0; k < weightMatrix.getSizeX(); k++)
+        weightMatrix[k][index] = neuron.weightMatrix[k][0];
+}
+
+void PerceptronBatch::getNeuron(int index, Neuron& neuron)
+{
+    neuron.initWeightMatrix(getFeatureSize());
+    neuron.activationFunctionEnum = activationFunctionEnum;
+    for (int k = 0; k < weightMatrix.getSizeX(); k++)
+        neuron.weightMatrix[k][0] = weightMatrix[k][index];
+}
@@ -0,0 +1,61 @@
+#ifndef PERCEPTRONBATCH_H
+#define PERCEPTRONBATCH_H
+
+#include "Matrix.h"
+#include "Array.h"
+#include "Neuron.h"
+#include "EActivationFunction.h"
+
+/**
+    Trains many independent perceptrons over the same feature matrix at once.
+
+    The weights are stored structure-of-arrays: row k of the weight matrix holds
+    weight k of every neuron, so for each data sample the inner loops run over
+    contiguous neurons and are vectorized by the compiler. Every sample is read
+    once for all neurons instead of once per neuron.
+
+    Groups of neurons can be trained on separate threads, each on its own copy of
+    the group's weights padded to whole cache lines. All neurons share the same
+    activation function, use one batch per activation function otherwise.
+*/
+class PerceptronBatch
+{
+    public:
+        PerceptronBatch();
+        PerceptronBatch(int numberOfNeurons, int featureSize);
+        ~PerceptronBatch();
+
+        void setSize(int numberOfNeurons, int featureSize); // Initialises the weights randomly
+        void fillWeightMatrixRandomly(int minValue, int maxValue);
+
+        // classificationMatrix is (numberOfNeurons, numberOfSamples), one target per neuron and sample
+        void deltaLearning(Matrix<float> &featureMatrix, Matrix<float> &classificationMatrix, int epoch, float learningRate);
+        void hebbianLearning(Matrix<float> &featureMatrix, int epoch, float learningRate);
+        void predict(Matrix<float>& dataPoint, Array<float>& responses); // Predicts the response of every neuron
+
+        // Conversion from and to single neurons
+        void setNeuron(int index, Neuron& neuron);
+        void getNeuron(int index, Neuron& neuron);
+
+        int getNumberOfNeurons();
+        int getFeatureSize();
+
+        EActivationFunction activationFunctionEnum; // Specifies the learning response function of every neuron
+        int numberOfThreads; // Number of threads the neuron groups are spread across
+        Matrix<float> weightMatrix; // (featureSize + 1, numberOfNeurons), row 0 holds the biases
+
+    private:
+        bool checkParameters(Matrix<float> &featureMatrix, const char* name);
+        void learn(Matrix<float> &featureMatrix, Matrix<float>* classificationMatrix, int epoch, float learningRate);
+        void trainGroup(const float* features, int numberOfSamples, const float* targets, float* weights,
+                        int firstNeuron, int lastNeuron, int epoch, float learningRate);
+
+        // The lockstep kernel, one instance per activation function so the per neuron loops have no switch
+        template <EActivationFunction Function>
+        void learnGroup(const float* features, int numberOfSamples, const float* targets, float* weights, int stride,
+                        int firstNeuron, int groupSize, int epoch, float learningRate);
+        typedef void (PerceptronBatch::*LearnGroupFunction)(const float*, int, const float*, float*, int, int, int, int, float);
+        LearnGroupFunction getLearnGroup();
+};
+
+#endif // PERCEPTRONBATCH_H
@@ -0,0 +1,469 @@
+#include "PipelineTrainer.h"
+#include "NeuralNetwork.h"
+#include "NetworkSnapshot.h"
+#include "SpscQueue.h"
+#include "Random.h"
+#include <iostream>
+#include <thread>
+#include <deque>
+#include <algorithm>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+/**
+    A micro-batch travelling through the pipeline. Forward it carries the
+    activations of the previous stage, backward the error of the stage outputs.
+*/
+struct PipelineMicroBatch
+{
+    long long miniBatch = -1; // -1 tells the stages to stop
+    int epoch = 0;
+    int microBatchesInMiniBatch = 0;
+    int miniBatchSamples = 0;
+    Matrix<float> data; // (features, samples)
+    Matrix<float> targets; // (outputSize, samples), only read by the last stage
+};
+
+/**
+    A group of consecutive layers and the thread running them
+*/
+class PipelineStage
+{
+    public:
+        void run();
+
+        int index;
+        int numberOfStages;
+        bool isFirst, isLast;
+        std::vector<int> inputSizes, sizes; // Per layer of the stage
+        std::vector<EActivationFunction> activationFunctions;
+        std::vector<float> weights; // Flat, layer by layer as in a NetworkSnapshot
+        std::vector<float> gradient;
+        Optimizer optimizer;
+        float learningRate;
+
+        SpscQueue<PipelineMicroBatch>* forwardIn = nullptr;
+        SpscQueue<PipelineMicroBatch>* forwardOut = nullptr;
+        SpscQueue<PipelineMicroBatch>* backwardIn = nullptr;
+        SpscQueue<PipelineMicroBatch>* backwardOut = nullptr;
+
+        std::vector<double> squaredErrors; // Per epoch, last stage only
+        std::vector<long long> sampleCounts;
+
+    private:
+        // What the backward pass of a micro-batch needs from its forward pass
+        struct Stash
+        {
+            PipelineMicroBatch header;
+            std::vector<Matrix<float>> inputs; // Per layer, (inputSize, samples)
+            std::vector<Matrix<float>> netInputs; // Per layer, (size, samples)
+        };
+
+        void forward(PipelineMicroBatch& microBatch);
+        void backward(Matrix<float>& error);
+        void update(const PipelineMicroBatch& header);
+        void addLoss(const PipelineMicroBatch& microBatch, const Matrix<float>& output, Matrix<float>& error);
+
+        std::deque<Stash> stashes; // Micro-batches in flight, oldest first
+        long long currentMiniBatch = 0; // The mini-batch gradients are accumulated for
+        int backwardsDone = 0;
+};
+
+template <class T>
+static void pushWaiting(SpscQueue<T>* queue, T&& value)
+{
+    while (!queue->tryPush(std::move(value)))
+        std::this_thread::yield();
+}
+
+static int getLayerWeightCount(const PipelineStage& stage, int layer)
+{
+    return stage.sizes[layer] * (stage.inputSizes[layer] + 1);
+}
+
+
+// --------------------------------------- Pipeline Stage ---------------------------------------
+void PipelineStage::run()
+{
+    int maxInFlight = numberOfStages - index;
+    while (true)
+    {
+        // Backward work first, it frees the stashed activations
+        PipelineMicroBatch microBatch;
+        if (!isLast && !stashes.empty() && backwardIn->tryPop(microBatch))
+        {
+            backward(microBatch.data);
+            continue;
+        }
+
+        PipelineMicroBatch* next = forwardIn->peek();
+        if (next != nullptr && next->miniBatch < 0 && stashes.empty())
+        {
+            // Stop once everything in flight came back
+            forwardIn->tryPop(microBatch);
+            if (!isLast)
+                pushWaiting(forwardOut, std::move(microBatch));
+            return;
+        }
+
+        // A new mini-batch has to wait for the update of the previous one
+        if (next != nullptr && next->miniBatch == currentMiniBatch && (int) stashes.size() < maxInFlight)
+        {
+            forwardIn->tryPop(microBatch);
+            forward(microBatch);
+            continue;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void PipelineStage::forward(PipelineMicroBatch& microBatch)
+{
+    int batchSize = microBatch.data.getSizeY();
+    stashes.emplace_back();
+    Stash& stash = stashes.back();
+    stash.inputs.resize(sizes.size());
+    stash.netInputs.resize(sizes.size());
+
+    const float* layerWeights = weights.data();
+    Matrix<float> input = microBatch.data;
+    for (int layer = 0; layer < (int) sizes.size(); layer++)
+    {
+        Matrix<float> output(sizes[layer], batchSize);
+        stash.netInputs[layer].setSize(sizes[layer], batchSize);
+        const Matrix<float>& layerInput = input; // Read only, the buffer is shared with the stash
+        NeuralNetworkLayer::forwardBatch(layerWeights, inputSizes[layer], sizes[layer], activationFunctions[layer],
+                                         layerInput.getArrayRef(), batchSize, stash.netInputs[layer].getArrayRef(), output.getArrayRef());
+        stash.inputs[layer] = input; // Shared, not copied
+        input = output;
+        layerWeights += getLayerWeightCount(*this, layer);
+    }
+
+    stash.header.miniBatch = microBatch.miniBatch;
+    stash.header.epoch = microBatch.epoch;
+    stash.header.microBatchesInMiniBatch = microBatch.microBatchesInMiniBatch;
+    stash.header.miniBatchSamples = microBatch.miniBatchSamples;
+
+    if (isLast)
+    {
+        // The loss turns straight around into the backward pass
+        Matrix<float> error;
+        addLoss(microBatch, input, error);
+        backward(error);
+    }
+    else
+    {
+        microBatch.data = input;
+        pushWaiting(forwardOut, std::move(microBatch));
+    }
+}
+
+void PipelineStage::addLoss(const PipelineMicroBatch& microBatch, const Matrix<float>& output, Matrix<float>& error)
+{
+    // Error in the delta rule direction: (t - y)
+    error.setSize(output.getSizeX(), output.getSizeY());
+    const float* outputArray = output.getArrayRef();
+    const float* targetArray = microBatch.targets.getArrayRef();
+    float* errorArray = error.getArrayRef();
+    double squaredError = 0;
+    for (int i = 0; i < output.getSize(); i++)
+    {
+        errorArray[i] = targetArray[i] - outputArray[i];
+        squaredError += errorArray[i] * errorArray[i];
+    }
+
+    if ((int) squaredErrors.size() <= microBatch.epoch)
+    {
+        squaredErrors.resize(microBatch.epoch + 1, 0);
+        sampleCounts.resize(microBatch.epoch + 1, 0);
+    }
+    squaredErrors[microBatch.epoch] += squaredError;
+    sampleCounts[microBatch.epoch] += output.getSizeY();
+}
+
+void PipelineStage::backward(Matrix<float>& error)
+{
+    Stash& stash = stashes.front();
+    int batchSize = error.getSizeY();
+
+    // Offset of the last layer of the stage
+    size_t offset = weights.size();
+    Matrix<float> inputError;
+    for (int layer = sizes.size() - 1; layer >= 0; layer--)
+    {
+        offset -= getLayerWeightCount(*this, layer);
+        bool propagate = layer > 0 || !isFirst; // The error of the network inputs is of no use
+        if (propagate)
+            inputError.setSize(inputSizes[layer], batchSize);
+        const Stash& layerStash = stash;
+        NeuralNetworkLayer::backwardBatch(weights.data() + offset, inputSizes[layer], sizes[layer], activationFunctions[layer],
+                                          layerStash.inputs[layer].getArrayRef(), layerStash.netInputs[layer].getArrayRef(),
+                                          error.getArrayRef(), batchSize, gradient.data() + offset,
+                                          propagate ? inputError.getArrayRef() : nullptr);
+        error = inputError;
+        inputError = Matrix<float>(); // The error now owns the buffer
+    }
+
+    PipelineMicroBatch header = std::move(stash.header);
+    stashes.pop_front();
+    if (!isFirst)
+    {
+        PipelineMicroBatch microBatch = header;
+        microBatch.data = error;
+        pushWaiting(backwardOut, std::move(microBatch));
+    }
+
+    backwardsDone++;
+    if (backwardsDone == header.microBatchesInMiniBatch)
+        update(header);
+}
+
+void PipelineStage::update(const PipelineMicroBatch& header)
+{
+    // Average over the mini-batch, then apply the update rule to the whole stage at once
+    float scale = 1.0f / header.miniBatchSamples;
+    for (int i = 0; i < (int) gradient.size(); i++)
+        gradient[i] *= scale;
+
+    optimizer.nextStep();
+    optimizer.update(weights.data(), gradient.data(), 0, weights.size(), learningRate);
+    std::fill(gradient.begin(), gradient.end(), 0.0f);
+
+    currentMiniBatch++;
+    backwardsDone = 0;
+}
+
+
+// --------------------------------------- Pipeline Trainer ---------------------------------------
+PipelineTrainer::PipelineTrainer(NeuralNetwork& _network, int _numberOfStages)
+{
+    network = &_network;
+    numberOfStages = _numberOfStages;
+    miniBatchSize = 64;
+    microBatchSize = 16;
+    pinThreads = false;
+}
+
+PipelineTrainer::~PipelineTrainer()
+{
+
+}
+
+/**
+    Splits the layers into contiguous groups with the largest group (in weights)
+    as small as possible
+*/
+std::vector<int> PipelineTrainer::getStageBoundaries()
+{
+    int numberOfLayers = network->layers.size() - 1;
+    int stages = std::max(1, std::min(numberOfStages, numberOfLayers));
+    std::vector<long long> prefix(numberOfLayers + 1, 0);
+    for (int i = 0; i < numberOfLayers; i++)
+        prefix[i + 1] = prefix[i] + (long long) network->layers[i + 1].size() * (network->layers[i].size() + 1);
+
+    // cost[s][i]: smallest largest group splitting the first i layers into s groups
+    const long long INFINITE = 0x7FFFFFFFFFFFFFFFLL;
+    std::vector<std::vector<long long>> cost(stages + 1, std::vector<long long>(numberOfLayers + 1, INFINITE));
+    std::vector<std::vector<int>> split(stages + 1, std::vector<int>(numberOfLayers + 1, 0));
+    cost[0][0] = 0;
+    for (int s = 1; s <= stages; s++)
+    {
+        for (int i = s; i <= numberOfLayers; i++)
+        {
+            for (int j = s - 1; j < i; j++)
+            {
+                if (cost[s - 1][j] == INFINITE)
+                    continue;
+                long long largest = std::max(cost[s - 1][j], prefix[i] - prefix[j]);
+                if (largest < cost[s][i])
+                {
+                    cost[s][i] = largest;
+                    split[s][i] = j;
+                }
+            }
+        }
+    }
+
+    std::vector<int> boundaries(stages + 1);
+    boundaries[stages] = numberOfLayers + 1;
+    for (int s = stages, i = numberOfLayers; s > 0; s--)
+    {
+        i = split[s][i];
+        boundaries[s - 1] = i + 1; // Layer indices of the network start after the input layer
+    }
+    return boundaries;
+}
+
+std::vector<float> PipelineTrainer::getEpochLosses()
+{
+    return epochLosses;
+}
+
+void PipelineTrainer::train(const Matrix<float>& dataSamples, const Matrix<float>& targets, int epochs)
+{
+    /// 1) Check the parameters and copy the weights out of the network
+    NetworkSnapshot snapshot;
+    if (!snapshot.capture(*network))
+    {
+        std::cout << "Pipeline trainer: Only fully connected networks can be trained!" << std::endl;
+        return;
+    }
+
+    if (dataSamples.getSizeX() != snapshot.getInputSize() || targets.getSizeX() != snapshot.getOutputSize()
+        || dataSamples.getSizeY() != targets.getSizeY())
+    {
+        std::cout << "Pipeline trainer: The samples or the targets do not match the network!" << std::endl;
+        return;
+    }
+
+    if (miniBatchSize < 1 || microBatchSize < 1)
+    {
+        std::cout << "Pipeline trainer: The mini-batch and micro-batch sizes must be larger than 0!" << std::endl;
+        return;
+    }
+
+    /// 2) Build the stages and the queues between them
+    std::vector<int> boundaries = getStageBoundaries();
+    int stages = boundaries.size() - 1;
+    std::vector<PipelineStage> pipeline(stages);
+
+    // A stage never has more messages outstanding than it has micro-batches in flight
+    int capacity = stages + 2;
+    std::vector<SpscQueue<PipelineMicroBatch>*> forwardQueues, backwardQueues;
+    for (int s = 0; s < stages; s++)
+    {
+        forwardQueues.push_back(new SpscQueue<PipelineMicroBatch>(capacity));
+        backwardQueues.push_back(new SpscQueue<PipelineMicroBatch>(capacity));
+    }
+
+    const float* weights = snapshot.weights.data();
+    for (int s = 0; s < stages; s++)
+    {
+        PipelineStage& stage = pipeline[s];
+        stage.index = s;
+        stage.numberOfStages = stages;
+        stage.isFirst = s == 0;
+        stage.isLast = s == stages - 1;
+        for (int layer = boundaries[s]; layer < boundaries[s + 1]; layer++)
+        {
+            stage.inputSizes.push_back(snapshot.layerSizes[layer - 1]);
+            stage.sizes.push_back(snapshot.layerSizes[layer]);
+            stage.activationFunctions.push_back(snapshot.activationFunctions[layer - 1]);
+        }
+
+        int weightCount = 0;
+        for (int layer = 0; layer < (int) stage.sizes.size(); layer++)
+            weightCount += getLayerWeightCount(stage, layer);
+        stage.weights.assign(weights, weights + weightCount);
+        stage.gradient.assign(weightCount, 0.0f);
+        weights += weightCount;
+
+        stage.optimizer = network->optimizer;
+        stage.optimizer.initState(weightCount);
+        stage.learningRate = network->learningRate;
+
+        // Forward queue s feeds stage s, backward queue s is written by stage s + 1
+        stage.forwardIn = forwardQueues[s];
+        stage.forwardOut = stage.isLast ? nullptr : forwardQueues[s + 1];
+        stage.backwardIn = stage.isLast ? nullptr : backwardQueues[s];
+        stage.backwardOut = stage.isFirst ? nullptr : backwardQueues[s - 1];
+    }
+
+    /// 3) Run the stages while the calling thread feeds the micro-batches
+    std::vector<std::thread> threads;
+    for (int s = 0; s < stages; s++)
+    {
+        threads.push_back(std::thread(&PipelineStage::run, &pipeline[s]));
+#ifdef __linux__
+        if (pinThreads)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(s % std::max(1u, std::thread::hardware_concurrency()), &cpuSet);
+            pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpuSet), &cpuSet);
+        }
+#endif
+    }
+
+    feed(dataSamples, targets, epochs, pipeline[0]);
+    for (int s = 0; s < stages; s++)
+        threads[s].join();
+
+    /// 4) Copy the weights back into the network
+    float* target = snapshot.weights.data();
+    for (int s = 0; s < stages; s++)
+    {
+        memcpy(target, pipeline[s].weights.data(), sizeof(float) * pipeline[s].weights.size());
+        target += pipeline[s].weights.size();
+    }
+    snapshot.restore(*network);
+
+    PipelineStage& lastStage = pipeline[stages - 1];
+    epochLosses.clear();
+    for (int i = 0; i < (int) lastStage.squaredErrors.size(); i++)
+        epochLosses.push_back(lastStage.squaredErrors[i] / (lastStage.sampleCounts[i] * snapshot.getOutputSize()));
+
+    for (int s = 0; s < stages; s++)
+    {
+        delete forwardQueues[s];
+        delete backwardQueues[s];
+    }
+}
+
+void PipelineTrainer::feed(const Matrix<float>& dataSamples, const Matrix<float>& targets, int epochs, PipelineStage& firstStage)
+{
+    int numberOfSamples = dataSamples.getSizeY();
+    int inputSize = dataSamples.getSizeX();
+    int outputSize = targets.getSizeX();
+    const float* sampleArray = dataSamples.getArrayRef();
+    const float* targetArray = targets.getArrayRef();
+
+    std::vector<int> order(numberOfSamples);
+    long long miniBatch = 0;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        // Same sample order as backpropagationStochastic
+        for (int i = 0; i < numberOfSamples; i++)
+            order[i] = i;
+        Random random(network->shuffleSeed, epoch);
+        for (int i = order.size() - 1; i > 0; i--)
+            std::swap(order[i], order[random.nextInt(i + 1)]);
+
+        for (int start = 0; start < numberOfSamples; start += miniBatchSize, miniBatch++)
+        {
+            int miniBatchSamples = std::min(miniBatchSize, numberOfSamples - start);
+            int microBatches = (miniBatchSamples + microBatchSize - 1) / microBatchSize;
+            for (int m = 0; m < microBatches; m++)
+            {
+                int first = start + m * microBatchSize;
+                int size = std::min(microBatchSize, start + miniBatchSamples - first);
+
+                // Gather the samples of the micro-batch
+                PipelineMicroBatch microBatch;
+                microBatch.miniBatch = miniBatch;
+                microBatch.epoch = epoch;
+                microBatch.microBatchesInMiniBatch = microBatches;
+                microBatch.miniBatchSamples = miniBatchSamples;
+                microBatch.data.setSize(inputSize, size);
+                microBatch.targets.setSize(outputSize, size);
+                float* data = microBatch.data.getArrayRef();
+                float* target = microBatch.targets.getArrayRef();
+                for (int k = 0; k < inputSize; k++)
+                    for (int s = 0; s < size; s++)
+                        data[k * size + s] = sampleArray[(size_t) k * numberOfSamples + order[first + s]];
+                for (int k = 0; k < outputSize; k++)
+                    for (int s = 0; s < size; s++)
+                        target[k * size + s] = targetArray[(size_t) k * numberOfSamples + order[first + s]];
+
+                pushWaiting(firstStage.forwardIn, std::move(microBatch));
+            }
+        }
+    }
+
+    PipelineMicroBatch stop;
+    pushWaiting(firstStage.forwardIn, std::move(stop));
+}
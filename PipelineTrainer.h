@@ -0,0 +1,51 @@
+#ifndef PIPELINETRAINER_H
+#define PIPELINETRAINER_H
+
+#include <vector>
+#include "Matrix.h"
+
+class NeuralNetwork;
+class PipelineStage;
+
+/**
+    Trains a deep network with its layers split into pipeline stages.
+
+    Every stage owns a contiguous group of layers and runs on a thread of its own
+    with a private copy of its weights, so each core only ever touches the weights
+    of its own stage. Mini-batches are split into micro-batches which stream
+    forward through the stages and back again over bounded lock-free single
+    producer single consumer queues. A stage keeps at most (numberOfStages - stage)
+    micro-batches in flight and prefers backward work (one forward one backward),
+    and it applies its update once all micro-batches of the mini-batch came back.
+
+    The result is therefore mini-batch gradient descent, the same for any number
+    of stages. The weight update follows network.optimizer (its settings, the
+    state is kept per stage) and network.learningRate, the gradient is averaged
+    over the mini-batch. Every epoch visits the samples in the order given by
+    network.shuffleSeed, as backpropagationStochastic does.
+*/
+class PipelineTrainer
+{
+    public:
+        PipelineTrainer(NeuralNetwork& network, int numberOfStages = 2);
+        ~PipelineTrainer();
+
+        // dataSamples is (inputSize, numberOfSamples), targets is (outputSize, numberOfSamples)
+        void train(const Matrix<float>& dataSamples, const Matrix<float>& targets, int epochs);
+
+        std::vector<int> getStageBoundaries(); // First layer of every stage, followed by the number of layers
+        std::vector<float> getEpochLosses(); // Training mean squared error of every epoch of the last call to train
+
+        int numberOfStages; // Limited to the number of layers after the input layer
+        int miniBatchSize; // Samples per weight update
+        int microBatchSize; // Samples per pipeline message
+        bool pinThreads; // Pins the stage threads to separate cores
+
+    private:
+        void feed(const Matrix<float>& dataSamples, const Matrix<float>& targets, int epochs, PipelineStage& firstStage);
+
+        NeuralNetwork* network;
+        std::vector<float> epochLosses;
+};
+
+#endif // PIPELINETRAINER_H
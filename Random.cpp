@@ -0,0 +1,275 @@
+#include "Random.h"
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Philox4x32 multipliers and Weyl sequence constants
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+static const float UNIT_SCALE = 1.0f / 16777216.0f; // 24 random bits to [0, 1)
+static const float TWO_PI = 6.28318530717958647692f;
+static const int CHUNK_SIZE = 1024; // Numbers generated at a time by the bulk functions
+
+/**
+    One block of four numbers, counter = (block, stream), key = seed
+*/
+static void philoxBlock(uint64_t seed, uint64_t stream, uint64_t block, uint32_t* output)
+{
+    uint32_t c0 = (uint32_t) block, c1 = (uint32_t) (block >> 32);
+    uint32_t c2 = (uint32_t) stream, c3 = (uint32_t) (stream >> 32);
+    uint32_t k0 = (uint32_t) seed, k1 = (uint32_t) (seed >> 32);
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+}
+
+#ifdef __AVX2__
+// 32 bit multiplication of every lane giving the high and the low halves
+static inline void multiplyHighLow(__m256i a, __m256i multiplier, __m256i& high, __m256i& low)
+{
+    __m256i even = _mm256_mul_epu32(a, multiplier);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), multiplier);
+    low = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    high = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/**
+    Eight consecutive blocks at once, one block per lane. The block index must not
+    carry into its upper 32 bits within the eight blocks.
+*/
+static void philoxBlocks8(uint64_t seed, uint64_t stream, uint64_t block, uint32_t* output)
+{
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((uint32_t) block), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i c1 = _mm256_set1_epi32((uint32_t) (block >> 32));
+    __m256i c2 = _mm256_set1_epi32((uint32_t) stream);
+    __m256i c3 = _mm256_set1_epi32((uint32_t) (stream >> 32));
+    __m256i m0 = _mm256_set1_epi32(PHILOX_M0);
+    __m256i m1 = _mm256_set1_epi32(PHILOX_M1);
+    uint32_t k0 = (uint32_t) seed, k1 = (uint32_t) (seed >> 32);
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        __m256i high0, low0, high1, low1;
+        multiplyHighLow(c0, m0, high0, low0);
+        multiplyHighLow(c2, m1, high1, low1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(high1, c1), _mm256_set1_epi32(k0));
+        c1 = low1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(high0, c3), _mm256_set1_epi32(k1));
+        c3 = low0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    // Transpose the lanes back to block order
+    __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+    __m256i t1 = _mm256_unpackhi_epi32(c0, c1);
+    __m256i t2 = _mm256_unpacklo_epi32(c2, c3);
+    __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    _mm256_storeu_si256((__m256i*) output, _mm256_permute2x128_si256(u0, u1, 0x20));
+    _mm256_storeu_si256((__m256i*) (output + 8), _mm256_permute2x128_si256(u2, u3, 0x20));
+    _mm256_storeu_si256((__m256i*) (output + 16), _mm256_permute2x128_si256(u0, u1, 0x31));
+    _mm256_storeu_si256((__m256i*) (output + 24), _mm256_permute2x128_si256(u2, u3, 0x31));
+}
+#endif
+
+void Random::generate(unsigned long long seed, unsigned long long stream, unsigned long long firstBlock,
+                      long long numberOfBlocks, unsigned int* output)
+{
+    long long i = 0;
+#ifdef __AVX2__
+    for (; i + 8 <= numberOfBlocks; i += 8)
+    {
+        uint64_t block = firstBlock + i;
+        if ((uint32_t) block > 0xFFFFFFFF - 7)
+            break; // Carry into the upper half, finish with the scalar version
+        philoxBlocks8(seed, stream, block, output + i * 4);
+    }
+#endif
+    for (; i < numberOfBlocks; i++)
+        philoxBlock(seed, stream, firstBlock + i, output + i * 4);
+}
+
+
+// --------------------------------------- Generator ---------------------------------------
+Random::Random(unsigned long long _seed, unsigned long long stream)
+{
+    seed(_seed, stream);
+}
+
+void Random::seed(unsigned long long _seed, unsigned long long stream)
+{
+    key = _seed;
+    streamID = stream;
+    setPosition(0);
+}
+
+void Random::setPosition(unsigned long long block)
+{
+    counter = block;
+    bufferPosition = 4;
+    gaussianPending = false;
+}
+
+unsigned int Random::next()
+{
+    if (bufferPosition == 4)
+    {
+        philoxBlock(key, streamID, counter++, buffer);
+        bufferPosition = 0;
+    }
+    return buffer[bufferPosition++];
+}
+
+float Random::nextFloat()
+{
+    return (next() >> 8) * UNIT_SCALE;
+}
+
+float Random::nextFloat(float minValue, float maxValue)
+{
+    return minValue + nextFloat() * (maxValue - minValue);
+}
+
+/**
+    Box-Muller transform, every pair of numbers gives two values
+*/
+float Random::nextGaussian()
+{
+    if (gaussianPending)
+    {
+        gaussianPending = false;
+        return pendingGaussian;
+    }
+
+    float u1 = ((next() >> 8) + 1) * UNIT_SCALE; // (0, 1] so the logarithm is finite
+    float u2 = (next() >> 8) * UNIT_SCALE;
+    float radius = sqrtf(-2.0f * logf(u1));
+    pendingGaussian = radius * sinf(TWO_PI * u2);
+    gaussianPending = true;
+    return radius * cosf(TWO_PI * u2);
+}
+
+int Random::nextInt(int bound)
+{
+    return (int) (((uint64_t) next() * (uint64_t) bound) >> 32);
+}
+
+void Random::fill(unsigned int* values, long long count)
+{
+    // Numbers left over in the buffer come first
+    long long i = 0;
+    while (i < count && bufferPosition < 4)
+        values[i++] = buffer[bufferPosition++];
+
+    // Whole blocks straight into the output
+    long long numberOfBlocks = (count - i) / 4;
+    generate(key, streamID, counter, numberOfBlocks, values + i);
+    counter += numberOfBlocks;
+    i += numberOfBlocks * 4;
+
+    while (i < count)
+        values[i++] = next();
+}
+
+void Random::fillUniform(float* values, long long count, float minValue, float maxValue)
+{
+    unsigned int bits[CHUNK_SIZE];
+    float scale = UNIT_SCALE * (maxValue - minValue);
+    for (long long start = 0; start < count; start += CHUNK_SIZE)
+    {
+        int size = count - start < CHUNK_SIZE ? count - start : CHUNK_SIZE;
+        fill(bits, size);
+        for (int i = 0; i < size; i++)
+            values[start + i] = minValue + (bits[i] >> 8) * scale;
+    }
+}
+
+void Random::fillGaussian(float* values, long long count, float mean, float standardDeviation)
+{
+    long long i = 0;
+    if (count > 0 && gaussianPending)
+    {
+        gaussianPending = false;
+        values[i++] = mean + standardDeviation * pendingGaussian;
+    }
+
+    // Pairs of values from pairs of numbers
+    unsigned int bits[CHUNK_SIZE];
+    while (count - i >= 2)
+    {
+        long long pairs = (count - i) / 2 < CHUNK_SIZE / 2 ? (count - i) / 2 : CHUNK_SIZE / 2;
+        fill(bits, pairs * 2);
+        for (int j = 0; j < pairs; j++)
+        {
+            float u1 = ((bits[2 * j] >> 8) + 1) * UNIT_SCALE;
+            float u2 = (bits[2 * j + 1] >> 8) * UNIT_SCALE;
+            float radius = sqrtf(-2.0f * logf(u1));
+            values[i++] = mean + standardDeviation * radius * cosf(TWO_PI * u2);
+            values[i++] = mean + standardDeviation * radius * sinf(TWO_PI * u2);
+        }
+    }
+
+    if (i < count)
+        values[i] = mean + standardDeviation * nextGaussian();
+}
+
+
+// --------------------------------------- Thread generators ---------------------------------------
+static std::atomic<unsigned long long> globalSeed(0);
+static std::atomic<unsigned int> globalSeedGeneration(0);
+static std::atomic<unsigned long long> nextThreadStream(0);
+
+// Thread generators use the upper half of the streams, the lower half is left to the caller
+static const unsigned long long THREAD_STREAM_BIT = 1ULL << 63;
+
+struct ThreadGenerator
+{
+    Random random;
+    unsigned int generation = 0xFFFFFFFF;
+    unsigned long long stream = nextThreadStream++ | THREAD_STREAM_BIT;
+};
+
+static thread_local ThreadGenerator threadGenerator;
+
+Random& Random::getThreadGenerator()
+{
+    unsigned int generation = globalSeedGeneration;
+    if (threadGenerator.generation != generation)
+    {
+        threadGenerator.random.seed(globalSeed, threadGenerator.stream);
+        threadGenerator.generation = generation;
+    }
+    return threadGenerator.random;
+}
+
+void Random::setGlobalSeed(unsigned long long seed)
+{
+    globalSeed = seed;
+    globalSeedGeneration++;
+}
@@ -0,0 +1,51 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/**
+    Counter based random number generator (Philox4x32-10).
+
+    Every block of four numbers is a pure function of (seed, stream, block index),
+    so any number of generators with different streams are independent, a generator
+    can jump to any position for free, and a range of numbers can be generated by
+    several threads with exactly the same result as a single thread.
+
+    The generator itself is a small value type, give every thread, layer or
+    neuron its own stream instead of sharing one.
+*/
+class Random
+{
+    public:
+        Random(unsigned long long seed = 0, unsigned long long stream = 0);
+
+        void seed(unsigned long long seed, unsigned long long stream = 0); // Restarts at block 0
+        void setPosition(unsigned long long block); // Jumps to the given block of four numbers
+
+        unsigned int next();
+        float nextFloat(); // [0, 1)
+        float nextFloat(float minValue, float maxValue); // [minValue, maxValue)
+        float nextGaussian(); // Standard normal distribution
+        int nextInt(int bound); // [0, bound)
+
+        // Bulk generation, the same numbers as calling the functions above count times
+        void fill(unsigned int* values, long long count);
+        void fillUniform(float* values, long long count, float minValue, float maxValue);
+        void fillGaussian(float* values, long long count, float mean, float standardDeviation);
+
+        // Stateless generation of numberOfBlocks * 4 numbers starting at firstBlock
+        static void generate(unsigned long long seed, unsigned long long stream, unsigned long long firstBlock,
+                             long long numberOfBlocks, unsigned int* output);
+
+        static Random& getThreadGenerator(); // A generator with a stream of its own for each thread
+        static void setGlobalSeed(unsigned long long seed); // Reseeds the thread generators
+
+    private:
+        unsigned long long key;
+        unsigned long long streamID;
+        unsigned long long counter; // Next block to generate
+        unsigned int buffer[4];
+        int bufferPosition; // 4 when the buffer is used up
+        bool gaussianPending;
+        float pendingGaussian;
+};
+
+#endif // RANDOM_H
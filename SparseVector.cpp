@@ -0,0 +1,113 @@
+#include "SparseVector.h"
+#include <iostream>
+#include <algorithm>
+
+SparseVector::SparseVector()
+{
+    size = 0;
+}
+
+SparseVector::SparseVector(int _size)
+{
+    size = _size;
+}
+
+SparseVector::~SparseVector()
+{
+
+}
+
+void SparseVector::setSize(int _size)
+{
+    size = _size;
+
+    int kept = 0;
+    for (int i = 0; i < (int) indices.size(); i++)
+    {
+        if (indices[i] >= 0 && indices[i] < size)
+        {
+            indices[kept] = indices[i];
+            values[kept] = values[i];
+            kept++;
+        }
+    }
+    indices.resize(kept);
+    values.resize(kept);
+}
+
+void SparseVector::add(int index, float value)
+{
+    if (index < 0 || index >= size)
+    {
+        std::cout << "Sparse vector: Index " << index << " is outside of the " << size << " dimensions!" << std::endl;
+        return;
+    }
+
+    indices.push_back(index);
+    values.push_back(value);
+}
+
+void SparseVector::clear()
+{
+    indices.clear();
+    values.clear();
+}
+
+void SparseVector::sort()
+{
+    std::vector<int> order(indices.size());
+    for (int i = 0; i < (int) order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return indices[a] < indices[b]; });
+
+    std::vector<int> sortedIndices;
+    std::vector<float> sortedValues;
+    sortedIndices.reserve(indices.size());
+    sortedValues.reserve(values.size());
+    for (int i = 0; i < (int) order.size(); i++)
+    {
+        if (!sortedIndices.empty() && sortedIndices.back() == indices[order[i]])
+            sortedValues.back() += values[order[i]];
+        else
+        {
+            sortedIndices.push_back(indices[order[i]]);
+            sortedValues.push_back(values[order[i]]);
+        }
+    }
+    indices.swap(sortedIndices);
+    values.swap(sortedValues);
+}
+
+void SparseVector::fromDense(const Matrix<float>& dataSample)
+{
+    clear();
+    size = dataSample.getSizeX();
+    const float* array = dataSample.getArrayRef();
+    for (int i = 0; i < size; i++)
+    {
+        if (array[i] != 0)
+        {
+            indices.push_back(i);
+            values.push_back(array[i]);
+        }
+    }
+}
+
+void SparseVector::toDense(Matrix<float>& dataSample) const
+{
+    dataSample.setSize(size, 1);
+    dataSample.clear();
+    float* array = dataSample.getArrayRef();
+    for (int i = 0; i < (int) indices.size(); i++)
+        array[indices[i]] += values[i];
+}
+
+int SparseVector::getSize() const
+{
+    return size;
+}
+
+int SparseVector::getNonZeroCount() const
+{
+    return indices.size();
+}
@@ -0,0 +1,39 @@
+#ifndef SPARSEVECTOR_H
+#define SPARSEVECTOR_H
+
+#include <vector>
+#include "Matrix.h"
+
+/**
+    A data sample with only a few non-zero features, e.g. one-hot or hashed
+    bag-of-features inputs, stored as index/value pairs.
+
+    Every index may occur at most once. The pairs need not be sorted but the
+    weights are accessed in index order when they are (see sort).
+*/
+class SparseVector
+{
+    public:
+        SparseVector();
+        SparseVector(int size);
+        ~SparseVector();
+
+        void setSize(int size); // Number of dimensions, pairs outside of them are dropped
+        void add(int index, float value);
+        void clear(); // Removes all pairs
+        void sort(); // Sorts the pairs by index and adds up duplicate indices
+
+        void fromDense(const Matrix<float>& dataSample); // (size, 1)
+        void toDense(Matrix<float>& dataSample) const;
+
+        int getSize() const;
+        int getNonZeroCount() const;
+
+        std::vector<int> indices;
+        std::vector<float> values;
+
+    private:
+        int size;
+};
+
+#endif // SPARSEVECTOR_H
@@ -0,0 +1,82 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <stddef.h>
+
+/**
+    Bounded lock-free queue for exactly one producer thread and one consumer thread.
+
+    The head is only written by the consumer and the tail only by the producer, each
+    on a cache line of its own. Every side also keeps a cached copy of the other
+    side's index so it only reads the shared one when the queue looks full (or empty).
+*/
+template <class T>
+class SpscQueue
+{
+    public:
+        SpscQueue(int capacity = 64)
+        {
+            // Round up to a power of two so the indices can be masked
+            size_t size = 1;
+            while (size < (size_t) capacity)
+                size <<= 1;
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        bool tryPush(T&& value)
+        {
+            size_t tail = producer.index.load(std::memory_order_relaxed);
+            if (tail - producer.cachedIndex > mask)
+            {
+                producer.cachedIndex = consumer.index.load(std::memory_order_acquire);
+                if (tail - producer.cachedIndex > mask)
+                    return false; // Full
+            }
+
+            slots[tail & mask] = std::move(value);
+            producer.index.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& value)
+        {
+            T* front = peek();
+            if (front == nullptr)
+                return false;
+
+            value = std::move(*front);
+            consumer.index.store(consumer.index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return true;
+        }
+
+        // The next element without removing it, nullptr if the queue is empty. Consumer only.
+        T* peek()
+        {
+            size_t head = consumer.index.load(std::memory_order_relaxed);
+            if (head == consumer.cachedIndex)
+            {
+                consumer.cachedIndex = producer.index.load(std::memory_order_acquire);
+                if (head == consumer.cachedIndex)
+                    return nullptr; // Empty
+            }
+            return &slots[head & mask];
+        }
+
+    private:
+        struct alignas(64) Side
+        {
+            std::atomic<size_t> index{0}; // Next slot to write (producer) or to read (consumer)
+            size_t cachedIndex = 0; // Last seen index of the other side
+        };
+
+        std::vector<T> slots;
+        size_t mask;
+        Side producer;
+        Side consumer;
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,201 @@
+#include "Standardizer.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <limits>
+#include <math.h>
+
+Standardizer::Standardizer(int featureSize)
+{
+    minimumDeviation = 1e-6;
+    reset(featureSize);
+}
+
+Standardizer::~Standardizer()
+{
+
+}
+
+void Standardizer::reset(int featureSize)
+{
+    count = 0;
+    mean.assign(featureSize, 0.0);
+    sumOfSquares.assign(featureSize, 0.0);
+    minimum.assign(featureSize, std::numeric_limits<float>::max());
+    maximum.assign(featureSize, -std::numeric_limits<float>::max());
+}
+
+/**
+    Two passes over every feature row of the batch, then the parallel update
+    mean = mean + delta * n / (count + n), m2 = m2 + m2Batch + delta^2 * count * n / (count + n)
+*/
+void Standardizer::add(const Matrix<float>& dataSamples)
+{
+    int numberOfSamples = dataSamples.getSizeY();
+    if (count == 0 && mean.empty())
+        reset(dataSamples.getSizeX());
+    if (dataSamples.getSizeX() != getFeatureSize())
+    {
+        std::cout << "Standardizer: Incorrect number of feature dimension entered for data samples. Got "
+            << dataSamples.getSizeX() << ". Expected " << getFeatureSize() << std::endl;
+        return;
+    }
+    if (numberOfSamples == 0)
+        return;
+
+    // Every feature is a contiguous row over the samples
+    const float* samples = dataSamples.getArrayRef();
+    long long total = count + numberOfSamples;
+    for (int k = 0; k < getFeatureSize(); k++)
+    {
+        const float* row = samples + (size_t) k * numberOfSamples;
+        double sum = 0;
+        float rowMinimum = minimum[k], rowMaximum = maximum[k];
+        for (int s = 0; s < numberOfSamples; s++)
+        {
+            sum += row[s];
+            rowMinimum = std::min(rowMinimum, row[s]);
+            rowMaximum = std::max(rowMaximum, row[s]);
+        }
+        double batchMean = sum / numberOfSamples;
+        double batchSumOfSquares = 0;
+        for (int s = 0; s < numberOfSamples; s++)
+            batchSumOfSquares += (row[s] - batchMean) * (row[s] - batchMean);
+
+        double delta = batchMean - mean[k];
+        mean[k] += delta * numberOfSamples / total;
+        sumOfSquares[k] += batchSumOfSquares + delta * delta * count * numberOfSamples / total;
+        minimum[k] = rowMinimum;
+        maximum[k] = rowMaximum;
+    }
+    count = total;
+}
+
+void Standardizer::add(Array<Matrix<float>>& dataSamples)
+{
+    for (int i = 0; i < dataSamples.size(); i++)
+        add(dataSamples[i]);
+}
+
+void Standardizer::merge(const Standardizer& other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0)
+    {
+        *this = other;
+        return;
+    }
+    if (other.getFeatureSize() != getFeatureSize())
+    {
+        std::cout << "Standardizer: Cannot merge statistics of " << other.getFeatureSize() << " features into " << getFeatureSize() << std::endl;
+        return;
+    }
+
+    long long total = count + other.count;
+    for (int k = 0; k < getFeatureSize(); k++)
+    {
+        double delta = other.mean[k] - mean[k];
+        mean[k] += delta * other.count / total;
+        sumOfSquares[k] += other.sumOfSquares[k] + delta * delta * count * other.count / total;
+        minimum[k] = std::min(minimum[k], other.minimum[k]);
+        maximum[k] = std::max(maximum[k], other.maximum[k]);
+    }
+    count = total;
+}
+
+void Standardizer::transform(Matrix<float>& dataSamples) const
+{
+    if (dataSamples.getSizeX() != getFeatureSize())
+    {
+        std::cout << "Standardizer: Incorrect number of feature dimension entered for data samples. Got "
+            << dataSamples.getSizeX() << ". Expected " << getFeatureSize() << std::endl;
+        return;
+    }
+
+    std::vector<float> scale = getScale(), shift = getShift();
+    int numberOfSamples = dataSamples.getSizeY();
+    float* samples = dataSamples.getArrayRef();
+    for (int k = 0; k < getFeatureSize(); k++)
+    {
+        float* row = samples + (size_t) k * numberOfSamples;
+        for (int s = 0; s < numberOfSamples; s++)
+            row[s] = row[s] * scale[k] + shift[k];
+    }
+}
+
+void Standardizer::transform(Array<Matrix<float>>& dataSamples) const
+{
+    for (int i = 0; i < dataSamples.size(); i++)
+        transform(dataSamples[i]);
+}
+
+/**
+    w . (x * scale + shift) + b = (w * scale) . x + (w . shift + b)
+*/
+bool Standardizer::foldInto(NeuralNetwork& network) const
+{
+    if (network.layers.size() < 2 || network.layers[1].layerType != FULLY_CONNECTED)
+    {
+        std::cout << "Standardizer: Only a fully connected first layer can take the standardisation!" << std::endl;
+        return false;
+    }
+
+    std::vector<float> scale = getScale(), shift = getShift();
+    NeuralNetworkLayer& layer = network.layers[1];
+    for (int i = 0; i < layer.size(); i++)
+    {
+        Matrix<float>& weightMatrix = layer.neurons[i].weightMatrix;
+        if (weightMatrix.getSizeX() != getFeatureSize() + 1)
+        {
+            std::cout << "Standardizer: The first layer takes " << weightMatrix.getSizeX() - 1 << " features, not "
+                << getFeatureSize() << std::endl;
+            return false;
+        }
+    }
+    for (int i = 0; i < layer.size(); i++)
+    {
+        float* weights = layer.neurons[i].weightMatrix.getArrayRef();
+        double bias = weights[0];
+        for (int k = 0; k < getFeatureSize(); k++)
+        {
+            bias += (double) weights[k + 1] * shift[k];
+            weights[k + 1] *= scale[k];
+        }
+        weights[0] = (float) bias;
+    }
+    return true;
+}
+
+std::vector<float> Standardizer::getScale() const
+{
+    std::vector<float> scale(getFeatureSize());
+    for (int k = 0; k < getFeatureSize(); k++)
+    {
+        double deviation = getStandardDeviation(k);
+        scale[k] = deviation > minimumDeviation ? (float) (1 / deviation) : 1.0f;
+    }
+    return scale;
+}
+
+std::vector<float> Standardizer::getShift() const
+{
+    std::vector<float> scale = getScale(), shift(getFeatureSize());
+    for (int k = 0; k < getFeatureSize(); k++)
+        shift[k] = (float) (-mean[k] * scale[k]);
+    return shift;
+}
+
+double Standardizer::getVariance(int feature) const
+{
+    return count > 0 ? sumOfSquares[feature] / count : 0;
+}
+
+double Standardizer::getStandardDeviation(int feature) const
+{
+    return sqrt(getVariance(feature));
+}
+
+int Standardizer::getFeatureSize() const
+{
+    return mean.size();
+}
@@ -0,0 +1,57 @@
+#ifndef STANDARDIZER_H
+#define STANDARDIZER_H
+
+#include <vector>
+#include "Matrix.h"
+#include "Array.h"
+
+class NeuralNetwork;
+
+/**
+    Streaming feature statistics and the standardisation (x - mean) / deviation.
+
+    Features in ranges like -500 to 500 saturate logistic and tanh units from the
+    first sample, standardised features train much faster. The statistics are
+    collected in one pass in double precision: every batch is reduced to its own
+    mean and sum of squared deviations per feature and merged into the totals with
+    the parallel form of Welford's update, so standardizers of several threads or
+    data shards can be combined with merge. Minimum and maximum are kept as well.
+
+    Samples are standardised with transform while training. Afterwards foldInto
+    moves the transform into the weights and biases of the first layer, so the
+    deployed network takes the raw features at no extra cost (getScale and
+    getShift give it to InferenceOptimizer for snapshots):
+
+        standardizer.add(trainingSamples);
+        standardizer.transform(trainingSamples);
+        ... train ...
+        standardizer.foldInto(network);
+*/
+class Standardizer
+{
+    public:
+        Standardizer(int featureSize = 0);
+        ~Standardizer();
+
+        void reset(int featureSize);
+        void add(const Matrix<float>& dataSamples); // (featureSize, numberOfSamples)
+        void add(Array<Matrix<float>>& dataSamples); // Samples of (featureSize, 1)
+        void merge(const Standardizer& other); // Adds the statistics of other samples
+
+        void transform(Matrix<float>& dataSamples) const; // In place, (featureSize, numberOfSamples)
+        void transform(Array<Matrix<float>>& dataSamples) const;
+        bool foldInto(NeuralNetwork& network) const; // The first layer then standardises raw features itself
+
+        std::vector<float> getScale() const; // 1 / deviation, standardised = raw * scale + shift
+        std::vector<float> getShift() const; // -mean / deviation
+        double getVariance(int feature) const; // Of the population
+        double getStandardDeviation(int feature) const;
+        int getFeatureSize() const;
+
+        long long count;
+        std::vector<double> mean, sumOfSquares; // Sum of squared deviations from the mean
+        std::vector<float> minimum, maximum;
+        double minimumDeviation; // Features which barely vary are only centred
+};
+
+#endif // STANDARDIZER_H
@@ -0,0 +1,225 @@
+#ifndef STATICNETWORK_H
+#define STATICNETWORK_H
+
+#include <array>
+#include <iostream>
+#include "EActivationFunction.h"
+#include "ActivationFunction.h"
+#include "NetworkSnapshot.h"
+
+// Number of weights (including biases) of fully connected layers of the given sizes, the input layer has none
+template <size_t N>
+constexpr int staticNetworkParameterCount(const std::array<int, N>& layerSizes)
+{
+    int count = 0;
+    for (size_t i = 1; i < N; i++)
+        count += layerSizes[i] * (layerSizes[i - 1] + 1);
+    return count;
+}
+
+/**
+    A fully connected network whose topology is fixed at compile time, for tiny
+    models on latency critical paths.
+
+    StaticNetwork<TANH, LOGISTIC, 2, 1, 1> is the 2-1-1 network of main.cpp: the
+    sizes start with the input layer, the hidden layers share the first activation
+    function and the output layer uses the second one. All weights live in one
+    std::array in the order of NetworkSnapshot (layer by layer, neuron by neuron,
+    bias first), the loop bounds are constants so the compiler unrolls them, and
+    neither predict nor train touch the heap.
+
+    train is one step of backpropagation with plain gradient descent, following the
+    sign convention of the delta rule. Convert with fromNetwork and toNetwork.
+*/
+template <EActivationFunction HiddenActivation, EActivationFunction OutputActivation, int... Sizes>
+class StaticNetwork
+{
+    static_assert(sizeof...(Sizes) >= 2, "A static network needs an input and an output layer");
+
+    public:
+        static constexpr int numberOfLayers = sizeof...(Sizes); // Including the input layer
+        static constexpr std::array<int, numberOfLayers> layerSizes = {Sizes...};
+        static constexpr int inputSize = layerSizes[0];
+        static constexpr int outputSize = layerSizes[numberOfLayers - 1];
+        static constexpr int neuronCount = (Sizes + ...) - inputSize; // Excluding the input layer
+        static constexpr int parameterCount = staticNetworkParameterCount(layerSizes);
+
+        void predict(const float* input, float* output) const
+        {
+            std::array<float, neuronCount> netInputs;
+            std::array<float, neuronCount> outputs;
+            forward<1>(input, netInputs.data(), outputs.data());
+            for (int i = 0; i < outputSize; i++)
+                output[i] = outputs[neuronOffset(numberOfLayers - 1) + i];
+        }
+
+        std::array<float, outputSize> predict(const std::array<float, inputSize>& input) const
+        {
+            std::array<float, outputSize> output;
+            predict(input.data(), output.data());
+            return output;
+        }
+
+        // One backpropagation step towards the target, returns the squared error before the step
+        float train(const float* input, const float* target, float learningRate)
+        {
+            std::array<float, neuronCount> netInputs;
+            std::array<float, neuronCount> outputs;
+            std::array<float, neuronCount> deltas;
+            forward<1>(input, netInputs.data(), outputs.data());
+
+            // (t - y) * derived_activation_function for the output layer
+            float squaredError = 0;
+            constexpr int outputOffset = neuronOffset(numberOfLayers - 1);
+            for (int i = 0; i < outputSize; i++)
+            {
+                float error = target[i] - outputs[outputOffset + i];
+                squaredError += error * error;
+                deltas[outputOffset + i] = error * activateDerived(OutputActivation, netInputs[outputOffset + i]);
+            }
+
+            // All deltas are calculated before any weight changes
+            if constexpr (numberOfLayers > 2)
+                backward<numberOfLayers - 2>(netInputs.data(), deltas.data());
+            update<1>(input, outputs.data(), deltas.data(), learningRate);
+            return squaredError;
+        }
+
+        bool fromSnapshot(const NetworkSnapshot& snapshot)
+        {
+            if (!matches(snapshot))
+            {
+                std::cout << "Static network: The snapshot has a different topology or different activation functions!" << std::endl;
+                return false;
+            }
+
+            for (int i = 0; i < parameterCount; i++)
+                weights[i] = snapshot.weights[i];
+            return true;
+        }
+
+        bool fromNetwork(NeuralNetwork& network)
+        {
+            NetworkSnapshot snapshot;
+            snapshot.capture(network);
+            return fromSnapshot(snapshot);
+        }
+
+        // The network must have the same layer sizes, its activation functions are set
+        bool toNetwork(NeuralNetwork& network) const
+        {
+            NetworkSnapshot snapshot;
+            snapshot.layerSizes.assign(layerSizes.begin(), layerSizes.end());
+            snapshot.activationFunctions.assign(numberOfLayers - 1, HiddenActivation);
+            snapshot.activationFunctions.back() = OutputActivation;
+            snapshot.weights.assign(weights.begin(), weights.end());
+            return snapshot.restore(network);
+        }
+
+        std::array<float, parameterCount> weights{}; // See above for the order
+
+    private:
+        // First weight of a layer within weights
+        static constexpr int weightOffset(int layer)
+        {
+            int offset = 0;
+            for (int i = 1; i < layer; i++)
+                offset += layerSizes[i] * (layerSizes[i - 1] + 1);
+            return offset;
+        }
+
+        // First output of a layer within the per neuron buffers
+        static constexpr int neuronOffset(int layer)
+        {
+            int offset = 0;
+            for (int i = 1; i < layer; i++)
+                offset += layerSizes[i];
+            return offset;
+        }
+
+        static constexpr EActivationFunction activationFunction(int layer)
+        {
+            return layer == numberOfLayers - 1 ? OutputActivation : HiddenActivation;
+        }
+
+        bool matches(const NetworkSnapshot& snapshot) const
+        {
+            if ((int) snapshot.layerSizes.size() != numberOfLayers || (int) snapshot.weights.size() != parameterCount)
+                return false;
+            for (int i = 0; i < numberOfLayers; i++)
+                if (snapshot.layerSizes[i] != layerSizes[i])
+                    return false;
+            for (int i = 1; i < numberOfLayers; i++)
+                if (snapshot.activationFunctions[i - 1] != activationFunction(i))
+                    return false;
+            return true;
+        }
+
+        template <int Layer>
+        void forward(const float* input, float* netInputs, float* outputs) const
+        {
+            constexpr int previousSize = layerSizes[Layer - 1];
+            constexpr int size = layerSizes[Layer];
+            constexpr int offset = neuronOffset(Layer);
+            const float* layerInput = Layer == 1 ? input : outputs + neuronOffset(Layer - 1);
+            const float* weight = weights.data() + weightOffset(Layer);
+
+            for (int j = 0; j < size; j++)
+            {
+                // Bias first, then the weighted inputs
+                float sum = weight[j * (previousSize + 1)];
+                for (int k = 0; k < previousSize; k++)
+                    sum += weight[j * (previousSize + 1) + k + 1] * layerInput[k];
+                netInputs[offset + j] = sum;
+                outputs[offset + j] = activate(activationFunction(Layer), sum);
+            }
+
+            if constexpr (Layer + 1 < numberOfLayers)
+                forward<Layer + 1>(input, netInputs, outputs);
+        }
+
+        // Deltas of a hidden layer from the deltas of the layer after it
+        template <int Layer>
+        void backward(const float* netInputs, float* deltas) const
+        {
+            constexpr int size = layerSizes[Layer];
+            constexpr int nextSize = layerSizes[Layer + 1];
+            constexpr int offset = neuronOffset(Layer);
+            constexpr int nextOffset = neuronOffset(Layer + 1);
+            const float* nextWeight = weights.data() + weightOffset(Layer + 1);
+
+            for (int j = 0; j < size; j++)
+            {
+                float sum = 0;
+                for (int z = 0; z < nextSize; z++)
+                    sum += nextWeight[z * (size + 1) + j + 1] * deltas[nextOffset + z]; // w * delta
+                deltas[offset + j] = sum * activateDerived(HiddenActivation, netInputs[offset + j]);
+            }
+
+            if constexpr (Layer > 1)
+                backward<Layer - 1>(netInputs, deltas);
+        }
+
+        template <int Layer>
+        void update(const float* input, const float* outputs, const float* deltas, float learningRate)
+        {
+            constexpr int previousSize = layerSizes[Layer - 1];
+            constexpr int size = layerSizes[Layer];
+            constexpr int offset = neuronOffset(Layer);
+            const float* layerInput = Layer == 1 ? input : outputs + neuronOffset(Layer - 1);
+            float* weight = weights.data() + weightOffset(Layer);
+
+            for (int j = 0; j < size; j++)
+            {
+                float step = learningRate * deltas[offset + j];
+                weight[j * (previousSize + 1)] += step;
+                for (int k = 0; k < previousSize; k++)
+                    weight[j * (previousSize + 1) + k + 1] += step * layerInput[k];
+            }
+
+            if constexpr (Layer + 1 < numberOfLayers)
+                update<Layer + 1>(input, outputs, deltas, learningRate);
+        }
+};
+
+#endif // STATICNETWORK_H
@@ -0,0 +1,288 @@
+#include "TrainingMonitor.h"
+#include "NeuralNetwork.h"
+#include <iostream>
+#include <limits>
+#include <math.h>
+
+TrainingMonitor::TrainingMonitor(Array<Matrix<float>>& _validationSamples, Array<Array<float>>& _validationVectors)
+{
+    validationSamples = &_validationSamples;
+    validationVectors = &_validationVectors;
+
+    evaluationInterval = 0;
+    epochInterval = 1;
+    patience = 5;
+    plateauPatience = 2;
+    decayFactor = 0.5f;
+    minimumLearningRate = 0;
+    minimumImprovement = 0;
+    restoreBestWeights = true;
+
+    snapshotPending = false;
+    running = false;
+    busy = false;
+    stopRequested = false;
+    decaysRequested = 0;
+
+    networkSupported = true;
+    evaluationDue = false;
+    samplesSinceEvaluation = 0;
+    epochsSinceEvaluation = 0;
+    evaluationsWithoutImprovement = 0;
+    evaluationsSinceDecay = 0;
+    numberOfEvaluations = 0;
+    bestLoss = std::numeric_limits<float>::infinity();
+    bestAccuracy = 0;
+    lastLoss = std::numeric_limits<float>::infinity();
+    lastAccuracy = 0;
+}
+
+TrainingMonitor::~TrainingMonitor()
+{
+    // Stop the background thread if training was never ended properly
+    if (evaluator.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_all();
+        evaluator.join();
+    }
+}
+
+void TrainingMonitor::begin(NeuralNetwork& network)
+{
+    if (validationSamples->size() != validationVectors->size())
+        std::cout << "Training monitor: The validation sample vector size is not equal to the classification vector size!" << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshotPending = false;
+        stopRequested = false;
+        decaysRequested = 0;
+        evaluationDue = false;
+        samplesSinceEvaluation = 0;
+        epochsSinceEvaluation = 0;
+        evaluationsWithoutImprovement = 0;
+        evaluationsSinceDecay = 0;
+        numberOfEvaluations = 0;
+        bestLoss = std::numeric_limits<float>::infinity();
+        bestAccuracy = 0;
+        lastLoss = std::numeric_limits<float>::infinity();
+        lastAccuracy = 0;
+        // Starting point in case nothing improves on it
+        networkSupported = bestSnapshot.capture(network);
+        if (!networkSupported)
+            std::cout << "Training monitor: Networks with convolution or pooling layers cannot be validated, the monitor stays idle!" << std::endl;
+    }
+
+    if (!evaluator.joinable())
+    {
+        running = true;
+        evaluator = std::thread(&TrainingMonitor::evaluationLoop, this);
+    }
+}
+
+void TrainingMonitor::sampleProcessed(NeuralNetwork& network)
+{
+    // Apply the learning rate decays requested by the evaluator
+    while (decaysRequested > 0)
+    {
+        decaysRequested--;
+        network.learningRate *= decayFactor;
+        if (network.learningRate < minimumLearningRate)
+            network.learningRate = minimumLearningRate;
+    }
+
+    if (evaluationInterval > 0 && ++samplesSinceEvaluation >= evaluationInterval)
+        requestEvaluation(network);
+    else if (evaluationDue) // The evaluator was busy when the last epoch finished
+        requestEvaluation(network);
+}
+
+void TrainingMonitor::epochFinished(NeuralNetwork& network)
+{
+    if (epochInterval > 0 && ++epochsSinceEvaluation >= epochInterval)
+        requestEvaluation(network);
+}
+
+void TrainingMonitor::end(NeuralNetwork& network)
+{
+    // Wait for the evaluation in progress
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]{ return !snapshotPending && !busy; });
+    }
+
+    // Evaluate the final weights here, the evaluator is idle
+    if (networkSupported && workingSnapshot.capture(network))
+        evaluate(workingSnapshot);
+
+    if (restoreBestWeights)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!bestSnapshot.isEmpty())
+            bestSnapshot.restore(network);
+    }
+
+    // Stop the background thread
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    if (evaluator.joinable())
+        evaluator.join();
+}
+
+bool TrainingMonitor::shouldStop()
+{
+    return stopRequested;
+}
+
+/**
+    Hands a snapshot of the current weights to the evaluator if it is idle.
+    Otherwise the request stays due and is retried on the next sample.
+*/
+void TrainingMonitor::requestEvaluation(NeuralNetwork& network)
+{
+    if (!networkSupported)
+        return;
+    if (busy)
+    {
+        evaluationDue = true;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingSnapshot.capture(network);
+        snapshotPending = true;
+        busy = true;
+    }
+    condition.notify_all();
+    evaluationDue = false;
+    samplesSinceEvaluation = 0;
+    epochsSinceEvaluation = 0;
+}
+
+void TrainingMonitor::evaluationLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this]{ return snapshotPending || !running; });
+        if (!running)
+            return;
+
+        // Take the snapshot (a swap, no copy) and evaluate it without holding the lock
+        std::swap(pendingSnapshot, workingSnapshot);
+        snapshotPending = false;
+        lock.unlock();
+        evaluate(workingSnapshot);
+        lock.lock();
+        busy = false;
+        condition.notify_all();
+    }
+}
+
+void TrainingMonitor::evaluate(NetworkSnapshot& snapshot)
+{
+    /// 1) Calculate the loss and the accuracy on the validation set
+    Matrix<float> output;
+    double loss = 0;
+    int correct = 0;
+    int numberOfSamples = validationSamples->size();
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+        Array<float>& target = (*validationVectors)[i];
+        snapshot.predict((*validationSamples)[i], output);
+        if (output.getSizeX() != target.size())
+        {
+            std::cout << "Training monitor: The validation classification vector size is not equal to the output layer size!" << std::endl;
+            return;
+        }
+
+        int predictedClass = 0, targetClass = 0;
+        for (int j = 0; j < target.size(); j++)
+        {
+            float error = target[j] - output[j][0];
+            loss += error * error;
+            if (output[j][0] > output[predictedClass][0]) predictedClass = j;
+            if (target[j] > target[targetClass]) targetClass = j;
+        }
+
+        // A single output is a binary classification, compare the rounded response instead
+        if (target.size() == 1)
+            correct += round(output[0][0]) == target[0];
+        else
+            correct += predictedClass == targetClass;
+    }
+
+    if (numberOfSamples == 0)
+        return;
+
+    /// 2) Keep track of the best snapshot and request decays or the stop
+    std::lock_guard<std::mutex> lock(mutex);
+    lastLoss = loss / (numberOfSamples * snapshot.getOutputSize());
+    lastAccuracy = correct / (float) numberOfSamples * 100.0f;
+    numberOfEvaluations++;
+
+    if (lastLoss < bestLoss - minimumImprovement)
+    {
+        bestLoss = lastLoss;
+        bestAccuracy = lastAccuracy;
+        bestSnapshot = snapshot;
+        evaluationsWithoutImprovement = 0;
+        evaluationsSinceDecay = 0;
+    }
+    else
+    {
+        evaluationsWithoutImprovement++;
+        evaluationsSinceDecay++;
+        if (plateauPatience > 0 && evaluationsSinceDecay >= plateauPatience)
+        {
+            decaysRequested++;
+            evaluationsSinceDecay = 0;
+        }
+        if (patience > 0 && evaluationsWithoutImprovement >= patience)
+            stopRequested = true;
+    }
+}
+
+float TrainingMonitor::getBestLoss()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bestLoss;
+}
+
+float TrainingMonitor::getBestAccuracy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bestAccuracy;
+}
+
+float TrainingMonitor::getLastLoss()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastLoss;
+}
+
+float TrainingMonitor::getLastAccuracy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastAccuracy;
+}
+
+int TrainingMonitor::getNumberOfEvaluations()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numberOfEvaluations;
+}
+
+NetworkSnapshot TrainingMonitor::getBestSnapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bestSnapshot;
+}
@@ -0,0 +1,87 @@
+#ifndef TRAININGMONITOR_H
+#define TRAININGMONITOR_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "Array.h"
+#include "Matrix.h"
+#include "NetworkSnapshot.h"
+
+class NeuralNetwork;
+
+/**
+    Evaluates a held-out validation set while the network is being trained.
+
+    Every evaluation interval the training thread copies the weights into a
+    snapshot and hands it to a background thread, so training never waits for
+    the evaluation. If the evaluator is still busy the hand over is retried on
+    every following sample, also when evaluating per epoch. The validation loss
+    is the mean squared error.
+
+    Attach it with NeuralNetwork::trainingMonitor before calling backpropagationStochastic.
+*/
+class TrainingMonitor
+{
+    public:
+        TrainingMonitor(Array<Matrix<float>> &validationSamples, Array<Array<float>> &validationVectors);
+        ~TrainingMonitor();
+
+        // Called by the training loop
+        void begin(NeuralNetwork& network);
+        void sampleProcessed(NeuralNetwork& network);
+        void epochFinished(NeuralNetwork& network);
+        void end(NeuralNetwork& network);
+        bool shouldStop();
+
+        // Results
+        float getBestLoss();
+        float getBestAccuracy();
+        float getLastLoss();
+        float getLastAccuracy();
+        int getNumberOfEvaluations();
+        NetworkSnapshot getBestSnapshot();
+
+        // Settings
+        int evaluationInterval; // Samples between evaluations, 0 disables
+        int epochInterval; // Epochs between evaluations, 0 disables
+        int patience; // Evaluations without improvement before training stops, 0 disables
+        int plateauPatience; // Evaluations without improvement before the learning rate decays, 0 disables
+        float decayFactor; // Learning rate multiplier applied on a plateau
+        float minimumLearningRate;
+        float minimumImprovement; // Smallest loss decrease counted as an improvement
+        bool restoreBestWeights; // Load the best snapshot into the network when training ends
+
+    private:
+        void requestEvaluation(NeuralNetwork& network);
+        void evaluationLoop();
+        void evaluate(NetworkSnapshot& snapshot);
+
+        Array<Matrix<float>>* validationSamples;
+        Array<Array<float>>* validationVectors;
+
+        std::thread evaluator;
+        std::mutex mutex;
+        std::condition_variable condition;
+        NetworkSnapshot pendingSnapshot; // Filled by the training thread
+        NetworkSnapshot workingSnapshot; // Evaluated by the background thread
+        NetworkSnapshot bestSnapshot;
+        bool snapshotPending;
+        bool running;
+        std::atomic<bool> busy;
+        std::atomic<bool> stopRequested;
+        std::atomic<int> decaysRequested;
+
+        bool networkSupported; // False for convolution and pooling layers, which snapshots do not hold
+        bool evaluationDue; // Set while a request waits for the busy evaluator
+        int samplesSinceEvaluation;
+        int epochsSinceEvaluation;
+        int evaluationsWithoutImprovement;
+        int evaluationsSinceDecay;
+        int numberOfEvaluations;
+        float bestLoss, bestAccuracy;
+        float lastLoss, lastAccuracy;
+};
+
+#endif // TRAININGMONITOR_H
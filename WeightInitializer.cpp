@@ -0,0 +1,158 @@
+#include "WeightInitializer.h"
+#include "Random.h"
+#include "NeuralNetwork.h"
+#include "PerceptronBatch.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <math.h>
+
+/**
+    The weights of one neuron, pointers are taken on the calling thread so no
+    matrix is detached concurrently
+*/
+struct InitializationJob
+{
+    float* weights;
+    int fanIn, fanOut;
+    unsigned long long stream;
+};
+
+static void initializeJobs(WeightInitializer* initializer, const InitializationJob* jobs, int first, int last)
+{
+    for (int i = first; i < last; i++)
+        initializer->fill(jobs[i].weights, jobs[i].fanIn, jobs[i].fanOut, jobs[i].stream);
+}
+
+static void runJobs(WeightInitializer* initializer, const std::vector<InitializationJob>& jobs, int numberOfThreads)
+{
+    int threads = numberOfThreads < 1 ? 1 : numberOfThreads;
+    int groupSize = (jobs.size() + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    for (int first = groupSize; first < (int) jobs.size(); first += groupSize)
+    {
+        int last = first + groupSize < (int) jobs.size() ? first + groupSize : jobs.size();
+        workers.push_back(std::thread(initializeJobs, initializer, jobs.data(), first, last));
+    }
+
+    // The first group is initialised on the calling thread
+    initializeJobs(initializer, jobs.data(), 0, groupSize < (int) jobs.size() ? groupSize : jobs.size());
+    for (int i = 0; i < (int) workers.size(); i++)
+        workers[i].join();
+}
+
+
+// --------------------------------------- Weight Initializer ---------------------------------------
+WeightInitializer::WeightInitializer()
+{
+    initializerEnum = XAVIER_UNIFORM;
+    seed = 0;
+    minValue = -1;
+    maxValue = 1;
+    bias = 0;
+    numberOfThreads = 1;
+}
+
+WeightInitializer::WeightInitializer(EWeightInitializer initializer, unsigned long long _seed)
+{
+    initializerEnum = initializer;
+    seed = _seed;
+    minValue = -1;
+    maxValue = 1;
+    bias = 0;
+    numberOfThreads = 1;
+}
+
+void WeightInitializer::fill(float* weights, int fanIn, int fanOut, unsigned long long stream)
+{
+    Random random(seed, stream);
+    weights[0] = bias;
+    float* values = weights + 1;
+
+    switch (initializerEnum)
+    {
+        case UNIFORM:
+            random.fillUniform(values, fanIn, minValue, maxValue);
+            break;
+
+        case XAVIER_UNIFORM:
+        {
+            float limit = sqrtf(6.0f / (fanIn + fanOut));
+            random.fillUniform(values, fanIn, -limit, limit);
+            break;
+        }
+
+        case XAVIER_NORMAL:
+            random.fillGaussian(values, fanIn, 0, sqrtf(2.0f / (fanIn + fanOut)));
+            break;
+
+        case HE_UNIFORM:
+        {
+            float limit = sqrtf(6.0f / fanIn);
+            random.fillUniform(values, fanIn, -limit, limit);
+            break;
+        }
+
+        case HE_NORMAL:
+            random.fillGaussian(values, fanIn, 0, sqrtf(2.0f / fanIn));
+            break;
+
+        default:
+            std::cout << "Weight initializer: Unknown initializer!" << std::endl;
+    }
+}
+
+void WeightInitializer::initialize(NeuralNetwork& network)
+{
+    std::vector<InitializationJob> jobs;
+    for (int i = 0; i < network.layers.size(); i++)
+    {
+        NeuralNetworkLayer& layer = network.layers[i];
+        if (layer.isInputLayer)
+            continue;
+
+        // A filter reaches kernelSize * kernelSize positions of every output channel
+        int fanOut = layer.layerType == CONVOLUTION ? layer.outputChannels * layer.kernelSize * layer.kernelSize : layer.size();
+        for (int j = 0; j < layer.neurons.size(); j++)
+        {
+            Matrix<float>& weightMatrix = layer.neurons[j].weightMatrix;
+            InitializationJob job;
+            job.weights = weightMatrix.getArrayRef();
+            job.fanIn = weightMatrix.getSizeX() - 1;
+            job.fanOut = fanOut;
+            job.stream = ((unsigned long long) i << 32) | j;
+            jobs.push_back(job);
+        }
+    }
+    runJobs(this, jobs, numberOfThreads);
+}
+
+void WeightInitializer::initialize(PerceptronBatch& batch)
+{
+    // The weights are interleaved across the neurons, generate every neuron into
+    // a contiguous buffer first
+    int numberOfNeurons = batch.getNumberOfNeurons();
+    int rowSize = batch.getFeatureSize() + 1;
+    std::vector<float> buffer((size_t) numberOfNeurons * rowSize);
+
+    std::vector<InitializationJob> jobs(numberOfNeurons);
+    for (int n = 0; n < numberOfNeurons; n++)
+    {
+        jobs[n].weights = buffer.data() + (size_t) n * rowSize;
+        jobs[n].fanIn = rowSize - 1;
+        jobs[n].fanOut = 1;
+        jobs[n].stream = n;
+    }
+    runJobs(this, jobs, numberOfThreads);
+
+    float* weights = batch.weightMatrix.getArrayRef();
+    for (int n = 0; n < numberOfNeurons; n++)
+        for (int k = 0; k < rowSize; k++)
+            weights[(size_t) k * numberOfNeurons + n] = buffer[(size_t) n * rowSize + k];
+}
+
+void WeightInitializer::initialize(Neuron& neuron, unsigned long long stream)
+{
+    fill(neuron.weightMatrix.getArrayRef(), neuron.weightMatrix.getSizeX() - 1, 1, stream);
+}
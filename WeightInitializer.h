@@ -0,0 +1,37 @@
+#ifndef WEIGHTINITIALIZER_H
+#define WEIGHTINITIALIZER_H
+
+#include "EWeightInitializer.h"
+
+class NeuralNetwork;
+class Neuron;
+class PerceptronBatch;
+
+/**
+    Fills the weights of networks and neurons from counter based random streams.
+
+    Every neuron draws from a stream of its own ((layer << 32) | neuron within a
+    network), so the result only depends on the seed: it is the same for any
+    number of threads and any order the neurons are visited in.
+*/
+class WeightInitializer
+{
+    public:
+        WeightInitializer();
+        WeightInitializer(EWeightInitializer initializer, unsigned long long seed);
+
+        void initialize(NeuralNetwork& network); // Every layer except the input layer
+        void initialize(PerceptronBatch& batch);
+        void initialize(Neuron& neuron, unsigned long long stream = 0);
+
+        // Fills a bias followed by fanIn weights
+        void fill(float* weights, int fanIn, int fanOut, unsigned long long stream);
+
+        EWeightInitializer initializerEnum; // Specifies the distribution to be used
+        unsigned long long seed;
+        float minValue, maxValue; // UNIFORM
+        float bias; // Value given to every bias
+        int numberOfThreads; // Number of threads the neurons are spread across
+};
+
+#endif // WEIGHTINITIALIZER_H
@@ -5,80 +5,13 @@
 
 #include "Neuron.h"
 #include "NeuralNetwork.h"
+#include "DataGenerator.h"
+#include "Random.h"
+#include "Standardizer.h"
+#include "WeightInitializer.h"
 
 using namespace std;
 
-void dataGenerator(int numberOfSamples, Matrix<float> &featureMatrix, Array<float> &classificationVector)
-{
-    // Set the matrix sizes
-    int dimensionality = 2;
-    featureMatrix.setSize(dimensionality, numberOfSamples);
-    classificationVector.setSize(numberOfSamples); // 1D column vector
-
-    // cout << "Sample data:" << endl;
-
-    for (int i = 0; i < numberOfSamples; i++)
-    {
-        // Set the feature matrix sample data range
-        for (int j = 0; j < dimensionality; j++)
-            featureMatrix[j][i] = rand() % 1001 - 500;
-
-        // The real classification function
-        if (featureMatrix[0][i] - featureMatrix[1][i] >= 0) // Condition: x - y >= 0
-            classificationVector[i] = 1;
-        else // Class 0 otherwise
-            classificationVector[i] = 0;
-    }
-}
-
-void nonLinearDataGenerator(int numberOfSamples, Matrix<float> &featureMatrix, Array<float> &classificationVector)
-{
-    // Set the matrix sizes
-    featureMatrix.setSize(3, numberOfSamples); // 1D samples
-    classificationVector.setSize(numberOfSamples); // 1D vector (y direction)
-
-    // cout << "Sample data:" << endl;
-
-    for (int i = 0; i < numberOfSamples; i++)
-    {
-        // Set the feature matrix sample data range
-        featureMatrix[0][i] = (float) (rand() % 10001) / 100.0f - 50.0f; // -50 <= x <= 50
-        featureMatrix[1][i] = (float) (rand() % 10001) / 100.0f - 50.0f; // -50 <= y <= 50
-        featureMatrix[2][i] = (float) (rand() % 10001) / 100.0f - 50.0f; // -50 <= z <= 50
-
-        // The real classification function
-        if (featureMatrix[0][i] * featureMatrix[0][i] + featureMatrix[0][i] * featureMatrix[1][i] - featureMatrix[1][i] * featureMatrix[1][i] + featureMatrix[1][i] * featureMatrix[2][i] >= 0) // Condition: xx + xy - yy + yz>= 0 -> Class 1
-//        if (featureMatrix[0][i] * featureMatrix[0][i] - featureMatrix[1][i] * featureMatrix[1][i] - featureMatrix[2][i] * featureMatrix[2][i] >= 0) // xx - yy - zz >= 0
-//        if (featureMatrix[0][i] - featureMatrix[1][i] + featureMatrix[2][i] >= 0) // x - y + z >= 0
-            classificationVector[i] = 1;
-        else // Class 0 otherwise
-            classificationVector[i] = 0;
-    }
-}
-
-void nonLinearSingleDataGenerator(Matrix<float> &featureMatrix, Array<float> &classificationVector)
-{
-    // Set the matrix sizes
-    featureMatrix.setSize(1, 1); // 1D samples
-    classificationVector.setSize(2); // 2 output classifications
-
-
-    // Set the feature matrix sample data range
-    featureMatrix[0][0] = (float) (rand() % 10001) / 100.0f - 50.0f; // -50 <= x <= 50
-
-    // The real classification function
-    if (sin(featureMatrix[0][0]) >= 0) // sin(x)
-    {
-        classificationVector[0] = 0;
-        classificationVector[1] = 1;
-    }
-    else // Class 0 otherwise
-    {
-        classificationVector[0] = 1;
-        classificationVector[1] = 0;
-    }
-}
-
 float perceptronTest()
 {
     cout << "### Neural network: Neuron test ###" << endl;
@@ -86,9 +19,10 @@ float perceptronTest()
     perceptron.activationFunctionEnum = TANH01;
     // perceptron.activationFunctionEnum = LOGISTIC;
     // perceptron.activationFunctionEnum = TANH; // Not sure why this doesn't work
+    DataGenerator generator(LINEAR_PROBLEM, Random::getThreadGenerator().next());
     Matrix<float> featureMatrix;
     Array<float> classificationVector;
-    dataGenerator(500, featureMatrix, classificationVector);
+    generator.generate(0, 500, featureMatrix, classificationVector);
 
     /* Learning phase */
     cout << "\nLearning phase:" << endl;
@@ -111,7 +45,7 @@ float perceptronTest()
     cout << "\nNew data testing phase" << endl;
     Matrix<float> testFeatureMatrix; // Generate test data
     Array<float> testClassificationMatrix;
-    dataGenerator(100, testFeatureMatrix, testClassificationMatrix);
+    generator.generate(500, 100, testFeatureMatrix, testClassificationMatrix); // Samples not seen during learning
     correct = 0;
     for (int i = 0; i < testClassificationMatrix.size(); i++)
     {
@@ -137,33 +71,31 @@ float neuralNetwork(EActivationFunction hidden, EActivationFunction output, bool
     neuralNetwork.layers[0].setActivationFunction(LINEAR);
     neuralNetwork.layers[1].setActivationFunction(hidden);
     neuralNetwork.layers[2].setActivationFunction(output);
+    WeightInitializer(XAVIER_UNIFORM, Random::getThreadGenerator().next()).initialize(neuralNetwork); // Sized for standardised inputs
 
+    DataGenerator generator(LINEAR_PROBLEM, Random::getThreadGenerator().next()); // Or QUADRATIC_PROBLEM (input size 3), SINE_PROBLEM (input size 1, output size 2)
     Matrix<float> featureMatrix;
     Array<float> classificationVector;
 
-    // Learning
+    // Learning on standardised features, the statistics come from a first pass over the samples
     int learningSize = 5000;
+    Standardizer standardizer;
+    generator.generate(0, learningSize, featureMatrix, classificationVector);
+    standardizer.add(featureMatrix);
     for (int i = 0; i < learningSize; i++)
     {
-        dataGenerator(1, featureMatrix, classificationVector);
-        // nonLinearDataGenerator(1, featureMatrix, classificationVector);
-        // nonLinearSingleDataGenerator(featureMatrix, classificationVector);
+        generator.generateSample(i, featureMatrix, classificationVector);
+        standardizer.transform(featureMatrix);
         neuralNetwork.backpropagation(featureMatrix, classificationVector);
     }
+    standardizer.foldInto(neuralNetwork); // The network takes the raw features from here on
 
     // Testing
     int testingSize = 1000;
-    int correct = 0;
-    for (int i = 0; i < testingSize; i++)
-    {
-        dataGenerator(1, featureMatrix, classificationVector);
-        // nonLinearDataGenerator(1, featureMatrix, classificationVector);
-        // nonLinearSingleDataGenerator(featureMatrix, classificationVector);
-        neuralNetwork.forwardPropagation(featureMatrix);
-        float response = neuralNetwork.getMaxResponse();
-        if (round(response) == classificationVector[0])
-            correct++;
-    }
+    Matrix<float> testFeatureMatrix, testTargetMatrix;
+    generator.generate(learningSize, testingSize, testFeatureMatrix, testTargetMatrix);
+    EvaluationResult result = neuralNetwork.evaluate(testFeatureMatrix, testTargetMatrix);
+    int correct = result.getConfusion(0, 0) + result.getConfusion(1, 1);
 
     if (printStuff)
     {
@@ -173,6 +105,7 @@ float neuralNetwork(EActivationFunction hidden, EActivationFunction output, bool
             << "\nNumber of hidden layers = " << numberOfHiddenLayers << std::endl;
         cout << "Correctly classified = " << correct << ", incorrectly classified = " << testingSize - correct << endl;
         cout << "Neural network success rate = " << (float) correct / (float) testingSize * 100.0f << "%" << endl;
+        result.print();
     }
     return (float) correct / (float) testingSize * 100.0f;
 }
@@ -242,7 +175,7 @@ void neuralNetworkFun()
 int main()
 {
     /* Initialisation */
-    srand(time(NULL));
+    Random::setGlobalSeed(time(NULL));
 
     // Neural network test 1
     neuralNetwork(LOGISTIC, LINEAR, true);